@@ -0,0 +1,111 @@
+#include "Bench.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+
+namespace bench {
+
+Runner::Runner(double minSeconds, std::string filter)
+    : minSeconds_(minSeconds), filter_(std::move(filter)) {}
+
+bool Runner::enabled(const std::string &name) const {
+  return filter_.empty() || name.find(filter_) != std::string::npos;
+}
+
+void Runner::measure(const std::string &name, const Params &params,
+                     const std::function<void(uint64_t)> &body) {
+  body(1); // 预热缓存与惰性分配
+
+  uint64_t iterations = 1;
+  double secs = 0;
+  for (;;) {
+    auto begin = std::chrono::steady_clock::now();
+    body(iterations);
+    secs = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         begin)
+               .count();
+    if (secs >= minSeconds_ || iterations >= (1ULL << 40))
+      break;
+    // 按已测速度估算下一轮所需次数，至多放大 10 倍
+    double scale = secs > 0 ? minSeconds_ * 1.2 / secs : 10;
+    iterations = static_cast<uint64_t>(iterations * std::min(scale, 10.0)) + 1;
+  }
+
+  Result r;
+  r.name = name;
+  r.params = params;
+  r.iterations = iterations;
+  r.nsPerOp = secs * 1e9 / iterations;
+  r.opsPerSec = iterations / secs;
+  add(std::move(r));
+}
+
+void Runner::add(Result result) {
+  std::cerr << "[Bench] " << result.name;
+  for (const auto &p : result.params)
+    std::cerr << " " << p.first << "=" << p.second;
+  std::cerr << ": " << result.nsPerOp << " ns/op, " << result.opsPerSec
+            << " ops/s\n";
+  results_.push_back(std::move(result));
+}
+
+static void writeParams(std::ostream &out, const Params &params) {
+  out << "{";
+  for (size_t i = 0; i < params.size(); ++i) {
+    out << (i ? ", " : "") << "\"" << params[i].first
+        << "\": " << params[i].second;
+  }
+  out << "}";
+}
+
+void Runner::writeJson(std::ostream &out) const {
+  char host[256] = "unknown";
+  gethostname(host, sizeof(host) - 1);
+  char date[32];
+  std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+  out.precision(6);
+  out << "{\n  \"context\": {\"date\": \"" << date << "\", \"host\": \""
+      << host << "\", \"cpus\": " << std::thread::hardware_concurrency()
+      << ", \"min_seconds\": " << minSeconds_ << "},\n  \"benchmarks\": [\n";
+  for (size_t i = 0; i < results_.size(); ++i) {
+    const Result &r = results_[i];
+    out << "    {\"name\": \"" << r.name << "\", \"params\": ";
+    writeParams(out, r.params);
+    out << std::fixed << ", \"iterations\": " << r.iterations
+        << ", \"ns_per_op\": " << r.nsPerOp
+        << ", \"ops_per_sec\": " << r.opsPerSec << std::defaultfloat;
+    if (!r.extra.empty()) {
+      out << ", \"metrics\": ";
+      writeParams(out, r.extra);
+    }
+    out << "}" << (i + 1 < results_.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n}\n";
+}
+
+std::string writeTempFile(const std::string &content) {
+  char path[] = "/tmp/wuthering-bench-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("[Bench] mkstemp");
+    std::exit(1);
+  }
+  size_t off = 0;
+  while (off < content.size()) {
+    ssize_t n = write(fd, content.data() + off, content.size() - off);
+    if (n <= 0)
+      break;
+    off += n;
+  }
+  close(fd);
+  return path;
+}
+
+} // namespace bench
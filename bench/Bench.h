@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// 自带的极简基准框架，不依赖第三方库：自动标定迭代次数，结果以 JSON 输出
+namespace bench {
+
+using Params = std::vector<std::pair<std::string, double>>;
+
+struct Result {
+  std::string name;
+  Params params;
+  uint64_t iterations = 0;
+  double nsPerOp = 0;
+  double opsPerSec = 0;
+  Params extra; // 延迟分位数等附加指标
+};
+
+class Runner {
+public:
+  Runner(double minSeconds, std::string filter);
+
+  // 名称不含过滤串时跳过整个用例（包括其准备工作）
+  bool enabled(const std::string &name) const;
+
+  // 以翻倍的迭代次数反复调用 body，直到单次耗时达到下限，记录 ns/op
+  void measure(const std::string &name, const Params &params,
+               const std::function<void(uint64_t)> &body);
+  // 自行计时的用例直接登记结果
+  void add(Result result);
+
+  double minSeconds() const { return minSeconds_; }
+  const std::vector<Result> &results() const { return results_; }
+  void writeJson(std::ostream &out) const;
+
+private:
+  double minSeconds_;
+  std::string filter_;
+  std::vector<Result> results_;
+};
+
+// 阻止编译器把被测结果当作无用代码消除
+template <class T> inline void doNotOptimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// 写入临时配置文件，返回路径；调用方负责删除
+std::string writeTempFile(const std::string &content);
+
+void registerMicroBenchmarks(Runner &runner);
+void registerEndToEndBenchmarks(Runner &runner);
+
+} // namespace bench
@@ -0,0 +1,49 @@
+#include "Bench.h"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+static void usage(const char *prog) {
+  std::cerr << "Usage: " << prog
+            << " [--filter <substr>] [--min-time <seconds>] [--out <file>]\n";
+}
+
+int main(int argc, char **argv) {
+  std::string filter, outPath;
+  double minSeconds = 0.2;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--filter" && hasValue) {
+      filter = argv[++i];
+    } else if (arg == "--min-time" && hasValue) {
+      minSeconds = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--out" && hasValue) {
+      outPath = argv[++i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  // 各模块在热路径上逐包打日志，测量期间屏蔽 stdout
+  std::cout.setstate(std::ios::badbit);
+  bench::Runner runner(minSeconds, filter);
+  bench::registerMicroBenchmarks(runner);
+  bench::registerEndToEndBenchmarks(runner);
+  std::cout.clear();
+
+  if (outPath.empty()) {
+    runner.writeJson(std::cout);
+    return 0;
+  }
+  std::ofstream out(outPath);
+  if (!out) {
+    std::cerr << "[Bench] Cannot write " << outPath << "\n";
+    return 1;
+  }
+  runner.writeJson(out);
+  std::cerr << "[Bench] Results written to " << outPath << "\n";
+  return 0;
+}
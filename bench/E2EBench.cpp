@@ -0,0 +1,137 @@
+#include "Bench.h"
+#include "QoS/QoSManager.h"
+#include "Traffic.h"
+#include "core/ForwardingPipeline.h"
+#include "core/MemoryPacketIO.h"
+#include "core/RoutingManager.h"
+#include "core/StaticPipeline.h"
+#include "firewall/Firewall.h"
+#include "nat/NATManager.h"
+#include "routing/StaticRouteProvider.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+
+namespace bench {
+
+static const std::vector<TrafficMix> kMixes = {
+    {"udp_small", 1024, {{64, 1}}, 0, 0},
+    {"tcp_bulk", 64, {{1500, 1}}, 100, 0},
+    // 经典 IMIX 7:4:1，TCP/UDP 混合，一成流量留在 LAN 内走路由
+    {"imix", 4096, {{64, 7}, {576, 4}, {1500, 1}}, 60, 10},
+};
+
+static constexpr size_t kPacketsPerRound = 20000;
+static constexpr size_t kFirewallRules = 100;
+static constexpr size_t kQosRules = 10;
+static constexpr size_t kRoutes = 100;
+
+// 与生产相近的配置规模：规则均不命中，目的地址落在末尾默认路由上
+static std::shared_ptr<StaticRouteProvider>
+loadConfig(Firewall &firewall, QoSManager &qos, RoutingManager &router) {
+  std::ostringstream fw, qs, rt;
+  for (size_t i = 0; i < kFirewallRules; ++i)
+    fw << ipv4String(ipv4(10, 1, i >> 8, i & 0xff)) << " ANY 0 0 ANY DENY\n";
+  for (size_t i = 0; i < kQosRules; ++i)
+    qs << ipv4String(ipv4(10, 2, i >> 8, i & 0xff)) << " ANY ANY 1000000\n";
+  for (size_t i = 0; i + 1 < kRoutes; ++i)
+    rt << ipv4String(ipv4(10, i >> 8, i & 0xff, 0))
+       << " 255.255.255.0 192.168.99.254 eth0\n";
+  rt << "0.0.0.0 0.0.0.0 192.168.99.254 eth0\n";
+
+  std::string fwPath = writeTempFile(fw.str());
+  std::string qsPath = writeTempFile(qs.str());
+  std::string rtPath = writeTempFile(rt.str());
+  firewall.loadRules(fwPath);
+  qos.loadRules(qsPath);
+  auto provider = std::make_shared<StaticRouteProvider>();
+  provider->loadFromFile(rtPath);
+  router.addProvider(provider);
+  std::remove(fwPath.c_str());
+  std::remove(qsPath.c_str());
+  std::remove(rtPath.c_str());
+  return provider;
+}
+
+static double percentile(std::vector<uint32_t> &sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  size_t idx = std::min(sorted.size() - 1, size_t(p * sorted.size()));
+  return sorted[idx];
+}
+
+// devirtualized 为 true 时以具体类型组合流水线，否则走运行时组合的
+// ForwardingPipeline，两者阶段与配置完全相同
+static void runMix(Runner &runner, const TrafficMix &mix,
+                   bool devirtualized) {
+  Firewall firewall;
+  QoSManager qos;
+  RoutingManager router;
+  NATManager nat;
+  nat.setPublicIp("lo");
+  auto provider = loadConfig(firewall, qos, router);
+
+  MemoryPacketIO io;
+  uint64_t bytes = 0;
+  for (auto &packet : generate(mix, kPacketsPerRound)) {
+    bytes += packet.size();
+    io.addLanPacket(std::move(packet));
+  }
+  ForwardingPipeline runtime(io, firewall, qos, router, nat);
+  auto compiled = makeOutboundPipeline(io, firewall, qos, *provider, nat);
+
+  // 逐轮回放直到达到最短时间；逐包记录流水线处理延迟
+  std::vector<uint32_t> latencies;
+  uint64_t packets = 0, rounds = 0;
+  auto begin = std::chrono::steady_clock::now();
+  double secs = 0;
+  do {
+    io.rewind();
+    while (auto packet = io.readPacket()) {
+      auto t0 = std::chrono::steady_clock::now();
+      if (devirtualized)
+        compiled.process(std::move(*packet));
+      else
+        runtime.processOutbound(std::move(*packet));
+      auto t1 = std::chrono::steady_clock::now();
+      latencies.push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0)
+              .count());
+      ++packets;
+    }
+    ++rounds;
+    secs = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         begin)
+               .count();
+  } while (secs < runner.minSeconds() * 5);
+
+  std::sort(latencies.begin(), latencies.end());
+  Result r;
+  r.name = (devirtualized ? "e2e_static_" : "e2e_") + mix.name;
+  r.params = {{"flows", double(mix.flows)},
+              {"tcp_percent", double(mix.tcpPercent)},
+              {"lan_percent", double(mix.lanPercent)}};
+  r.iterations = packets;
+  r.nsPerOp = secs * 1e9 / packets;
+  r.opsPerSec = packets / secs;
+  r.extra = {{"mbps", bytes * rounds * 8 / secs / 1e6},
+             {"p50_ns", percentile(latencies, 0.50)},
+             {"p90_ns", percentile(latencies, 0.90)},
+             {"p99_ns", percentile(latencies, 0.99)},
+             {"p999_ns", percentile(latencies, 0.999)},
+             {"max_ns", double(latencies.back())}};
+  runner.add(std::move(r));
+}
+
+void registerEndToEndBenchmarks(Runner &runner) {
+  for (const auto &mix : kMixes) {
+    if (runner.enabled("e2e_" + mix.name))
+      runMix(runner, mix, false);
+    if (runner.enabled("e2e_static_" + mix.name))
+      runMix(runner, mix, true);
+  }
+}
+
+} // namespace bench
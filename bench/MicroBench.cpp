@@ -0,0 +1,199 @@
+#include "Bench.h"
+#include "QoS/QoSManager.h"
+#include "Traffic.h"
+#include "core/Checksum.h"
+#include "core/ConfigSnapshot.h"
+#include "core/RoutingManager.h"
+#include "firewall/Firewall.h"
+#include "nat/NATManager.h"
+#include "routing/StaticRouteProvider.h"
+#include <arpa/inet.h>
+#include <cstdio>
+#include <memory>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sstream>
+
+namespace bench {
+
+// 规则均不命中被测报文，衡量最坏情况下的线性扫描
+static void benchFirewall(Runner &runner) {
+  const std::string name = "firewall_allow";
+  if (!runner.enabled(name))
+    return;
+  auto packet = makeUdp(ipv4(192, 168, 1, 2), ipv4(8, 8, 8, 8), 5000, 53, 32);
+  for (size_t rules : {1, 10, 100, 1000}) {
+    std::ostringstream conf;
+    for (size_t i = 0; i < rules; ++i)
+      conf << ipv4String(ipv4(10, 1, i >> 8, i & 0xff)) << " ANY 0 "
+           << 1000 + i % 1000 << " TCP DENY\n";
+    std::string path = writeTempFile(conf.str());
+    Firewall firewall;
+    firewall.loadRules(path);
+    std::remove(path.c_str());
+
+    runner.measure(name, {{"rules", double(rules)}}, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; ++i)
+        doNotOptimize(firewall.allow(packet));
+    });
+  }
+}
+
+// 目的地址只命中末尾的默认路由
+static void benchRoute(Runner &runner) {
+  const std::string name = "route_lookup";
+  if (!runner.enabled(name))
+    return;
+  for (size_t routes : {1, 10, 100, 1000}) {
+    std::ostringstream conf;
+    for (size_t i = 0; i + 1 < routes; ++i)
+      conf << ipv4String(ipv4(10, i >> 8, i & 0xff, 0))
+           << " 255.255.255.0 192.168.99.254 eth0\n";
+    conf << "0.0.0.0 0.0.0.0 192.168.99.254 eth0\n";
+    std::string path = writeTempFile(conf.str());
+    auto provider = std::make_shared<StaticRouteProvider>();
+    provider->loadFromFile(path);
+    std::remove(path.c_str());
+    RoutingManager router;
+    router.addProvider(provider);
+
+    runner.measure(name, {{"routes", double(routes)}}, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; ++i)
+        doNotOptimize(router.lookupRoute("8.8.8.8"));
+    });
+  }
+}
+
+// 先为 flows 条流建立映射，再轮转测量命中已有映射的 SNAT 与回程 DNAT
+static void benchNat(Runner &runner) {
+  if (!runner.enabled("nat_snat") && !runner.enabled("nat_dnat"))
+    return;
+  for (size_t flows : {100, 1000, 10000}) {
+    NATManager nat;
+    nat.setPublicIp("lo");
+    std::vector<std::vector<uint8_t>> out, back;
+    for (size_t i = 0; i < flows; ++i) {
+      out.push_back(makeUdp(ipv4(192, 168, 1 + i / 250, 2 + i % 250),
+                            ipv4(8, 8, 8, 8), 1024 + i % 60000, 53, 32));
+      auto snatted = nat.applySNAT(out.back());
+      // 回包：交换地址与端口
+      iphdr *ip = reinterpret_cast<iphdr *>(snatted.data());
+      udphdr *udp = reinterpret_cast<udphdr *>(snatted.data() + ip->ihl * 4);
+      std::swap(ip->saddr, ip->daddr);
+      std::swap(udp->source, udp->dest);
+      back.push_back(std::move(snatted));
+    }
+
+    Params params{{"flows", double(flows)}};
+    if (runner.enabled("nat_snat"))
+      runner.measure("nat_snat", params, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i)
+          doNotOptimize(nat.applySNAT(out[i % flows]));
+      });
+    if (runner.enabled("nat_dnat"))
+      runner.measure("nat_dnat", params, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i)
+          doNotOptimize(nat.applyDNAT(back[i % flows]));
+      });
+  }
+}
+
+// 前 rules-1 条不命中，最后一条命中且限速足够高，测量扫描与计量开销
+static void benchQos(Runner &runner) {
+  const std::string name = "qos_allow";
+  if (!runner.enabled(name))
+    return;
+  auto packet = makeUdp(ipv4(192, 168, 1, 2), ipv4(8, 8, 8, 8), 5000, 53, 32);
+  for (size_t rules : {1, 10, 100}) {
+    std::ostringstream conf;
+    for (size_t i = 0; i + 1 < rules; ++i)
+      conf << ipv4String(ipv4(10, 2, i >> 8, i & 0xff)) << " ANY UDP 1000000\n";
+    conf << "192.168.1.2 ANY ANY 18446744073709551615\n";
+    std::string path = writeTempFile(conf.str());
+    QoSManager qos;
+    qos.loadRules(path);
+    std::remove(path.c_str());
+
+    runner.measure(name, {{"rules", double(rules)}}, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; ++i)
+        doNotOptimize(qos.allow(packet));
+    });
+  }
+}
+
+// 防火墙规则的启动加载：逐行解析文本与 mmap 预编译快照的对比
+static void benchConfigLoad(Runner &runner) {
+  if (!runner.enabled("config_load_text") &&
+      !runner.enabled("config_load_snapshot"))
+    return;
+  for (size_t rules : {1000, 100000}) {
+    std::ostringstream conf;
+    for (size_t i = 0; i < rules; ++i)
+      conf << ipv4String(ipv4(10, i >> 16, (i >> 8) & 0xff, i & 0xff))
+           << "/32 ANY 0 " << 1000 + i % 1000 << " TCP DENY\n";
+    std::string path = writeTempFile(conf.str());
+    std::string snapPath = path + ".snap";
+    {
+      Firewall firewall;
+      firewall.loadRules(path);
+      ConfigSnapshotWriter writer;
+      firewall.saveSnapshot(writer);
+      writer.write(snapPath);
+    }
+
+    Params params{{"rules", double(rules)}};
+    if (runner.enabled("config_load_text"))
+      runner.measure("config_load_text", params, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+          Firewall firewall;
+          doNotOptimize(firewall.loadRules(path));
+        }
+      });
+    if (runner.enabled("config_load_snapshot"))
+      runner.measure("config_load_snapshot", params, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+          ConfigSnapshot snapshot;
+          Firewall firewall;
+          doNotOptimize(snapshot.open(snapPath) &&
+                        firewall.loadSnapshot(snapshot));
+        }
+      });
+    std::remove(path.c_str());
+    std::remove(snapPath.c_str());
+  }
+}
+
+static void benchChecksum(Runner &runner) {
+  if (runner.enabled("checksum_ip")) {
+    auto packet = makeUdp(ipv4(192, 168, 1, 2), ipv4(8, 8, 8, 8), 1, 2, 0);
+    runner.measure("checksum_ip", {{"bytes", 20}}, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; ++i) {
+        doNotOptimize(packet.data());
+        doNotOptimize(ipChecksum(packet.data(), sizeof(iphdr)));
+      }
+    });
+  }
+  if (runner.enabled("checksum_l4")) {
+    for (size_t len : {64, 512, 1460}) {
+      std::vector<uint8_t> seg(len, 0x5a);
+      runner.measure("checksum_l4", {{"bytes", double(len)}}, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+          doNotOptimize(seg.data());
+          doNotOptimize(l4Checksum(0x0101a8c0, 0x08080808, IPPROTO_UDP,
+                                   seg.data(), seg.size()));
+        }
+      });
+    }
+  }
+}
+
+void registerMicroBenchmarks(Runner &runner) {
+  benchFirewall(runner);
+  benchRoute(runner);
+  benchNat(runner);
+  benchQos(runner);
+  benchConfigLoad(runner);
+  benchChecksum(runner);
+}
+
+} // namespace bench
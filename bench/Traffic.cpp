@@ -0,0 +1,100 @@
+#include "Traffic.h"
+#include "core/Checksum.h"
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <random>
+
+namespace bench {
+
+static std::vector<uint8_t> makeIp(uint8_t proto, uint32_t srcIp,
+                                   uint32_t dstIp, size_t l4Len) {
+  std::vector<uint8_t> pkt(sizeof(iphdr) + l4Len);
+  iphdr *ip = reinterpret_cast<iphdr *>(pkt.data());
+  ip->version = 4;
+  ip->ihl = 5;
+  ip->tot_len = htons(pkt.size());
+  ip->ttl = 64;
+  ip->protocol = proto;
+  ip->saddr = htonl(srcIp);
+  ip->daddr = htonl(dstIp);
+  ip->check = ipChecksum(ip, sizeof(iphdr));
+  return pkt;
+}
+
+std::vector<uint8_t> makeUdp(uint32_t srcIp, uint32_t dstIp, uint16_t srcPort,
+                             uint16_t dstPort, size_t payloadLen) {
+  auto pkt = makeIp(IPPROTO_UDP, srcIp, dstIp, sizeof(udphdr) + payloadLen);
+  udphdr *udp = reinterpret_cast<udphdr *>(pkt.data() + sizeof(iphdr));
+  udp->source = htons(srcPort);
+  udp->dest = htons(dstPort);
+  udp->len = htons(sizeof(udphdr) + payloadLen);
+  return pkt;
+}
+
+std::vector<uint8_t> makeTcp(uint32_t srcIp, uint32_t dstIp, uint16_t srcPort,
+                             uint16_t dstPort, size_t payloadLen) {
+  auto pkt = makeIp(IPPROTO_TCP, srcIp, dstIp, sizeof(tcphdr) + payloadLen);
+  tcphdr *tcp = reinterpret_cast<tcphdr *>(pkt.data() + sizeof(iphdr));
+  tcp->source = htons(srcPort);
+  tcp->dest = htons(dstPort);
+  tcp->doff = 5;
+  tcp->ack = 1;
+  tcp->window = htons(65535);
+  return pkt;
+}
+
+uint32_t ipv4(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+  return (uint32_t(a) << 24) | (uint32_t(b) << 16) | (uint32_t(c) << 8) | d;
+}
+
+std::string ipv4String(uint32_t ip) {
+  return std::to_string(ip >> 24) + "." + std::to_string((ip >> 16) & 0xff) +
+         "." + std::to_string((ip >> 8) & 0xff) + "." +
+         std::to_string(ip & 0xff);
+}
+
+std::vector<std::vector<uint8_t>> generate(const TrafficMix &mix,
+                                           size_t count) {
+  std::mt19937 rng(42);
+  std::vector<unsigned> weights;
+  for (const auto &s : mix.sizes)
+    weights.push_back(s.second);
+  std::discrete_distribution<size_t> pickSize(weights.begin(), weights.end());
+  std::uniform_int_distribution<unsigned> percent(0, 99);
+
+  // 每条流的五元组固定，包长与协议按组合随机
+  struct Flow {
+    uint32_t src, dst;
+    uint16_t sport, dport;
+    bool tcp;
+  };
+  std::vector<Flow> flows(mix.flows ? mix.flows : 1);
+  for (size_t i = 0; i < flows.size(); ++i) {
+    Flow &f = flows[i];
+    f.src = ipv4(192, 168, 1 + (i >> 16) % 200, 2 + i % 250);
+    f.sport = 1024 + (i * 7) % 60000;
+    f.tcp = percent(rng) < mix.tcpPercent;
+    if (percent(rng) < mix.lanPercent) {
+      f.dst = ipv4(192, 168, 200, 1 + rng() % 250);
+    } else {
+      f.dst = ipv4(1 + rng() % 200, rng() % 256, rng() % 256, 1 + rng() % 250);
+    }
+    f.dport = f.tcp ? 443 : 53;
+  }
+
+  std::vector<std::vector<uint8_t>> packets;
+  packets.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    const Flow &f = flows[i % flows.size()];
+    size_t ipLen = mix.sizes[pickSize(rng)].first;
+    size_t hdr = sizeof(iphdr) + (f.tcp ? sizeof(tcphdr) : sizeof(udphdr));
+    size_t payload = ipLen > hdr ? ipLen - hdr : 0;
+    packets.push_back(f.tcp ? makeTcp(f.src, f.dst, f.sport, f.dport, payload)
+                            : makeUdp(f.src, f.dst, f.sport, f.dport, payload));
+  }
+  return packets;
+}
+
+} // namespace bench
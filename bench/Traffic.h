@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 合成流量：构造带正确 IP 校验和的 TCP/UDP 报文，地址与端口为主机字节序
+namespace bench {
+
+std::vector<uint8_t> makeUdp(uint32_t srcIp, uint32_t dstIp, uint16_t srcPort,
+                             uint16_t dstPort, size_t payloadLen);
+std::vector<uint8_t> makeTcp(uint32_t srcIp, uint32_t dstIp, uint16_t srcPort,
+                             uint16_t dstPort, size_t payloadLen);
+
+uint32_t ipv4(uint8_t a, uint8_t b, uint8_t c, uint8_t d);
+std::string ipv4String(uint32_t ip);
+
+// 流量组合：flows 条流轮转发包，报文长度按权重取自 sizes
+struct TrafficMix {
+  std::string name;
+  size_t flows;
+  std::vector<std::pair<size_t, unsigned>> sizes; // {IP 报文长度, 权重}
+  unsigned tcpPercent;                            // 其余为 UDP
+  unsigned lanPercent; // 目的地址仍在 LAN 内（走路由而非 NAT）的比例
+};
+
+// 按组合生成 count 个 LAN 侧报文，结果可复现
+std::vector<std::vector<uint8_t>> generate(const TrafficMix &mix,
+                                           size_t count);
+
+} // namespace bench
@@ -1,4 +1,7 @@
 #pragma once
+#include "core/ConfigSnapshot.h"
+#include "core/HugePageArena.h"
+#include "core/RuleClassifier.h"
 #include <cstdint>
 #include <string>
 #include <unordered_map>
@@ -13,7 +16,16 @@ struct QoSRule {
 
 class QoSManager {
 public:
+  // arena 非空时限速状态表从其分配，须比本对象长寿
+  explicit QoSManager(HugePageArena *arena = nullptr);
+
+  // 格式错误的行被跳过；文件无法打开或有被跳过的行时返回 false
   bool loadRules(const std::string &path);
+  // 直接引用快照中的规则列，snapshot 须比本对象长寿
+  bool loadSnapshot(const ConfigSnapshot &snapshot);
+  void saveSnapshot(ConfigSnapshotWriter &writer) const;
+  // 多 worker 各持一份 QoSManager 时，每份只分得 1/shares 的速率
+  void setRateShare(size_t shares);
   bool allow(const std::vector<uint8_t> &packet);
 
 private:
@@ -22,9 +34,13 @@ private:
     uint64_t lastCheckTimeMs;
   };
 
-  std::vector<QoSRule> rules_;
-  std::unordered_map<std::string, FlowState> flowTable_;
+  std::vector<uint64_t> rates_; // 字节/秒，下标与规则一一对应
+  RuleClassifier classifier_;
+  // 键为规则下标
+  std::unordered_map<size_t, FlowState, std::hash<size_t>,
+                     std::equal_to<size_t>,
+                     ArenaAllocator<std::pair<const size_t, FlowState>>>
+      flowTable_;
 
-  bool match(const QoSRule &rule, const std::vector<uint8_t> &packet);
   uint64_t nowMs();
 };
@@ -0,0 +1,15 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// 16 位反码和校验（RFC 1071），返回值为网络字节序，可直接写入报文头
+uint16_t ipChecksum(const void *data, size_t length);
+
+// TCP/UDP 校验和，包含 IPv4 伪首部；saddr/daddr 为网络字节序
+uint16_t l4Checksum(uint32_t saddr, uint32_t daddr, uint8_t protocol,
+                    const void *segment, size_t length);
+
+// 增量更新校验和（RFC 1624）：报文中某个字段由 from 改为 to 时修正 check，
+// 参数与返回值均为网络字节序，无需重新遍历整个报文
+uint16_t checksumUpdate16(uint16_t check, uint16_t from, uint16_t to);
+uint16_t checksumUpdate32(uint16_t check, uint32_t from, uint32_t to);
@@ -0,0 +1,70 @@
+#pragma once
+#include "core/RuleClassifier.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 预编译配置快照的节类型，编号写入文件，只能追加
+enum class SnapshotSection : uint32_t {
+  FirewallRules = 1, // RuleColumns 的各列
+  FirewallActions,   // 每条规则一个字节
+  QosRules,
+  QosRates, // 每条规则一个 uint64_t，字节/秒
+  Routes,   // SnapshotRoute
+  NextHops, // SnapshotNextHop
+};
+
+// 路由节的定长记录，地址为网络字节序
+struct SnapshotRoute {
+  uint32_t dest;
+  uint32_t netmask;
+  int32_t metric;
+  uint32_t firstHop; // 在 NextHops 节中的下标
+  uint32_t hopCount;
+};
+struct SnapshotNextHop {
+  uint32_t gateway;
+  char iface[16]; // IFNAMSIZ，以 0 结尾
+};
+
+// 由 wuthering-configc 从文本配置生成。文件头之后是节目录，各节按 64 字节
+// 对齐依次排列，只存偏移不存指针
+class ConfigSnapshotWriter {
+public:
+  void add(SnapshotSection id, uint32_t count, const void *data, size_t size);
+  void addColumns(SnapshotSection id, const RuleColumns &columns);
+  // 先写临时文件再改名，正在使用旧快照的进程不受影响
+  bool write(const std::string &path) const;
+
+private:
+  struct Pending {
+    SnapshotSection id;
+    uint32_t count;
+    std::vector<uint8_t> data;
+  };
+  std::vector<Pending> sections_;
+};
+
+// 只读映射快照文件，各模块直接引用其中的数据，不做解析；
+// 引用了快照的对象须在本对象之前销毁或不再使用
+class ConfigSnapshot {
+public:
+  ConfigSnapshot() = default;
+  ~ConfigSnapshot();
+  ConfigSnapshot(const ConfigSnapshot &) = delete;
+  ConfigSnapshot &operator=(const ConfigSnapshot &) = delete;
+
+  // 校验文件头、版本与各节边界
+  bool open(const std::string &path);
+
+  // 节不存在时返回 nullptr；count 为记录数，size 为字节数
+  const void *section(SnapshotSection id, uint32_t &count,
+                      size_t &size) const;
+  // 按列布局解释规则节，列长度须为 RuleClassifier::kLanes 的倍数
+  bool columns(SnapshotSection id, RuleColumns &out) const;
+
+private:
+  const uint8_t *base_ = nullptr;
+  size_t length_ = 0;
+};
@@ -0,0 +1,7 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// IPv4 五元组哈希，用于 ECMP 选路与分流；同一流的报文哈希值恒定。
+// 分片报文只用地址与协议计算，保证首片与后续分片走同一路径
+uint32_t flowHash(const std::vector<uint8_t> &packet);
@@ -0,0 +1,64 @@
+#pragma once
+#include "core/IPacketIO.h"
+#include "core/StageQueue.h"
+#include "core/StaticPipeline.h"
+#include "routing/RouteChain.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+class Firewall;
+class QoSManager;
+class RoutingManager;
+class NATManager;
+class PacketCapture;
+class StaticRouteProvider;
+class DynamicRouteProvider;
+class UserTcpStack;
+class UdpRelay;
+
+// 防火墙 → QoS → 路由 → NAT/代理 的转发流水线，与报文来源无关：
+// 实时运行时由主循环喂 TUN 报文，离线时直接读空 pcap / 内存后端。
+// Router 与 IO 决定 LAN 侧 OutboundPipeline 的组合方式：取接口类型时
+// 路由提供者与收发后端可在运行时选择（ForwardingPipeline，离线回放用），
+// 取具体类型时整条路径没有虚调用（WorkerPipeline，worker 用）。
+// 只对下面两个别名显式实例化
+template <class Router, class IO> class BasicForwardingPipeline {
+public:
+  using Stats = PipelineStats;
+
+  BasicForwardingPipeline(IO &io, Firewall &firewall, QoSManager &qos,
+                          Router &router, NATManager &nat);
+
+  // 代理模式：LAN → WAN 的 TCP/UDP 交给用户态协议栈与 UDP 中继，可为空
+  void setProxy(UserTcpStack *tcpStack, UdpRelay *udpRelay);
+
+  // 处理一个 LAN 侧报文；capturedNs 为读出时刻，只用于逐包追踪
+  void processOutbound(std::vector<uint8_t> &&packet, uint64_t capturedNs = 0);
+  // 处理一个 WAN 侧回包：DNAT 后写回 LAN；实时模式下在回包线程调用
+  void processInbound(const std::vector<uint8_t> &packet);
+
+  // 采集阶段按报文将走的处理路径分类，决定其在 StageQueue 中的优先级
+  StageQueue::Priority classify(const std::vector<uint8_t> &packet,
+                                bool inbound) const;
+
+  // 离线回放：读空后端两个方向的输入，返回处理的报文数
+  uint64_t drain();
+
+  Stats stats() const;
+
+private:
+  IO &io_;
+  NATManager &nat_;
+  UserTcpStack *tcpStack_ = nullptr;
+  UdpRelay *udpRelay_ = nullptr;
+
+  OutboundPipeline<Firewall, QoSManager, Router, NATManager, IO> outbound_;
+  std::atomic<uint64_t> inbound_{0}; // 回包线程写入
+};
+
+using ForwardingPipeline = BasicForwardingPipeline<RoutingManager, IPacketIO>;
+
+// worker 的路由固定为静态路由在前、动态路由在后
+using WorkerRouter = RouteChain<StaticRouteProvider, DynamicRouteProvider>;
+using WorkerPipeline = BasicForwardingPipeline<WorkerRouter, PacketCapture>;
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+// 大页内存池：按块向内核申请内存，块大小从 2MB 起倍增到 1GB，优先使用
+// 1GB/2MB hugetlb 大页，失败时退回普通页并建议内核使用透明大页；
+// numaNode >= 0 时用 mbind 把内存优先放在该节点。
+// 小块按大小分级复用，大块单独映射、释放即归还。
+// 非线程安全：每个 worker 一个实例，与其 NAT/QoS 分片一起使用
+class HugePageArena {
+public:
+  explicit HugePageArena(int numaNode = -1);
+  ~HugePageArena();
+  HugePageArena(const HugePageArena &) = delete;
+  HugePageArena &operator=(const HugePageArena &) = delete;
+
+  // 16 字节对齐；映射失败时返回 nullptr
+  void *allocate(size_t size);
+  void deallocate(void *p, size_t size);
+
+  int numaNode() const { return numaNode_; }
+  size_t mappedBytes() const { return mappedBytes_; }
+  size_t hugeBytes() const { return hugeBytes_; } // 其中 hugetlb 大页部分
+
+  // CPU 所在的 NUMA 节点，无法确定时返回 -1
+  static int nodeOfCpu(int cpu);
+
+private:
+  static constexpr size_t kSmallStep = 16;
+  static constexpr size_t kSmallMax = 512;     // 以 16 字节为级差
+  static constexpr size_t kMediumMax = 65536;  // 以 2 的幂为级差
+  static constexpr size_t kNumClasses = kSmallMax / kSmallStep + 7;
+
+  static size_t classOf(size_t size);
+  static size_t classSize(size_t cls);
+  void *mapRegion(size_t size, size_t &mapped, bool &huge);
+  void *carve(size_t size);
+
+  int numaNode_;
+  size_t nextChunk_;
+  uint8_t *cursor_ = nullptr; // 当前块中未分配部分
+  uint8_t *limit_ = nullptr;
+  std::vector<void *> freeLists_[kNumClasses];
+  std::vector<std::pair<void *, size_t>> chunks_;
+  struct Mapping {
+    size_t length;
+    bool huge;
+  };
+  std::unordered_map<void *, Mapping> large_; // 单独映射的大块
+  size_t mappedBytes_ = 0;
+  size_t hugeBytes_ = 0;
+};
+
+// 供标准容器使用的分配器；arena 为空时退回全局 operator new
+template <typename T> class ArenaAllocator {
+public:
+  using value_type = T;
+
+  ArenaAllocator(HugePageArena *arena = nullptr) noexcept : arena_(arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) noexcept
+      : arena_(other.arena()) {}
+
+  T *allocate(size_t n) {
+    if (!arena_)
+      return static_cast<T *>(::operator new(n * sizeof(T)));
+    void *p = arena_->allocate(n * sizeof(T));
+    if (!p)
+      throw std::bad_alloc();
+    return static_cast<T *>(p);
+  }
+  void deallocate(T *p, size_t n) noexcept {
+    if (!arena_)
+      ::operator delete(p);
+    else
+      arena_->deallocate(p, n * sizeof(T));
+  }
+
+  HugePageArena *arena() const { return arena_; }
+  template <typename U> bool operator==(const ArenaAllocator<U> &o) const {
+    return arena_ == o.arena();
+  }
+  template <typename U> bool operator!=(const ArenaAllocator<U> &o) const {
+    return arena_ != o.arena();
+  }
+
+private:
+  HugePageArena *arena_;
+};
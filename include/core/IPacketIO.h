@@ -0,0 +1,33 @@
+#pragma once
+#include "routing/IRouteProvider.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// 报文收发后端：LAN 侧（TUN）与 WAN 侧（回包监听 / 原始发包）。
+// PacketCapture 为真实网卡实现，PcapPacketIO 与 MemoryPacketIO 用于离线回放
+class IPacketIO {
+public:
+  virtual ~IPacketIO() = default;
+
+  // 读取一个 LAN 侧报文；离线后端在输入耗尽时返回空
+  virtual std::optional<std::vector<uint8_t>> readPacket() = 0;
+  // 读取一个 WAN 侧回包
+  virtual std::optional<std::vector<uint8_t>> readRawPacket() = 0;
+
+  // SNAT 后发往外网
+  virtual bool writePacket(const std::vector<uint8_t> &packet) = 0;
+  // 写回 LAN 侧（发回客户端）
+  virtual bool writeToTun(const uint8_t *data, size_t len) = 0;
+  bool writeToTun(const std::vector<uint8_t> &packet) {
+    return writeToTun(packet.data(), packet.size());
+  }
+  // 按路由查找结果从指定网卡发出
+  virtual bool sendViaInterface(const std::vector<uint8_t> &packet,
+                                const RouteHop &hop) = 0;
+
+  // 可供 poll 的 LAN 侧 fd；离线后端没有，返回 -1
+  virtual int getTunFd() const { return -1; }
+};
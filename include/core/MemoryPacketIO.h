@@ -0,0 +1,57 @@
+#pragma once
+#include "core/IPacketIO.h"
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+
+// 内存后端：预先装入的报文按顺序循环回放 rounds 轮，发出的报文只计数，
+// 可选保留最近若干个供检查。无系统调用，用于压测与回归
+class MemoryPacketIO final : public IPacketIO {
+public:
+  struct Counters {
+    uint64_t toWan = 0;   // writePacket
+    uint64_t toTun = 0;   // writeToTun
+    uint64_t toIface = 0; // sendViaInterface
+    uint64_t bytes = 0;
+  };
+
+  explicit MemoryPacketIO(size_t rounds = 1);
+
+  void addLanPacket(std::vector<uint8_t> packet);
+  void addWanPacket(std::vector<uint8_t> packet);
+  // 从头开始新一次回放，计数不清零
+  void rewind();
+  // 保留最近 n 个发出的报文，0 表示只计数
+  void keepOutput(size_t n);
+
+  std::optional<std::vector<uint8_t>> readPacket() override;
+  std::optional<std::vector<uint8_t>> readRawPacket() override;
+  bool writePacket(const std::vector<uint8_t> &packet) override;
+  using IPacketIO::writeToTun;
+  bool writeToTun(const uint8_t *data, size_t len) override;
+  bool sendViaInterface(const std::vector<uint8_t> &packet,
+                        const RouteHop &hop) override;
+
+  size_t lanPacketCount() const { return lanSrc_.packets.size(); }
+  const Counters &counters() const { return counters_; }
+  const std::deque<std::vector<uint8_t>> &output() const { return output_; }
+
+private:
+  struct Source {
+    std::vector<std::vector<uint8_t>> packets;
+    size_t next = 0;
+    size_t round = 0;
+  };
+
+  std::optional<std::vector<uint8_t>> next(Source &src);
+  void record(const uint8_t *data, size_t len);
+
+  size_t rounds_;
+  Source lanSrc_;
+  Source wanSrc_;
+  size_t keep_ = 0;
+  Counters counters_;
+  std::deque<std::vector<uint8_t>> output_;
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// 用户态 ARP 邻居表：查找未命中时由后台线程异步发 ARP 请求，
+// 命中的表项直接给出预先拼好的以太网头（目的 MAC、源 MAC、IPv4 类型）。
+// 表项过期后转为 STALE，仍可使用，同时后台单播探测刷新；探测无应答则删除
+class NeighborCache {
+public:
+  static constexpr size_t kEthHeaderLen = 14;
+  using EthHeader = std::array<uint8_t, kEthHeaderLen>;
+
+  NeighborCache() = default;
+  ~NeighborCache();
+
+  bool start();
+  void stop();
+
+  // 登记一个以太网接口，addr 为接口 IPv4 地址（网络字节序），作为 ARP 请求源
+  void addInterface(int ifindex, const uint8_t mac[6], uint32_t addr);
+
+  // nextHop 为网络字节序；命中时写入以太网头并返回 true，
+  // 未命中时触发异步解析并返回 false，调用方自行走慢路径
+  bool lookup(int ifindex, uint32_t nextHop, EthHeader &header);
+
+  // 调用线程独占的已解析表项副本。共享表中已解析的表项出现、MAC 变化或
+  // 被删除时递增代号，代号未变时副本里的表头仍然有效
+  struct Local {
+    uint64_t generation = 0;
+    std::unordered_map<uint64_t, EthHeader> headers;
+  };
+  // 同上，但先查 local：命中时只读一次代号、不加锁，未命中才查共享表
+  bool lookup(Local &local, int ifindex, uint32_t nextHop, EthHeader &header);
+
+  size_t size() const;
+
+private:
+  enum class State { Incomplete, Reachable, Stale, Failed };
+  struct Entry {
+    State state = State::Incomplete;
+    EthHeader header{};
+    uint64_t updatedMs = 0;   // 最近一次收到该邻居的 ARP
+    uint64_t nextProbeMs = 0; // 下一次发请求的时间
+    int probes = 0;
+  };
+  struct Interface {
+    std::array<uint8_t, 6> mac;
+    uint32_t addr;
+  };
+
+  void workerLoop();
+  void receiveAll();
+  void service(uint64_t now);
+  void sendRequest(int ifindex, uint32_t target, const uint8_t *dstMac);
+  static uint64_t makeKey(int ifindex, uint32_t addr);
+  static uint64_t nowMs();
+
+  std::unordered_map<int, Interface> interfaces_;
+  std::unordered_map<uint64_t, Entry> entries_;
+  mutable std::mutex mutex_;
+  std::atomic<uint64_t> generation_{1}; // 持 mutex_ 修改后递增
+
+  int sock_ = -1;
+  int wakeFd_ = -1; // 有新的未解析表项时唤醒后台线程立即发请求
+  std::thread worker_;
+  std::atomic<bool> running_{false};
+};
@@ -1,24 +1,60 @@
 #pragma once
+#include "core/IPacketIO.h"
+#include "core/NeighborCache.h"
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
-class PacketCapture {
+// TUN + AF_PACKET + raw socket 的实时后端，需要 root 与真实网卡。
+// 按路由发包时，下一跳已解析的以太网接口直接经 AF_PACKET 带上预建的以太网头发出，
+// 否则退回 raw socket 由内核完成路由与邻居解析。
+// 多 worker 时每个 worker 一个实例：TUN 以多队列方式打开，各实例占一个队列；
+// WAN 侧回包 socket 加入同一 PACKET_FANOUT 组，按目的端口投递到对应 NAT 分片
+class PacketCapture final : public IPacketIO {
 public:
-  bool init(const std::string &devName = "tun0");
-  std::optional<std::vector<uint8_t>> readPacket(); // 从 TUN 读取
-  std::optional<std::vector<uint8_t>> readRawPacket(); // 从 raw socket 读取回包
-  bool
-  writePacket(const std::vector<uint8_t> &packet); // 发往外网（raw socket）
-  bool writeToTun(const std::vector<uint8_t> &packet); // 写回 TUN（发回客户端）
+  ~PacketCapture();
+  // numQueues > 1 时 queue 为本实例的分片号，各实例须按 queue 从小到大依次
+  // init：fanout 组按加入顺序编号，加入顺序即分片号
+  bool init(const std::string &devName = "tun0",
+            const std::string &wanIface = "wlan0", size_t queue = 0,
+            size_t numQueues = 1);
+  // 多个实例共用一个邻居表，须在 init 之前设置；未设置时 init 自行创建
+  void setNeighborCache(std::shared_ptr<NeighborCache> cache);
+  std::shared_ptr<NeighborCache> neighborCache() const { return neighbors_; }
+  std::optional<std::vector<uint8_t>> readPacket() override; // 从 TUN 读取
+  std::optional<std::vector<uint8_t>>
+  readRawPacket() override; // 从 raw socket 读取回包
+  bool writePacket(
+      const std::vector<uint8_t> &packet) override; // 发往外网（raw socket）
+  using IPacketIO::writeToTun;
+  bool writeToTun(const uint8_t *data,
+                  size_t len) override; // 写回 TUN（发回客户端）
   bool sendViaInterface(const std::vector<uint8_t> &packet,
-                        const std::string &gateway, const std::string &iface);
+                        const RouteHop &hop) override;
   std::string getInterfaceName() const;
-  int getTunFd() const;
+  int getTunFd() const override;
+  int getWanFd() const { return rawFd_; }
 
 private:
+  // 每个出接口缓存一次的发送状态
+  struct TxPort {
+    int ifindex = 0;
+    bool ethernet = false;
+    uint32_t addr = 0; // 接口 IPv4 地址，网络字节序
+    int packetFd = -1; // AF_PACKET 发送，只用于以太网接口
+    int rawFd = -1;    // 绑定到接口的 IPPROTO_RAW，邻居未解析时使用
+  };
+  TxPort *txPort(const std::string &iface);
+
   int tunFd_ = -1;
   int rawFd_ = -1;
+  int rawTxFd_ = -1; // writePacket 使用的 IPPROTO_RAW
   std::string ifName_;
+  std::shared_ptr<NeighborCache> neighbors_;
+  // 与 txPorts_ 一样只在发送线程访问，命中时查邻居不加锁
+  NeighborCache::Local neighborLocal_;
+  std::unordered_map<std::string, TxPort> txPorts_;
 };
@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 抽样的逐包路径追踪：每 N 个 LAN 侧报文取一个，记录读出时刻与流水线各阶段
+// 的完成时刻，写入每线程一个的定长环形缓冲。收到导出请求（SIGUSR1）后各线程
+// 在主循环中取下自己环的快照，由后台线程导出：明细写入文件，各阶段耗时
+// 分位数打到 stderr。采样关闭时热路径上只有一次原子读
+class PacketTracer {
+public:
+  static constexpr size_t kMaxStages = 8;
+  static constexpr size_t kRingSize = 4096;
+
+  struct Record {
+    uint64_t capturedNs; // 从内核读出的时刻，0 表示未知
+    uint64_t startNs;    // 进入流水线的时刻
+    uint32_t stageNs[kMaxStages]; // 各阶段完成时刻，相对 startNs
+    const char *const *names;     // 阶段名，与 stageNs 一一对应
+    uint32_t srcIp;               // 网络字节序
+    uint32_t dstIp;
+    uint8_t protocol;
+    uint8_t stages; // 实际走过的阶段数，中途丢弃或被消费时少于总数
+  };
+
+  // every 为 0 时关闭，否则每 every 个报文采样一个；须在 worker 启动前设置
+  static void setSampleRate(uint32_t every);
+  // 明细文件所在目录，默认当前目录
+  static void setOutputDir(const std::string &dir);
+  static bool enabled() {
+    return sampleEvery_.load(std::memory_order_relaxed) != 0;
+  }
+
+  // 决定本报文是否采样，采样时返回本线程环中新开的记录
+  static Record *sample(uint64_t capturedNs) {
+    uint32_t every = sampleEvery_.load(std::memory_order_relaxed);
+    return every ? begin(every, capturedNs) : nullptr;
+  }
+  static void mark(Record &record, size_t stage) {
+    record.stageNs[stage] = uint32_t(nowNs() - record.startNs);
+    record.stages = uint8_t(stage + 1);
+  }
+
+  // 只递增导出代数，可在信号处理函数中调用
+  static void requestDump();
+  // 主循环中调用：有新的导出请求时导出本线程的环，name 区分线程；
+  // wait 为 true 时在本线程同步导出（离线回放结束、进程即将退出时）
+  static void poll(const std::string &name, bool wait = false);
+
+  static uint64_t nowNs();
+
+private:
+  static Record *begin(uint32_t every, uint64_t capturedNs);
+  static void dump(const std::string &name,
+                   const std::vector<Record> &records);
+
+  static inline std::atomic<uint32_t> sampleEvery_{0};
+  static inline std::atomic<uint32_t> dumpGeneration_{0};
+};
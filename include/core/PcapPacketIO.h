@@ -0,0 +1,38 @@
+#pragma once
+#include "core/IPacketIO.h"
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+// pcap 文件后端（不依赖 libpcap）：从抓包文件读取 LAN 侧报文，
+// 发出的报文以 LINKTYPE_RAW 写入输出文件。支持以太网、Linux cooked
+// 与裸 IP 三种链路类型，非 IPv4 记录被跳过
+class PcapPacketIO final : public IPacketIO {
+public:
+  // outPath 为空时不写出，只计数
+  bool open(const std::string &inPath, const std::string &outPath = "");
+
+  std::optional<std::vector<uint8_t>> readPacket() override;
+  std::optional<std::vector<uint8_t>> readRawPacket() override;
+  bool writePacket(const std::vector<uint8_t> &packet) override;
+  using IPacketIO::writeToTun;
+  bool writeToTun(const uint8_t *data, size_t len) override;
+  bool sendViaInterface(const std::vector<uint8_t> &packet,
+                        const RouteHop &hop) override;
+
+  uint64_t readCount() const { return readCount_; }
+  uint64_t writeCount() const { return writeCount_; }
+
+private:
+  bool record(const uint8_t *data, size_t len);
+  uint32_t field(uint32_t v) const;
+
+  std::ifstream in_;
+  std::ofstream out_;
+  uint32_t linkType_ = 0;
+  bool swapped_ = false; // 文件字节序与本机相反
+  uint64_t readCount_ = 0;
+  uint64_t writeCount_ = 0;
+};
@@ -0,0 +1,182 @@
+#pragma once
+#include "core/FlowHash.h"
+#include "core/PacketTracer.h"
+#include "core/Probes.h"
+#include "routing/IRouteProvider.h"
+#include <arpa/inet.h>
+#include <cstdint>
+#include <iostream>
+#include <netinet/ip.h>
+#include <ostream>
+#include <vector>
+
+class UserTcpStack;
+class UdpRelay;
+
+struct PipelineStats {
+  uint64_t received = 0;
+  uint64_t blocked = 0;
+  uint64_t rateLimited = 0;
+  uint64_t noRoute = 0;
+  uint64_t snat = 0;
+  uint64_t routed = 0;
+  uint64_t proxied = 0;
+  uint64_t inbound = 0;
+};
+
+// 在阶段间传递的报文：IP 头只解析一次，地址均为网络字节序
+struct PacketContext {
+  std::vector<uint8_t> packet;
+  uint32_t srcIp = 0;
+  uint32_t dstIp = 0;
+  uint8_t protocol = 0;
+  bool toWan = false; // LAN 发往外网，交给代理或 SNAT
+  RouteHop hop;
+  PacketTracer::Record *trace = nullptr; // 未被抽样时为空
+};
+
+// 私网网段的前缀判断，地址为网络字节序
+inline bool isLanAddress(uint32_t addr) {
+  uint32_t a = ntohl(addr);
+  return (a >> 24) == 10 || (a >> 24) == 172 || (a >> 16) == 0xc0a8;
+}
+
+// 以点分十进制输出网络字节序地址，不分配内存
+struct Ipv4Addr {
+  uint32_t addr;
+};
+std::ostream &operator<<(std::ostream &os, Ipv4Addr ip);
+
+// 每个阶段是一个可调用对象，返回 false 表示报文已被消费或丢弃，后续阶段
+// 不再执行；kName 用于逐包追踪的输出。依赖以模板参数给出：取具体类型时
+// 调用可被内联，取接口类型（RoutingManager、IPacketIO）时保留运行时分派
+namespace stage {
+
+class Parse {
+public:
+  static constexpr const char *kName = "parse";
+  bool operator()(PacketContext &ctx, PipelineStats &stats) const {
+    if (ctx.packet.size() < sizeof(iphdr))
+      return false;
+    ++stats.received;
+    const iphdr *iph = reinterpret_cast<const iphdr *>(ctx.packet.data());
+    ctx.srcIp = iph->saddr;
+    ctx.dstIp = iph->daddr;
+    ctx.protocol = iph->protocol;
+    ctx.toWan = isLanAddress(ctx.srcIp) && !isLanAddress(ctx.dstIp);
+    std::cout << "[Cap] From " << Ipv4Addr{ctx.srcIp} << " to "
+              << Ipv4Addr{ctx.dstIp} << "\n";
+    return true;
+  }
+};
+
+template <class Firewall> class Filter {
+public:
+  static constexpr const char *kName = "firewall";
+  explicit Filter(Firewall &firewall) : firewall_(firewall) {}
+  bool operator()(PacketContext &ctx, PipelineStats &stats) {
+    bool allowed = firewall_.allow(ctx.packet);
+    WUTHERING_PROBE3(firewall, ctx.srcIp, ctx.dstIp, allowed);
+    if (allowed)
+      return true;
+    std::cout << "[Firewall] Blocked packet from " << Ipv4Addr{ctx.srcIp}
+              << " to " << Ipv4Addr{ctx.dstIp} << "\n";
+    ++stats.blocked;
+    return false;
+  }
+
+private:
+  Firewall &firewall_;
+};
+
+template <class QoS> class RateLimit {
+public:
+  static constexpr const char *kName = "qos";
+  explicit RateLimit(QoS &qos) : qos_(qos) {}
+  bool operator()(PacketContext &ctx, PipelineStats &stats) {
+    bool allowed = qos_.allow(ctx.packet);
+    WUTHERING_PROBE3(qos, ctx.srcIp, ctx.packet.size(), allowed);
+    if (allowed)
+      return true;
+    std::cout << "[QoS] Rate limited packet from " << Ipv4Addr{ctx.srcIp}
+              << "\n";
+    ++stats.rateLimited;
+    return false;
+  }
+
+private:
+  QoS &qos_;
+};
+
+template <class Router> class Route {
+public:
+  static constexpr const char *kName = "route";
+  explicit Route(Router &router) : router_(router) {}
+  bool operator()(PacketContext &ctx, PipelineStats &stats) {
+    bool found = router_.resolve(ctx.dstIp, flowHash(ctx.packet), ctx.hop);
+    WUTHERING_PROBE3(route, ctx.dstIp, ctx.hop.gateway, found);
+    if (found)
+      return true;
+    std::cout << "[Router] No route for " << Ipv4Addr{ctx.dstIp} << "\n";
+    ++stats.noRoute;
+    return false;
+  }
+
+private:
+  Router &router_;
+};
+
+// 代理模式：LAN → WAN 的 TCP/UDP 交给用户态协议栈与 UDP 中继，可为空
+class Proxy {
+public:
+  static constexpr const char *kName = "proxy";
+  Proxy(UserTcpStack *tcpStack = nullptr, UdpRelay *udpRelay = nullptr)
+      : tcpStack_(tcpStack), udpRelay_(udpRelay) {}
+  bool operator()(PacketContext &ctx, PipelineStats &stats);
+
+private:
+  UserTcpStack *tcpStack_;
+  UdpRelay *udpRelay_;
+};
+
+// LAN → WAN 报文在此 SNAT 后发往外网，其余报文交给下一阶段
+template <class Nat, class IO> class Snat {
+public:
+  static constexpr const char *kName = "snat";
+  Snat(Nat &nat, IO &io) : nat_(nat), io_(io) {}
+  bool operator()(PacketContext &ctx, PipelineStats &stats) {
+    if (!ctx.toWan)
+      return true;
+    auto snatted = nat_.applySNAT(ctx.packet);
+    if (!snatted.empty()) {
+      io_.writePacket(snatted);
+      WUTHERING_PROBE3(transmit, ctx.dstIp, snatted.size(), 0);
+      ++stats.snat;
+    }
+    return false;
+  }
+
+private:
+  Nat &nat_;
+  IO &io_;
+};
+
+template <class IO> class Transmit {
+public:
+  static constexpr const char *kName = "transmit";
+  explicit Transmit(IO &io) : io_(io) {}
+  bool operator()(PacketContext &ctx, PipelineStats &stats) {
+    std::cout << "[Router] Route to " << Ipv4Addr{ctx.dstIp} << " via "
+              << Ipv4Addr{ctx.hop.gateway} << " on " << *ctx.hop.iface
+              << "\n";
+    io_.sendViaInterface(ctx.packet, ctx.hop);
+    WUTHERING_PROBE3(transmit, ctx.dstIp, ctx.packet.size(), 1);
+    ++stats.routed;
+    return true;
+  }
+
+private:
+  IO &io_;
+};
+
+} // namespace stage
@@ -0,0 +1,86 @@
+#pragma once
+#include <type_traits>
+
+// USDT 静态探针，provider 为 wuthering。未被附加时每个探针只是一条 nop
+// 加上参数的寄存器/内存引用，可长期留在热路径上。用法：
+//   bpftrace -l 'usdt:./wuthering:*'
+//   bpftrace -e 'usdt:./wuthering:wuthering:route { @[arg2] = count(); }'
+//   perf buildid-cache --add ./wuthering && perf list sdt_wuthering
+// 有 <sys/sdt.h> 时直接使用；否则在 x86-64 / AArch64 上自行生成同格式的
+// .note.stapsdt 描述；其余平台或定义了 WUTHERING_NO_PROBES 时为空操作。
+// 参数须为整数或指针，最多三个
+//
+// 探针一览（地址均为网络字节序，端口为主机字节序）：
+//   tun_read(len)                 wan_read(len)
+//   firewall(src, dst, allowed)   qos(src, len, allowed)
+//   route(dst, gateway, found)
+//   nat_hit(outbound, port, proto)    nat_miss(dst, port, proto)
+//   nat_create(src, srcPort, externalPort)   nat_reject(src)
+//   transmit(dst, len, path)      path: 0 SNAT 出外网，1 按路由，
+//                                 2 DNAT 后写回 TUN，3 无映射原样写回 TUN
+
+#if defined(WUTHERING_NO_PROBES)
+#define WUTHERING_PROBE1(name, a)
+#define WUTHERING_PROBE2(name, a, b)
+#define WUTHERING_PROBE3(name, a, b, c)
+
+#elif defined(__has_include) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define WUTHERING_PROBE1(name, a) DTRACE_PROBE1(wuthering, name, a)
+#define WUTHERING_PROBE2(name, a, b) DTRACE_PROBE2(wuthering, name, a, b)
+#define WUTHERING_PROBE3(name, a, b, c)                                        \
+  DTRACE_PROBE3(wuthering, name, a, b, c)
+
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+// 与 systemtap sdt.h 相同的 stapsdt v3 描述：nop 的地址、.stapsdt.base 的
+// 地址（供工具修正预链接偏移）、信号量（不使用）、provider、name、参数格式。
+// 参数格式为 "字节数@操作数"，有符号参数的字节数为负；%n 输出的是
+// 立即数的相反数，因此这里有符号取正、无符号取负
+#define WUTHERING_SDT_SIZE(x)                                                  \
+  ((std::is_signed<std::decay_t<decltype(x)>>::value ? 1 : -1) *              \
+   int(sizeof(x)))
+#define WUTHERING_SDT_ARG(n, x)                                                \
+  [s##n] "n"(WUTHERING_SDT_SIZE(x)), [a##n] "nor"(x)
+#define WUTHERING_SDT_FMT(n) "%n[s" #n "]@%[a" #n "]"
+#define WUTHERING_SDT_NOTE(name, format)                                       \
+  "990: nop\n"                                                                 \
+  ".pushsection .note.stapsdt,\"?\",\"note\"\n"                                \
+  ".balign 4\n"                                                                \
+  ".4byte 992f-991f, 994f-993f, 3\n"                                           \
+  "991: .asciz \"stapsdt\"\n"                                                  \
+  "992: .balign 4\n"                                                           \
+  "993: .8byte 990b\n"                                                         \
+  ".8byte _.stapsdt.base\n"                                                    \
+  ".8byte 0\n"                                                                 \
+  ".asciz \"wuthering\"\n"                                                     \
+  ".asciz \"" #name "\"\n"                                                     \
+  ".asciz \"" format "\"\n"                                                    \
+  "994: .balign 4\n"                                                           \
+  ".popsection\n"                                                              \
+  ".ifndef _.stapsdt.base\n"                                                   \
+  ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"      \
+  ".weak _.stapsdt.base\n"                                                     \
+  ".hidden _.stapsdt.base\n"                                                   \
+  "_.stapsdt.base: .space 1\n"                                                 \
+  ".size _.stapsdt.base, 1\n"                                                  \
+  ".popsection\n"                                                              \
+  ".endif\n"
+#define WUTHERING_PROBE1(name, a)                                              \
+  __asm__ __volatile__(WUTHERING_SDT_NOTE(name, WUTHERING_SDT_FMT(1))          \
+                       : : WUTHERING_SDT_ARG(1, a))
+#define WUTHERING_PROBE2(name, a, b)                                           \
+  __asm__ __volatile__(                                                        \
+      WUTHERING_SDT_NOTE(name, WUTHERING_SDT_FMT(1) " " WUTHERING_SDT_FMT(2))  \
+      : : WUTHERING_SDT_ARG(1, a), WUTHERING_SDT_ARG(2, b))
+#define WUTHERING_PROBE3(name, a, b, c)                                        \
+  __asm__ __volatile__(                                                        \
+      WUTHERING_SDT_NOTE(name, WUTHERING_SDT_FMT(1) " " WUTHERING_SDT_FMT(2)   \
+                                   " " WUTHERING_SDT_FMT(3))                   \
+      : : WUTHERING_SDT_ARG(1, a), WUTHERING_SDT_ARG(2, b),                    \
+          WUTHERING_SDT_ARG(3, c))
+
+#else
+#define WUTHERING_PROBE1(name, a)
+#define WUTHERING_PROBE2(name, a, b)
+#define WUTHERING_PROBE3(name, a, b, c)
+#endif
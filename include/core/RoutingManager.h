@@ -7,6 +7,11 @@ class RoutingManager {
 public:
   void addProvider(std::shared_ptr<IRouteProvider> provider);
   std::optional<RouteEntry> lookupRoute(const std::string &dstIp);
+  // 同一流的 flowHash 不变，ECMP 路由对同一流总是选出同一下一跳
+  std::optional<RouteEntry> lookupRoute(const std::string &dstIp,
+                                        uint32_t flowHash);
+  // 转发快路径：按顺序询问各提供者，dst 为网络字节序
+  bool resolve(uint32_t dst, uint32_t flowHash, RouteHop &hop);
 
 private:
   std::vector<std::shared_ptr<IRouteProvider>> providers_;
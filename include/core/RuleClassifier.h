@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 报文分类键：地址为网络字节序，端口为主机字节序
+struct ClassifierKey {
+  uint32_t srcIp = 0;
+  uint32_t dstIp = 0;
+  uint32_t srcPort = 0;
+  uint32_t dstPort = 0;
+  uint32_t proto = 0;
+  bool hasPorts = false; // 非 TCP/UDP 报文不比较端口
+};
+
+// 预解析后的规则，地址已按掩码截断；掩码为 0 表示任意地址
+struct ClassifierRule {
+  uint32_t srcIp = 0;
+  uint32_t srcMask = 0;
+  uint32_t dstIp = 0;
+  uint32_t dstMask = 0;
+  uint16_t srcPortLo = 0;
+  uint16_t srcPortHi = 65535;
+  uint16_t dstPortLo = 0;
+  uint16_t dstPortHi = 65535;
+  uint8_t proto = 0; // 0 表示任意协议
+};
+
+// 规则按列存放（structure of arrays）。每列长度为 kLanes 的倍数，
+// 尾部填充行永不匹配，SIMD 内核无需处理余数
+struct RuleColumns {
+  static constexpr size_t kNumColumns = 10;
+  const uint32_t *srcIp;
+  const uint32_t *srcMask;
+  const uint32_t *dstIp;
+  const uint32_t *dstMask;
+  const uint32_t *srcPortLo;
+  const uint32_t *srcPortHi;
+  const uint32_t *dstPortLo;
+  const uint32_t *dstPortHi;
+  const uint32_t *proto;
+  const uint32_t *protoMask;
+  size_t count;  // 真实规则数
+  size_t padded; // 列长度
+};
+
+// 多规则分类器：一次比较一个报文与 8（AVX2）或 16（AVX-512）条规则，
+// 由比较结果的位掩码直接得到第一条命中的规则；启动时按 CPU 选择内核，
+// 不支持 SIMD 时退回标量实现
+class RuleClassifier {
+public:
+  static constexpr size_t kLanes = 16;
+  static constexpr size_t kNoMatch = ~size_t(0);
+
+  // 以自有存储构建列
+  void build(const std::vector<ClassifierRule> &rules);
+  // 改用外部提供的列（如 mmap 的规则快照），调用方保证其生命周期
+  void attach(const RuleColumns &columns);
+
+  // 返回第一条命中规则的下标，没有命中时返回 kNoMatch
+  size_t match(const ClassifierKey &key) const;
+  size_t size() const { return columns_.count; }
+  const RuleColumns &columns() const { return columns_; }
+
+  static ClassifierKey keyOf(const std::vector<uint8_t> &packet);
+  // "ANY"、"a.b.c.d" 或 "a.b.c.d/len"（len 为 0..32）
+  static bool parseAddress(const std::string &text, uint32_t &addr,
+                           uint32_t &mask);
+  // "ANY"、"TCP"、"UDP"、"ICMP" 或协议号 1..255；ANY 得 0，无法识别返回 false
+  static bool parseProtocol(const std::string &text, uint8_t &proto);
+  // 当前 CPU 使用的内核名称："avx512"、"avx2" 或 "scalar"
+  static const char *kernelName();
+
+private:
+  std::vector<uint32_t> storage_;
+  RuleColumns columns_{};
+};
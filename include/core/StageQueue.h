@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 采集与处理之间的有界优先级队列：每个类别一个定长环形缓冲，满时丢弃新到的
+// 报文，出队总是先取优先级最高的非空类别。采集一轮读入的报文多于处理一轮
+// 的预算，过载时丢包集中在低优先级类别，而不是在内核缓冲区里随机发生。
+// 单线程使用：采集与处理都在同一个 worker 中
+class StageQueue {
+public:
+  enum Priority {
+    Control,     // 路由协议等控制面报文（数据面上看到的副本，见 classify）
+    Established, // 已有映射或无需 NAT 的流量
+    NewFlow,     // 将新建 NAT 映射，或没有映射的回包
+    kNumPriorities
+  };
+  struct Item {
+    std::vector<uint8_t> packet;
+    bool inbound = false; // WAN 侧回包
+    uint64_t capturedNs = 0; // 读出时刻，只在逐包追踪开启时记录
+  };
+
+  // capacity 为每个类别的容量
+  explicit StageQueue(size_t capacity);
+
+  // 类别已满时丢弃并返回 false
+  bool push(Priority priority, std::vector<uint8_t> &&packet, bool inbound,
+            uint64_t capturedNs = 0);
+  bool pop(Item &out);
+  bool empty() const { return queued_ == 0; }
+
+  uint64_t dropped(Priority priority) const {
+    return rings_[priority].dropped;
+  }
+
+private:
+  struct Ring {
+    std::vector<Item> slots;
+    size_t head = 0;
+    size_t size = 0;
+    uint64_t dropped = 0;
+  };
+  Ring rings_[kNumPriorities];
+  size_t queued_ = 0;
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include "core/PacketTracer.h"
+#include "core/PipelineStages.h"
+#include <tuple>
+#include <utility>
+
+// 编译期组合的转发流水线：各阶段按模板参数顺序执行，类型全部已知，
+// 编译器可跨阶段内联。阶段依赖取具体类型（StaticRouteProvider、
+// PacketCapture 等 final 类）时整条路径没有虚调用。
+// 被 PacketTracer 抽中的报文在每个阶段结束时记录时刻
+template <class... Stages> class StaticPipeline {
+public:
+  static_assert(sizeof...(Stages) <= PacketTracer::kMaxStages,
+                "too many stages for PacketTracer");
+  static constexpr const char *kStageNames[] = {Stages::kName...};
+
+  explicit StaticPipeline(Stages... stages) : stages_(std::move(stages)...) {}
+
+  // capturedNs 为报文从内核读出的时刻，只用于追踪，未知时为 0
+  void process(std::vector<uint8_t> &&packet, uint64_t capturedNs = 0) {
+    PacketContext ctx;
+    ctx.packet = std::move(packet);
+    ctx.trace = PacketTracer::sample(capturedNs);
+    run(ctx, std::index_sequence_for<Stages...>());
+    if (ctx.trace) {
+      ctx.trace->names = kStageNames;
+      ctx.trace->srcIp = ctx.srcIp;
+      ctx.trace->dstIp = ctx.dstIp;
+      ctx.trace->protocol = ctx.protocol;
+    }
+  }
+
+  // 按类型取出阶段，用于构造后调整（如设置代理）
+  template <class Stage> Stage &stage() { return std::get<Stage>(stages_); }
+
+  const PipelineStats &stats() const { return stats_; }
+
+private:
+  template <size_t... I>
+  void run(PacketContext &ctx, std::index_sequence<I...>) {
+    // && 折叠：某一阶段返回 false 后短路
+    (void)(step<I>(ctx) && ...);
+  }
+
+  template <size_t I> bool step(PacketContext &ctx) {
+    bool next = std::get<I>(stages_)(ctx, stats_);
+    if (ctx.trace)
+      PacketTracer::mark(*ctx.trace, I);
+    return next;
+  }
+
+  std::tuple<Stages...> stages_;
+  PipelineStats stats_;
+};
+
+// 标准的 LAN 侧流水线：解析 → 防火墙 → QoS → 路由 → 代理 → SNAT → 发送。
+// 传入具体类型得到去虚化的版本（worker 的 WorkerPipeline），传入
+// RoutingManager / IPacketIO 则可在运行时选择路由提供者与收发后端
+// （离线回放的 ForwardingPipeline）
+template <class Firewall, class QoS, class Router, class Nat, class IO>
+using OutboundPipeline =
+    StaticPipeline<stage::Parse, stage::Filter<Firewall>, stage::RateLimit<QoS>,
+                   stage::Route<Router>, stage::Proxy, stage::Snat<Nat, IO>,
+                   stage::Transmit<IO>>;
+
+template <class Firewall, class QoS, class Router, class Nat, class IO>
+OutboundPipeline<Firewall, QoS, Router, Nat, IO>
+makeOutboundPipeline(IO &io, Firewall &firewall, QoS &qos, Router &router,
+                     Nat &nat) {
+  return OutboundPipeline<Firewall, QoS, Router, Nat, IO>(
+      stage::Parse(), stage::Filter<Firewall>(firewall),
+      stage::RateLimit<QoS>(qos), stage::Route<Router>(router), stage::Proxy(),
+      stage::Snat<Nat, IO>(nat, io), stage::Transmit<IO>(io));
+}
@@ -1,4 +1,6 @@
 #pragma once
+#include "core/ConfigSnapshot.h"
+#include "core/RuleClassifier.h"
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -12,12 +14,18 @@ struct FirewallRule {
   enum Action { ALLOW, DENY } action;
 };
 
+// 规则按文件顺序匹配，第一条命中的规则决定动作；
+// 加载时预解析为列存储，由 RuleClassifier 批量匹配
 class Firewall {
 public:
+  // 格式错误的行被跳过；文件无法打开或有被跳过的行时返回 false
   bool loadRules(const std::string &path);
+  // 直接引用快照中的规则列，snapshot 须比本对象长寿
+  bool loadSnapshot(const ConfigSnapshot &snapshot);
+  void saveSnapshot(ConfigSnapshotWriter &writer) const;
   bool allow(const std::vector<uint8_t> &packet);
 
 private:
-  std::vector<FirewallRule> rules_;
-  bool match(const FirewallRule &rule, const std::vector<uint8_t> &packet);
+  std::vector<uint8_t> actions_; // FirewallRule::Action，下标与规则一一对应
+  RuleClassifier classifier_;
 };
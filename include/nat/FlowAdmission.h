@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 新建流准入控制：每个源地址一个令牌桶，另有整个 NAT 分片共用的总桶。
+// 源地址按哈希落到定长槽位，冲突时后来者接管槽位，内存不随源地址数增长；
+// 伪造大量源地址的洪泛由总桶兜底。突发上限为每秒速率的 2 倍
+class FlowAdmission {
+public:
+  // 速率单位为新建流/秒；perSource 为 0 表示不限制
+  void configure(uint32_t perSource, uint32_t total);
+  bool enabled() const { return perSource_ != 0; }
+
+  // 消耗一个令牌；未启用时总是放行。srcIp 为网络字节序
+  bool admit(uint32_t srcIp, uint64_t nowMs);
+  uint64_t rejected() const { return rejected_; }
+
+private:
+  static constexpr size_t kSlots = 4096;
+
+  struct Bucket {
+    uint64_t lastMs = 0;
+    uint64_t milliTokens = 0; // 千分之一令牌为单位，按毫秒补充
+  };
+  struct Slot {
+    uint32_t srcIp = 0;
+    Bucket bucket;
+  };
+  static void refill(Bucket &bucket, uint32_t rate, uint64_t nowMs);
+
+  uint32_t perSource_ = 0;
+  uint32_t total_ = 0;
+  std::vector<Slot> slots_;
+  Bucket totalBucket_;
+  uint64_t rejected_ = 0;
+};
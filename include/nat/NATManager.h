@@ -1,34 +1,85 @@
 #pragma once
 
+#include "core/HugePageArena.h"
+#include "nat/FlowAdmission.h"
+#include "nat/NatStateStore.h"
 #include <cstdint>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+class NatOffload;
+
 struct NATEntry {
   std::string internalIp;
   uint16_t internalPort;
   std::string externalIp;
   uint16_t externalPort;
   uint8_t protocol;
+  uint64_t lastSeenMs = 0;
+  uint64_t offloadPackets = 0; // 内核快速路径已处理的回包数，用于判断活跃
+  uint32_t stateSlot = NatStateStore::kNoSlot; // 在热重启状态文件中的槽号
 };
 
+// 多 worker 时每个 worker 持有一个分片：外部端口满足 port % numShards == shard，
+// 回包按目的端口即可投递到创建映射的 worker，各分片 NAT 表互不共享
 class NATManager {
 public:
+  // arena 非空时映射表从其分配（大页、worker 所在 NUMA 节点），须比本对象长寿
+  explicit NATManager(size_t shard = 0, size_t numShards = 1,
+                      HugePageArena *arena = nullptr);
+
+  static size_t shardOfPort(uint16_t port, size_t numShards) {
+    return port % numShards;
+  }
+
   void setPublicIp(const std::string &iface);
   std::string getPublicIp();
 
+  // 打开热重启状态文件，恢复上一个进程留下的映射与端口分配位置，
+  // 之后的增删都写穿透到文件；须在 setPublicIp 之后、处理报文之前调用
+  bool attachState(const std::string &path);
+
+  // 本分片端口耗尽或新建流被准入控制拒绝时返回空，调用方丢弃报文
   std::vector<uint8_t> applySNAT(const std::vector<uint8_t> &packet);
   std::vector<uint8_t> applyDNAT(const std::vector<uint8_t> &packet);
 
+  // 报文是否命中已有映射：出方向按内部地址端口，回包按外部地址端口
+  bool hasMapping(const std::vector<uint8_t> &packet, bool inbound) const;
+
+  // 每个源地址与整个分片每秒可新建的映射数，perSource 为 0 表示不限制
+  void setFlowLimit(uint32_t perSource, uint32_t total);
+  uint64_t admissionRejected() const { return admission_.rejected(); }
+
+  // 现有及新建的映射下发到内核快速路径，回包不再经过 applyDNAT；
+  // offload 须比本对象长寿，可被多个分片共用
+  void setOffload(NatOffload *offload);
+
+  // 回收空闲超时的映射（含内核侧表项），返回回收数；由所属 worker 周期调用，
+  // 每次只检查表的一段，多次调用后覆盖全表
+  size_t expire(uint64_t nowMs);
+  static uint64_t nowMs();
+
 private:
+  size_t shard_;
+  size_t numShards_;
+  uint32_t nextPort_; // 下一个候选外部端口，按 numShards_ 步进
   std::string publicIp_;
-  std::unordered_map<std::string, NATEntry> natTable_; // 外部 → 内部
-  std::unordered_map<std::string, std::string> reverseTable_; // 内部 → 外部 key
-
-  uint16_t allocateExternalPort();
-  std::string makeNatKey(const std::string &ip, uint16_t port,
-                         uint8_t protocol);
-  std::string makeReverseKey(const std::string &ip, uint16_t port,
-                             uint8_t protocol);
+  NatOffload *offload_ = nullptr;
+  NatStateStore state_;
+  FlowAdmission admission_;
+  // 键为 (地址, 端口, 协议) 打包成的整数
+  template <typename V>
+  using FlowMap =
+      std::unordered_map<uint64_t, V, std::hash<uint64_t>,
+                         std::equal_to<uint64_t>,
+                         ArenaAllocator<std::pair<const uint64_t, V>>>;
+  FlowMap<NATEntry> natTable_;     // 外部 → 内部
+  FlowMap<uint64_t> reverseTable_; // 内部 → 外部 key
+  size_t expireCursor_ = 0;        // expire 下一次开始的桶号
+
+  size_t shardFlows() const;
+  uint16_t firstPort() const;
+  uint16_t allocateExternalPort(uint8_t protocol);
+  static uint64_t makeKey(uint32_t ip, uint16_t port, uint8_t protocol);
 };
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// 已建立 NAT 映射的回包在内核中完成 DNAT 并直接注入 TUN，不再经过用户态：
+// WAN 网卡的 TC 入口（tcx）挂一段 eBPF 程序，按 (外部地址, 外部端口, 协议)
+// 查 BPF hash map，改写目的地址端口与校验和后重定向到 TUN 的接收方向。
+// 只处理无 IP 选项、未分片的 TCP/UDP，其余报文照常交给用户态。
+// 程序在此手工汇编并经 bpf() 系统调用加载，不依赖 clang/libbpf；
+// 需要 root 与支持 tcx 的内核（6.6+），TUN 须与 WAN 网卡在同一网络命名空间
+class NatOffload {
+public:
+  struct Counters {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+  };
+
+  ~NatOffload();
+
+  bool attach(const std::string &wanIface, const std::string &tunIface);
+  void detach();
+  bool active() const { return linkFd_ >= 0; }
+
+  // 地址为网络字节序，端口为主机字节序；可被多个 worker 并发调用
+  bool install(uint32_t extIp, uint16_t extPort, uint8_t proto,
+               uint32_t intIp, uint16_t intPort);
+  void remove(uint32_t extIp, uint16_t extPort, uint8_t proto);
+  // 读取内核侧累计的报文数与字节数
+  bool counters(uint32_t extIp, uint16_t extPort, uint8_t proto,
+                Counters &out);
+
+private:
+  int mapFd_ = -1;
+  int progFd_ = -1;
+  int linkFd_ = -1; // 关闭即从网卡卸载
+  uint32_t tunIfindex_ = 0;
+};
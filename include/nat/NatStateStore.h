@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// 一条 NAT 映射的持久化形式，地址为网络字节序，端口为主机字节序
+struct NatStateRecord {
+  uint32_t externalIp;
+  uint32_t internalIp;
+  uint16_t externalPort;
+  uint16_t internalPort;
+  uint8_t protocol;
+  uint8_t used; // 最后写入，非 0 表示槽位有效
+  uint16_t reserved;
+};
+
+// 热重启用的 NAT 状态文件：一个分片一份，MAP_SHARED 映射，进程退出或崩溃后
+// 内容仍在页缓存中。布局为定长头部加定长槽位数组，只存下标不存指针，
+// 新进程映射到任意地址都可直接读取。映射表仍以内存中的哈希表为准，
+// 这里只做写穿透；启动时由 NATManager 读回重建。
+// 非线程安全：与所属 NAT 分片在同一 worker 中使用
+class NatStateStore {
+public:
+  static constexpr uint32_t kNoSlot = UINT32_MAX;
+
+  ~NatStateStore();
+
+  // 打开或创建状态文件；版本、槽位布局、分片参数或公网地址不一致时
+  // 丢弃旧内容重新初始化
+  bool open(const std::string &path, uint32_t shard, uint32_t numShards,
+            uint32_t publicIp, size_t capacity);
+  void close();
+  bool isOpen() const { return header_ != nullptr; }
+
+  // 遍历文件中有效的映射
+  void forEach(
+      const std::function<void(uint32_t, const NatStateRecord &)> &fn) const;
+
+  // 写入一条映射，返回槽号；槽位用尽时返回 kNoSlot
+  uint32_t insert(const NatStateRecord &record);
+  void erase(uint32_t slot);
+
+  // 端口分配器的下一个候选端口，0 表示文件中尚无记录
+  uint32_t nextPort() const;
+  void setNextPort(uint32_t port);
+
+private:
+  struct Header;
+
+  Header *header_ = nullptr;
+  NatStateRecord *records_ = nullptr;
+  size_t mapLength_ = 0;
+  uint32_t hint_ = 0; // 下一次查找空槽的起点
+};
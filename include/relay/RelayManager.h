@@ -0,0 +1,62 @@
+#pragma once
+
+#include "relay/Socks5.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class Socks5Pool;
+
+// 事件驱动的 SOCKS5 中继：少量工作线程各自持有一个 epoll（边沿触发），
+// 以非阻塞方式完成握手并双向转发大量会话。useSplice 时 socket 之间的转发
+// 经管道 splice，负载不进入用户态
+class RelayManager {
+public:
+  explicit RelayManager(size_t numWorkers = 2, size_t bufferSize = 16 * 1024,
+                        bool useSplice = false);
+  ~RelayManager();
+
+  // 需在 start() 之前设置；设置了连接池时优先取用预协商连接
+  void setProxy(const socks5::ProxyConfig &proxy);
+  void setPool(std::shared_ptr<Socks5Pool> pool);
+
+  bool start();
+  void stop();
+
+  // 接管 clientFd（任意流式 fd），经 SOCKS5 连接 dstIp:dstPort 后双向转发；
+  // 返回会话 id，失败返回 0（此时 clientFd 已被关闭）
+  uint64_t openSession(int clientFd, const std::string &dstIp,
+                       uint16_t dstPort);
+
+  size_t sessionCount() const;
+
+private:
+  struct Session;
+  struct Worker;
+
+  void workerLoop(Worker &worker);
+  void adoptPending(Worker &worker);
+  // 关闭超过握手时限仍未进入转发的会话
+  void expireHandshakes(Worker &worker);
+  void handleEvent(Worker &worker, Session &s, bool proxySide,
+                   uint32_t events);
+  bool driveHandshake(Session &s);
+  bool pump(Session &s);
+  bool pumpSplice(Session &s);
+  void closeSession(Worker &worker, Session &s);
+  static uint64_t nowMs();
+
+  size_t bufferSize_;
+  bool useSplice_;
+  socks5::ProxyConfig proxy_;
+  std::shared_ptr<Socks5Pool> pool_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<bool> running_{false};
+  std::atomic<uint64_t> nextId_{1};
+  std::atomic<size_t> sessionCount_{0};
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sys/types.h>
+
+// 定长字节环形缓冲区，用于会话的单方向转发；容量为 2 的幂，
+// 存储在第一次写入时才分配，空闲会话不占用内存
+class RingBuffer {
+public:
+  explicit RingBuffer(size_t capacity);
+
+  size_t size() const { return tail_ - head_; }
+  size_t capacity() const { return capacity_; }
+  size_t space() const { return capacity_ - size(); }
+  bool empty() const { return head_ == tail_; }
+  bool full() const { return size() == capacity_; }
+
+  // 追加数据，返回实际写入的字节数（受剩余空间限制）
+  size_t write(const uint8_t *data, size_t len);
+
+  // 从 offset 处复制最多 len 字节但不消费，供重传等场景使用
+  size_t peek(size_t offset, uint8_t *out, size_t len) const;
+  // 丢弃开头的 n 字节
+  void consume(size_t n);
+
+  // 从 fd 读取直到缓冲区满；返回 read 语义的结果（0 表示对端关闭）
+  ssize_t readFrom(int fd);
+  // 向 fd 写出缓冲区内容；返回 write 语义的结果
+  ssize_t writeTo(int fd);
+
+private:
+  size_t capacity_;
+  size_t head_ = 0; // 读位置（单调递增，取模后为下标）
+  size_t tail_ = 0; // 写位置
+  std::unique_ptr<uint8_t[]> data_;
+
+  uint8_t *storage();
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// SOCKS5 (RFC 1928) 报文编解码，供阻塞式 TcpRelay 与异步 RelayManager 共用
+namespace socks5 {
+
+constexpr uint8_t kVersion = 0x05;
+constexpr uint8_t kMethodNoAuth = 0x00;
+constexpr uint8_t kCmdConnect = 0x01;
+constexpr uint8_t kCmdUdpAssociate = 0x03;
+constexpr uint8_t kAtypIPv4 = 0x01;
+constexpr uint8_t kAtypDomain = 0x03;
+constexpr uint8_t kAtypIPv6 = 0x04;
+constexpr uint8_t kReplySucceeded = 0x00;
+
+// 上游 SOCKS5 代理地址，默认指向 Clash 本地端口
+struct ProxyConfig {
+  std::string ip = "127.0.0.1";
+  uint16_t port = 7897;
+
+  // 格式："<ip> <port>"，# 开头为注释
+  bool loadFromFile(const std::string &path);
+};
+
+// 连接与握手各步的超时，代理失联时调用方最多阻塞这么久
+constexpr int kHandshakeTimeoutMs = 3000;
+
+// 阻塞地连接代理并完成方法协商，失败或超时返回 -1
+int connectAndNegotiate(const ProxyConfig &proxy,
+                        int timeoutMs = kHandshakeTimeoutMs);
+
+// 方法协商请求：版本 + 1 个方法 + 无认证
+std::vector<uint8_t> buildGreeting();
+
+// 方法协商应答固定 2 字节，检查服务端是否接受无认证
+bool parseMethodReply(const uint8_t *data, size_t len);
+
+// 命令请求（CONNECT 等），dstIp 非法时返回空
+std::vector<uint8_t> buildRequest(uint8_t cmd, const std::string &dstIp,
+                                  uint16_t dstPort);
+
+constexpr size_t kMalformedReply = static_cast<size_t>(-1);
+
+// 根据已收到的前缀计算完整应答长度；数据不足以判断时返回 0，
+// 地址类型非法时返回 kMalformedReply
+size_t replyLength(const uint8_t *data, size_t len);
+
+// UDP 中继报文头：RSV(2) FRAG(1) ATYP(1) DST.ADDR DST.PORT，IPv4 时为 10 字节
+constexpr size_t kUdpHeaderLen = 10;
+
+// 在 out 处写入 IPv4 的 UDP 报文头；ip/port 为网络字节序
+void writeUdpHeader(uint8_t *out, uint32_t ip, uint16_t port);
+
+// 解析 UDP 报文头，返回头部长度；分片或非 IPv4 地址返回 0
+size_t parseUdpHeader(const uint8_t *data, size_t len, uint32_t &ip,
+                      uint16_t &port);
+
+} // namespace socks5
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "relay/Socks5.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// 预热的 SOCKS5 连接池：后台线程提前建立到代理的 TCP 连接并完成方法协商，
+// 新流取出后只需发送 CONNECT；空闲连接数按新建连接速率自适应调整
+class Socks5Pool {
+public:
+  explicit Socks5Pool(const socks5::ProxyConfig &proxy, size_t minIdle = 4,
+                      size_t maxIdle = 256);
+  ~Socks5Pool();
+
+  void start();
+  void stop();
+
+  // 取出一个已协商好的连接（阻塞模式），池空时返回 -1，由调用方自行新建
+  int acquire();
+
+  const socks5::ProxyConfig &proxy() const { return proxy_; }
+  size_t idleCount();
+  size_t targetIdle() const { return target_; }
+
+private:
+  struct IdleConn {
+    int fd;
+    uint64_t createdMs;
+  };
+
+  void refillLoop();
+  void updateTarget(uint64_t now);
+  static bool isHealthy(int fd);
+  static uint64_t nowMs();
+
+  socks5::ProxyConfig proxy_;
+  size_t minIdle_;
+  size_t maxIdle_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<IdleConn> idle_;
+
+  std::atomic<size_t> target_;
+  std::atomic<uint64_t> acquired_{0}; // 当前统计窗口内的取用次数
+  double rateEwma_ = 0;               // 每秒新建连接数的滑动平均
+  uint64_t lastTickMs_ = 0;
+
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <sys/types.h>
+
+// splice 中转管道：socket → pipe → socket，数据只在内核页之间移动，
+// 不进入用户态；管道本身充当转发缓冲区
+class SplicePipe {
+public:
+  SplicePipe() = default;
+  ~SplicePipe();
+  SplicePipe(const SplicePipe &) = delete;
+  SplicePipe &operator=(const SplicePipe &) = delete;
+
+  // 创建非阻塞管道并尽量调整容量
+  bool open(size_t capacity);
+  bool isOpen() const { return fds_[0] >= 0; }
+  // 关闭管道并丢弃其中的数据，之后可重新 open
+  void close();
+
+  // 管道中尚未转出的字节数
+  size_t size() const { return bytes_; }
+  bool empty() const { return bytes_ == 0; }
+
+  // srcFd → 管道；返回 splice 语义的结果（0 表示对端关闭）
+  ssize_t fill(int srcFd, size_t maxBytes);
+  // 管道 → dstFd
+  ssize_t drain(int dstFd, size_t maxBytes);
+
+  size_t capacity() const { return capacity_; }
+
+private:
+  int fds_[2] = {-1, -1};
+  size_t bytes_ = 0;
+  size_t capacity_ = 0;
+};
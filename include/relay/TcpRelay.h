@@ -1,14 +1,21 @@
 #pragma once
 
+#include "relay/Socks5.h"
+#include "relay/SplicePipe.h"
 #include <cstdint>
 #include <optional>
 #include <string>
 #include <vector>
 
+class Socks5Pool;
+
 class TcpRelay {
 public:
   // 构造函数接收目标地址和端口，连接 SOCKS5 代理
-  TcpRelay(const std::string &dstIp, uint16_t dstPort);
+  TcpRelay(const std::string &dstIp, uint16_t dstPort,
+           const socks5::ProxyConfig &proxy = {});
+  // 优先取用连接池中已完成方法协商的连接，只需再发送 CONNECT
+  TcpRelay(const std::string &dstIp, uint16_t dstPort, Socks5Pool &pool);
   ~TcpRelay();
 
   // 检查 SOCKS5 连接是否成功
@@ -20,12 +27,31 @@ public:
   // 接收 payload 数据
   std::optional<std::vector<uint8_t>> receivePayload();
 
+  // 零拷贝转发：srcFd 的数据经内部管道 splice 到代理连接，
+  // 返回搬运的字节数，0 表示 srcFd 已关闭，-1 表示出错
+  ssize_t spliceFrom(int srcFd, size_t maxBytes = 64 * 1024);
+
+  // 零拷贝转发：代理连接收到的数据经内部管道 splice 到 dstFd
+  ssize_t spliceTo(int dstFd, size_t maxBytes = 64 * 1024);
+
+  // 开启 SO_ZEROCOPY，不小于 threshold 的 sendPayload 改用 MSG_ZEROCOPY
+  bool enableZeroCopy(size_t threshold = 32 * 1024);
+
   // 获取 socket 文件描述符（供 poll/select 使用）
   int getSocketFd() const;
 
 private:
   int sockFd_ = -1;
 
-  // 执行 SOCKS5 握手与目标连接建立
+  SplicePipe inPipe_;  // srcFd → 代理
+  SplicePipe outPipe_; // 代理 → dstFd
+
+  bool zeroCopy_ = false;
+  size_t zeroCopyThreshold_ = 0;
+  uint32_t zcIssued_ = 0; // 已发出的 MSG_ZEROCOPY 调用次数
+
+  bool sendZeroCopy(const uint8_t *data, size_t len);
+
+  // 在已协商的代理连接上发送 CONNECT 并等待应答
   bool socks5Connect(const std::string &dstIp, uint16_t dstPort);
 };
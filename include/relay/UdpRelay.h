@@ -0,0 +1,114 @@
+#pragma once
+
+#include "relay/Socks5.h"
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+// SOCKS5 UDP ASSOCIATE 中继：来自 TUN 的 UDP 报文就地封装后，按流分配到
+// 少量关联上，用 sendmmsg/recvmmsg 批量收发；回包按 SOCKS 头中的远端地址
+// 分流还原为 IP 报文。关联的建立是非阻塞的，由 epoll 驱动并有截止时间，
+// 代理失联不会卡住主循环。同一远端在各关联上都已占用时，接管其中已应答
+// 或空闲较久的流（DNS 等请求-应答式流量由此复用少量关联），否则按需新建
+// 关联，总数有上限。
+// 与 UserTcpStack 一样在主循环中单线程使用
+class UdpRelay {
+public:
+  // 输出回 TUN 的 IP 报文
+  using Output = std::function<void(const uint8_t *, size_t)>;
+
+  // numAssociations 为常驻关联数，按需新建的关联总数不超过 maxAssociations
+  UdpRelay(const socks5::ProxyConfig &proxy, Output output,
+           size_t numAssociations = 4, size_t maxAssociations = 16);
+  ~UdpRelay();
+
+  bool start();
+  void stop();
+
+  // 处理一个来自 TUN 的 UDP/IPv4 报文，报文被接管并在原缓冲区内封装；
+  // 不是 UDP 时返回 false 且 packet 保持不变
+  bool handlePacket(std::vector<uint8_t> &&packet);
+
+  // 以 sendmmsg 发出各关联上积攒的报文
+  void flush();
+
+  // 批量接收代理回包，推进关联的建立，并处理断线重连与空闲流回收
+  void poll();
+
+  // 供主循环 poll 的 epoll fd
+  int getEventFd() const;
+
+  size_t flowCount() const { return flows_.size(); }
+  uint64_t droppedCount() const { return dropped_; }
+
+private:
+  struct Flow {
+    size_t assoc;
+    uint64_t remoteKey;
+    uint64_t lastSeenMs;
+  };
+  struct Peer {
+    uint64_t client;
+    uint64_t lastReplyMs; // 最近一次收到回包的时刻，用于判断流是否已应答
+  };
+  struct Pending {
+    std::vector<uint8_t> packet;
+    size_t offset; // 封装后的 SOCKS 报文在 packet 中的起始位置
+    size_t length;
+  };
+  struct Association {
+    // 建立过程：TCP 连接 → 方法协商 → UDP ASSOCIATE → 就绪
+    enum State { Closed, Connecting, Greeting, Requesting, Ready };
+    State state = Closed;
+    int ctrlFd = -1; // UDP ASSOCIATE 的 TCP 控制连接，关闭即关联失效
+    int udpFd = -1;
+    uint64_t deadlineMs = 0; // 建立过程的截止时刻
+    uint64_t retryAtMs = 0;
+    uint8_t reply[4 + 1 + 255 + 2]; // 握手应答，可能分多次收到
+    size_t replyLen = 0;
+    // 远端地址 → 客户端流；同一关联上远端地址唯一，回包才能无歧义分流
+    std::unordered_map<uint64_t, Peer> remotes;
+    std::vector<Pending> pending; // 建立期间到达的报文也暂存在这里
+  };
+
+  struct FlowKey;
+  bool openAssociation(size_t idx);
+  bool advanceHandshake(size_t idx);
+  bool finishAssociation(size_t idx);
+  void failAssociation(size_t idx, const char *why);
+  size_t addAssociation();
+  size_t chooseAssociation(const FlowKey &key, uint64_t now);
+  void closeAssociation(size_t idx);
+  void sendBatch(Association &a);
+  void receiveBatch(size_t idx);
+  void expireFlows(uint64_t now);
+  static uint64_t makeKey(uint32_t ip, uint16_t port);
+  static uint64_t nowMs();
+
+  socks5::ProxyConfig proxy_;
+  Output output_;
+  size_t baseAssocs_;
+  size_t maxAssocs_;
+  int epollFd_ = -1;
+  uint16_t ipId_ = 0;
+  uint64_t dropped_ = 0;
+  uint64_t lastExpireMs_ = 0;
+
+  // 下标 < baseAssocs_ 的为常驻关联，断线后自动重连
+  std::vector<Association> assocs_;
+  // 键为客户端 (ip,port) 与远端 (ip,port) 各自打包后的组合
+  struct FlowKey {
+    uint64_t client;
+    uint64_t remote;
+    bool operator==(const FlowKey &o) const {
+      return client == o.client && remote == o.remote;
+    }
+  };
+  struct FlowKeyHash {
+    size_t operator()(const FlowKey &k) const;
+  };
+  std::unordered_map<FlowKey, Flow, FlowKeyHash> flows_;
+
+  std::vector<uint8_t> rxBuf_; // recvmmsg 预分配的接收槽
+};
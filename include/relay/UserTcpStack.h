@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+class RelayManager;
+
+// 用户态 TCP 终结：在 TUN 上冒充远端，完成 LAN 客户端的握手、重组、
+// 窗口、ACK 与重传，并把字节流经 socketpair 交给 RelayManager 走 SOCKS5。
+// 单线程使用：handlePacket / poll / flush 都在主循环中调用
+class UserTcpStack {
+public:
+  // 输出回 TUN 的 IP 报文
+  using Output = std::function<void(const std::vector<uint8_t> &)>;
+
+  UserTcpStack(RelayManager &relay, Output output);
+  ~UserTcpStack();
+
+  // 处理一个来自 TUN 的 TCP/IPv4 报文；不是 TCP 时返回 false
+  bool handlePacket(const std::vector<uint8_t> &packet);
+
+  // 处理 socketpair 读写就绪与定时器（重传、零窗口探测、超时回收）
+  void poll();
+
+  // 发出积攒的 ACK；主循环在 TUN 暂时读空时调用，实现批量确认
+  void flush();
+
+  // 供主循环 poll 的 epoll fd
+  int getEventFd() const;
+  // 下一次需要调用 poll() 的时间，不超过 maxMs
+  int nextTimeoutMs(int maxMs) const;
+
+  size_t connectionCount() const;
+
+private:
+  // 客户端视角的四元组，地址与端口均为网络字节序
+  struct FlowKey {
+    uint32_t srcIp;
+    uint32_t dstIp;
+    uint16_t srcPort;
+    uint16_t dstPort;
+    bool operator==(const FlowKey &o) const {
+      return srcIp == o.srcIp && dstIp == o.dstIp && srcPort == o.srcPort &&
+             dstPort == o.dstPort;
+    }
+  };
+  struct FlowKeyHash {
+    size_t operator()(const FlowKey &k) const;
+  };
+  struct Conn;
+
+  Conn *accept(const FlowKey &key, uint32_t seq, const uint8_t *opts,
+               size_t optLen);
+  void processAck(Conn &c, uint32_t ack, uint16_t window, bool pureAck);
+  void processData(Conn &c, uint32_t seq, const uint8_t *data, size_t len,
+                   bool fin);
+  void deliver(Conn &c, const uint8_t *data, size_t len);
+  void service(Conn &c);
+  void trySend(Conn &c);
+  void sendSegment(Conn &c, uint8_t flags, uint32_t seq, size_t dataOffset,
+                   size_t len);
+  void sendSynAck(Conn &c);
+  void sendAck(Conn &c);
+  void sendReset(const FlowKey &key, uint32_t seq, uint32_t ack, bool withAck);
+  void queueAck(Conn &c);
+  void onTimer(Conn &c, uint64_t now);
+  void armRto(Conn &c, uint64_t now);
+  void close(Conn &c, bool reset);
+  uint32_t receiveWindow(const Conn &c) const;
+  std::vector<uint8_t> makePacket(const FlowKey &key, uint8_t flags,
+                                  uint32_t seq, uint32_t ack, uint16_t window,
+                                  size_t optLen, size_t payloadLen);
+  void finalize(std::vector<uint8_t> &packet);
+  void reap();
+  static uint64_t nowMs();
+
+  RelayManager &relay_;
+  Output output_;
+  int epollFd_ = -1;
+  uint16_t ipId_ = 0;
+  std::mt19937 rng_;
+  uint64_t lastTimerScanMs_ = 0;
+
+  std::unordered_map<FlowKey, std::unique_ptr<Conn>, FlowKeyHash> conns_;
+  std::vector<Conn *> ackQueue_;
+  std::vector<FlowKey> closed_;
+};
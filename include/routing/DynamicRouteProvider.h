@@ -1,31 +1,81 @@
 #pragma once
 #include "IRouteProvider.h"
+#include "routing/EcmpGroup.h"
 #include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
-class DynamicRouteProvider : public IRouteProvider {
+// 距离向量路由：二进制格式的批量更新，一个报文携带多条路由；
+// 路由变化时立即发送只含变化部分的触发更新，周期全量更新只用于保活。
+// 每条通告带上下一跳，收方发现下一跳是自己即视为不可达（毒性逆转）；
+// 超时未刷新的路由先置为不可达并通告，再经过回收期删除。
+// 多个邻居通告同一度量时保留为等价下一跳，按流哈希分担流量
+class DynamicRouteProvider final : public IRouteProvider {
 public:
+  static constexpr uint16_t kPort = 54321; // 路由更新的 UDP 端口
+
   DynamicRouteProvider(const std::string &iface, const std::string &localIp);
   ~DynamicRouteProvider();
 
   void start();
   void stop();
 
+  // 通告本机直连网段，metric 为到达该网段的代价
+  void advertise(const std::string &dest, const std::string &netmask,
+                 int metric = 0);
+  // 撤销本机通告，以不可达 metric 触发更新
+  void withdraw(const std::string &dest, const std::string &netmask);
+
   std::optional<RouteEntry> lookup(const std::string &dstIp) override;
+  std::optional<RouteEntry> lookup(const std::string &dstIp,
+                                   uint32_t flowHash) override;
+  bool resolve(uint32_t dst, uint32_t flowHash, RouteHop &hop) override;
 
 private:
+  struct Alternate {
+    uint32_t gateway;
+    uint64_t updatedMs;
+  };
+  struct Route {
+    uint32_t dest;    // 网络字节序，已按掩码截断
+    uint8_t prefixLen;
+    uint32_t gateway; // 网络字节序，本机通告为 0
+    uint8_t metric;
+    bool local;       // 由 advertise 产生
+    bool changed;     // 等待触发更新
+    uint64_t updatedMs;
+    // 与 gateway 等价的其余下一跳，各自独立刷新与超时
+    std::vector<Alternate> alternates;
+    std::shared_ptr<const EcmpGroup> group; // 有等价下一跳时才存在
+  };
+
   void sendLoop();
   void receiveLoop();
-  void mergeRoutes(const std::vector<RouteEntry> &newRoutes,
-                   const std::string &senderIp);
-  bool match(const std::string &ip, const RouteEntry &route);
+  void mergeRoutes(const uint8_t *data, size_t len, uint32_t senderIp);
+  void markChanged(Route &route);
+  void updateGroup(Route &route);
+  bool promoteAlternate(Route &route);
+  const Route *findRoute(uint32_t dst) const;
+  RouteEntry toEntry(const Route &route) const;
+  void expireRoutes(uint64_t now);
+  std::vector<std::vector<uint8_t>> serializeRoutes(bool full);
+  static uint64_t makeKey(uint32_t dest, uint8_t prefixLen);
+  static uint64_t nowMs();
 
   std::string iface_;
   std::string localIp_;
-  std::vector<RouteEntry> routeTable_;
-  std::mutex routeMutex_;
+  uint32_t localAddr_;
+  // 键为 (目的网段, 前缀长度)；查找时从长到短逐个前缀长度探测
+  std::unordered_map<uint64_t, Route> routeTable_;
+  uint64_t prefixMask_ = 0; // 表中出现过的前缀长度，bit i 对应 /i
+  bool pendingTrigger_ = false;
+  mutable std::mutex routeMutex_;
+  std::condition_variable triggerCv_;
 
   std::thread sendThread_;
   std::thread recvThread_;
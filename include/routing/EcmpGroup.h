@@ -0,0 +1,44 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct NextHop {
+  std::string gateway;
+  std::string iface;
+  uint32_t addr = 0; // gateway 的网络字节序形式，由 EcmpGroup 填写
+  bool operator==(const NextHop &o) const {
+    return gateway == o.gateway && iface == o.iface;
+  }
+};
+
+// 等价多路径下一跳组，采用弹性哈希：流哈希先映射到固定数量的桶，桶再指向
+// 下一跳。成员变化时只迁移必要的桶，其余流保持原路径，同一流内不会乱序。
+// 对象创建后不可变，变更通过 withNextHops 生成新组，可无锁地跨线程共享
+class EcmpGroup {
+public:
+  static constexpr size_t kBuckets = 256;
+
+  explicit EcmpGroup(std::vector<NextHop> hops);
+
+  // 以当前桶分配为基础生成新组：仍在组内的下一跳尽量保留原有的桶
+  std::shared_ptr<const EcmpGroup>
+  withNextHops(std::vector<NextHop> hops) const;
+
+  // 组为空时返回 nullptr
+  const NextHop *select(uint32_t flowHash) const;
+
+  const std::vector<NextHop> &nextHops() const { return hops_; }
+  size_t size() const { return hops_.size(); }
+
+private:
+  EcmpGroup() = default;
+  void resolveAddresses();
+  void rebalance(const std::vector<int> &oldToNew,
+                 const std::array<uint16_t, kBuckets> &oldBuckets);
+
+  std::vector<NextHop> hops_;
+  std::array<uint16_t, kBuckets> buckets_{};
+};
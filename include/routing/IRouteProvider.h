@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <optional>
 #include <string>
 
@@ -7,11 +8,26 @@ struct RouteEntry {
   std::string netmask;
   std::string gateway;
   std::string iface;
-  int metric;
+  int metric = 0;
+};
+
+// 转发快路径的查找结果，不含字符串拷贝：iface 指向路由提供者内
+// 与其同寿命的接口名
+struct RouteHop {
+  uint32_t gateway = 0; // 网络字节序，0 表示目的地址直连
+  const std::string *iface = nullptr;
 };
 
 class IRouteProvider {
 public:
   virtual ~IRouteProvider() = default;
   virtual std::optional<RouteEntry> lookup(const std::string &dstIp) = 0;
+  // 多路径路由按流哈希在等价下一跳中选择；默认忽略哈希，按单路径查找
+  virtual std::optional<RouteEntry> lookup(const std::string &dstIp,
+                                           uint32_t flowHash) {
+    (void)flowHash;
+    return lookup(dstIp);
+  }
+  // 快路径：dst 为网络字节序，命中时填写 hop 并返回 true
+  virtual bool resolve(uint32_t dst, uint32_t flowHash, RouteHop &hop) = 0;
 };
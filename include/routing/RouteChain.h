@@ -0,0 +1,19 @@
+#pragma once
+#include "routing/IRouteProvider.h"
+
+// 编译期固定的两级路由：先问 First，未命中再问 Second，语义同按此顺序
+// addProvider 的 RoutingManager。两者取 final 的具体类型时 resolve 没有
+// 虚调用，可内联进流水线的路由阶段；提供者须比本对象长寿
+template <class First, class Second> class RouteChain {
+public:
+  RouteChain(First &first, Second &second) : first_(first), second_(second) {}
+
+  bool resolve(uint32_t dst, uint32_t flowHash, RouteHop &hop) {
+    return first_.resolve(dst, flowHash, hop) ||
+           second_.resolve(dst, flowHash, hop);
+  }
+
+private:
+  First &first_;
+  Second &second_;
+};
@@ -1,13 +1,32 @@
 #pragma once
 #include "IRouteProvider.h"
+#include "core/ConfigSnapshot.h"
+#include "routing/EcmpGroup.h"
+#include <memory>
 #include <vector>
 
-class StaticRouteProvider : public IRouteProvider {
+// 静态路由表。目的网段与掩码相同的多行组成等价多路径路由，
+// 只保留度量最小的一组下一跳。加载后只读，快路径查找无锁
+class StaticRouteProvider final : public IRouteProvider {
 public:
+  // 格式错误的行被跳过；文件无法打开或有被跳过的行时返回 false
   bool loadFromFile(const std::string &path);
+  bool loadSnapshot(const ConfigSnapshot &snapshot);
+  void saveSnapshot(ConfigSnapshotWriter &writer) const;
   std::optional<RouteEntry> lookup(const std::string &dstIp) override;
+  std::optional<RouteEntry> lookup(const std::string &dstIp,
+                                   uint32_t flowHash) override;
+  bool resolve(uint32_t dst, uint32_t flowHash, RouteHop &hop) override;
 
 private:
-  std::vector<RouteEntry> routes_;
-  bool match(const std::string &ip, const RouteEntry &route);
+  struct Route {
+    RouteEntry entry; // 首个下一跳，供不带流哈希的查找使用
+    uint32_t dest;    // 网络字节序，已按掩码截断
+    uint32_t mask;
+    uint32_t gateway; // entry.gateway 的网络字节序形式
+    std::shared_ptr<const EcmpGroup> group;
+  };
+  std::vector<Route> routes_;
+  const Route *find(const std::string &dstIp);
+  const Route *find(uint32_t dst) const;
 };
@@ -1,26 +1,20 @@
 #include "QoS/QoSManager.h"
-#include <arpa/inet.h>
 #include <chrono>
 #include <fstream>
 #include <iostream>
-#include <netinet/ip.h>
-#include <netinet/tcp.h>
-#include <netinet/udp.h>
 #include <sstream>
 
-static bool ipMatch(const std::string &ruleIp, uint32_t actual) {
-  if (ruleIp == "ANY")
-    return true;
-  in_addr ruleAddr;
-  inet_aton(ruleIp.c_str(), &ruleAddr);
-  return ruleAddr.s_addr == actual;
-}
+QoSManager::QoSManager(HugePageArena *arena)
+    : flowTable_(0, std::hash<size_t>(), std::equal_to<size_t>(), arena) {}
 
 bool QoSManager::loadRules(const std::string &path) {
   std::ifstream in(path);
   if (!in)
     return false;
 
+  std::vector<ClassifierRule> parsed;
+  rates_.clear();
+  bool ok = true;
   std::string line;
   while (std::getline(in, line)) {
     if (line.empty() || line[0] == '#')
@@ -28,38 +22,66 @@ bool QoSManager::loadRules(const std::string &path) {
 
     std::istringstream ss(line);
     QoSRule rule;
-    std::string rateStr;
+    if (!(ss >> rule.srcIp >> rule.dstIp >> rule.protocol >>
+          rule.maxRateBytesPerSec)) {
+      std::cerr << "[QoS] Malformed rule: " << line << "\n";
+      ok = false;
+      continue;
+    }
 
-    ss >> rule.srcIp >> rule.dstIp >> rule.protocol >> rateStr;
-    rule.maxRateBytesPerSec = std::stoull(rateStr);
+    ClassifierRule c;
+    if (!RuleClassifier::parseAddress(rule.srcIp, c.srcIp, c.srcMask) ||
+        !RuleClassifier::parseAddress(rule.dstIp, c.dstIp, c.dstMask)) {
+      std::cerr << "[QoS] Bad address in rule: " << line << "\n";
+      ok = false;
+      continue;
+    }
+    if (!RuleClassifier::parseProtocol(rule.protocol, c.proto)) {
+      std::cerr << "[QoS] Bad protocol in rule: " << line << "\n";
+      ok = false;
+      continue;
+    }
 
-    rules_.push_back(rule);
+    rates_.push_back(rule.maxRateBytesPerSec);
+    parsed.push_back(c);
   }
+  classifier_.build(parsed);
 
-  std::cout << "[QoS] Loaded " << rules_.size() << " QoS rules.\n";
-  return true;
+  std::cout << "[QoS] Loaded " << rates_.size() << " QoS rules.\n";
+  return ok;
 }
 
-bool QoSManager::match(const QoSRule &rule,
-                       const std::vector<uint8_t> &packet) {
-  const iphdr *ip = reinterpret_cast<const iphdr *>(packet.data());
-
-  if (!ipMatch(rule.srcIp, ip->saddr))
+bool QoSManager::loadSnapshot(const ConfigSnapshot &snapshot) {
+  RuleColumns columns;
+  uint32_t count;
+  size_t size;
+  const void *rates = snapshot.section(SnapshotSection::QosRates, count, size);
+  if (!snapshot.columns(SnapshotSection::QosRules, columns) || !rates ||
+      count != columns.count || size != count * sizeof(uint64_t)) {
+    std::cerr << "[QoS] Snapshot has no valid QoS rules\n";
     return false;
-  if (!ipMatch(rule.dstIp, ip->daddr))
-    return false;
-
-  uint8_t protocol = ip->protocol;
-  if (rule.protocol != "ANY") {
-    if ((rule.protocol == "TCP" && protocol != IPPROTO_TCP) ||
-        (rule.protocol == "UDP" && protocol != IPPROTO_UDP)) {
-      return false;
-    }
   }
-
+  classifier_.attach(columns);
+  // 速率按 worker 数切分，需要私有副本
+  const uint64_t *p = static_cast<const uint64_t *>(rates);
+  rates_.assign(p, p + count);
+  std::cout << "[QoS] Loaded " << count << " QoS rules from snapshot.\n";
   return true;
 }
 
+void QoSManager::saveSnapshot(ConfigSnapshotWriter &writer) const {
+  writer.addColumns(SnapshotSection::QosRules, classifier_.columns());
+  writer.add(SnapshotSection::QosRates, rates_.size(), rates_.data(),
+             rates_.size() * sizeof(uint64_t));
+}
+
+void QoSManager::setRateShare(size_t shares) {
+  if (shares <= 1)
+    return;
+  for (auto &rate : rates_)
+    rate /= shares;
+}
+
 uint64_t QoSManager::nowMs() {
   auto now = std::chrono::steady_clock::now();
   return std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -68,26 +90,24 @@ uint64_t QoSManager::nowMs() {
 }
 
 bool QoSManager::allow(const std::vector<uint8_t> &packet) {
-  for (const auto &rule : rules_) {
-    if (match(rule, packet)) {
-      std::string flowKey = rule.srcIp + "_" + rule.dstIp + "_" + rule.protocol;
-      auto &state = flowTable_[flowKey];
-
-      uint64_t current = nowMs();
-      uint64_t elapsed = current - state.lastCheckTimeMs;
-      if (elapsed > 1000) { // 每秒刷新
-        state.bytesSent = 0;
-        state.lastCheckTimeMs = current;
-      }
-
-      if (state.bytesSent + packet.size() > rule.maxRateBytesPerSec) {
-        return false; // 超速，丢弃
-      }
-
-      state.bytesSent += packet.size();
-      return true;
-    }
+  size_t i = classifier_.match(RuleClassifier::keyOf(packet));
+  if (i == RuleClassifier::kNoMatch)
+    return true; // 没有匹配规则，默认放行
+
+  uint64_t rate = rates_[i];
+  auto &state = flowTable_[i];
+
+  uint64_t current = nowMs();
+  uint64_t elapsed = current - state.lastCheckTimeMs;
+  if (elapsed > 1000) { // 每秒刷新
+    state.bytesSent = 0;
+    state.lastCheckTimeMs = current;
   }
 
-  return true; // 没有匹配规则，默认放行
+  if (state.bytesSent + packet.size() > rate) {
+    return false; // 超速，丢弃
+  }
+
+  state.bytesSent += packet.size();
+  return true;
 }
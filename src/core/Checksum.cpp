@@ -0,0 +1,56 @@
+#include "core/Checksum.h"
+#include <arpa/inet.h>
+#include <cstring>
+
+static uint64_t sumWords(const void *vdata, size_t length, uint64_t acc) {
+  const char *data = reinterpret_cast<const char *>(vdata);
+
+  for (size_t i = 0; i + 1 < length; i += 2) {
+    uint16_t word;
+    memcpy(&word, data + i, 2);
+    acc += ntohs(word);
+  }
+
+  if (length & 1) {
+    uint16_t word = 0;
+    memcpy(&word, data + length - 1, 1);
+    acc += ntohs(word);
+  }
+  return acc;
+}
+
+static uint16_t fold(uint64_t acc) {
+  while (acc >> 16) {
+    acc = (acc & 0xffff) + (acc >> 16);
+  }
+  return htons(~acc);
+}
+
+uint16_t ipChecksum(const void *data, size_t length) {
+  return fold(sumWords(data, length, 0));
+}
+
+uint16_t l4Checksum(uint32_t saddr, uint32_t daddr, uint8_t protocol,
+                    const void *segment, size_t length) {
+  uint64_t acc = 0;
+  acc += ntohl(saddr) >> 16;
+  acc += ntohl(saddr) & 0xffff;
+  acc += ntohl(daddr) >> 16;
+  acc += ntohl(daddr) & 0xffff;
+  acc += protocol;
+  acc += length;
+  return fold(sumWords(segment, length, acc));
+}
+
+uint16_t checksumUpdate16(uint16_t check, uint16_t from, uint16_t to) {
+  // HC' = ~(~HC + ~m + m')
+  uint32_t acc = uint16_t(~ntohs(check)) + uint16_t(~ntohs(from)) + ntohs(to);
+  acc = (acc & 0xffff) + (acc >> 16);
+  acc = (acc & 0xffff) + (acc >> 16);
+  return htons(~acc);
+}
+
+uint16_t checksumUpdate32(uint16_t check, uint32_t from, uint32_t to) {
+  check = checksumUpdate16(check, from >> 16, to >> 16);
+  return checksumUpdate16(check, from & 0xffff, to & 0xffff);
+}
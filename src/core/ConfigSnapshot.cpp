@@ -0,0 +1,169 @@
+#include "core/ConfigSnapshot.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char kMagic[8] = {'W', 'U', 'C', 'F', 'G', 'S', 'N', 'P'};
+// 文件头、节目录或任一节的记录格式变化时递增
+static constexpr uint32_t kVersion = 1;
+static constexpr size_t kAlign = 64;
+
+namespace {
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t numSections;
+  uint64_t fileSize;
+};
+struct SectionEntry {
+  uint32_t id;
+  uint32_t count;
+  uint64_t offset;
+  uint64_t size;
+};
+} // namespace
+
+static size_t alignUp(size_t n) { return (n + kAlign - 1) / kAlign * kAlign; }
+
+void ConfigSnapshotWriter::add(SnapshotSection id, uint32_t count,
+                               const void *data, size_t size) {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  sections_.push_back({id, count, std::vector<uint8_t>(p, p + size)});
+}
+
+void ConfigSnapshotWriter::addColumns(SnapshotSection id,
+                                      const RuleColumns &c) {
+  const uint32_t *cols[RuleColumns::kNumColumns] = {
+      c.srcIp,     c.srcMask,   c.dstIp,     c.dstMask, c.srcPortLo,
+      c.srcPortHi, c.dstPortLo, c.dstPortHi, c.proto,   c.protoMask};
+  size_t colBytes = c.padded * sizeof(uint32_t);
+  Pending s{id, uint32_t(c.count),
+            std::vector<uint8_t>(colBytes * RuleColumns::kNumColumns)};
+  for (size_t i = 0; i < RuleColumns::kNumColumns && colBytes; ++i)
+    memcpy(s.data.data() + i * colBytes, cols[i], colBytes);
+  sections_.push_back(std::move(s));
+}
+
+bool ConfigSnapshotWriter::write(const std::string &path) const {
+  size_t offset =
+      alignUp(sizeof(FileHeader) + sections_.size() * sizeof(SectionEntry));
+  std::vector<SectionEntry> dir;
+  for (const auto &s : sections_) {
+    dir.push_back({uint32_t(s.id), s.count, offset, s.data.size()});
+    offset = alignUp(offset + s.data.size());
+  }
+  FileHeader header{};
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.numSections = sections_.size();
+  header.fileSize = offset;
+
+  std::vector<uint8_t> image(offset, 0);
+  memcpy(image.data(), &header, sizeof(header));
+  memcpy(image.data() + sizeof(header), dir.data(),
+         dir.size() * sizeof(SectionEntry));
+  for (size_t i = 0; i < sections_.size(); ++i)
+    if (!sections_[i].data.empty())
+      memcpy(image.data() + dir[i].offset, sections_[i].data.data(),
+             sections_[i].data.size());
+
+  std::string tmp = path + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (!f) {
+    perror(("[Snapshot] " + tmp).c_str());
+    return false;
+  }
+  bool ok = fwrite(image.data(), 1, image.size(), f) == image.size();
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    perror(("[Snapshot] " + path).c_str());
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+ConfigSnapshot::~ConfigSnapshot() {
+  if (base_)
+    munmap(const_cast<uint8_t *>(base_), length_);
+}
+
+bool ConfigSnapshot::open(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    perror(("[Snapshot] " + path).c_str());
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(FileHeader)) {
+    std::cerr << "[Snapshot] " << path << " is truncated\n";
+    ::close(fd);
+    return false;
+  }
+  void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE,
+                 fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    perror("[Snapshot] mmap");
+    return false;
+  }
+  base_ = static_cast<const uint8_t *>(p);
+  length_ = st.st_size;
+
+  const FileHeader *h = reinterpret_cast<const FileHeader *>(base_);
+  bool ok = memcmp(h->magic, kMagic, sizeof(kMagic)) == 0 &&
+            h->version == kVersion && h->fileSize == length_ &&
+            sizeof(FileHeader) + h->numSections * sizeof(SectionEntry) <=
+                length_;
+  const SectionEntry *dir = reinterpret_cast<const SectionEntry *>(h + 1);
+  for (uint32_t i = 0; ok && i < h->numSections; ++i)
+    ok = dir[i].offset % kAlign == 0 && dir[i].offset <= length_ &&
+         dir[i].size <= length_ - dir[i].offset;
+  if (!ok) {
+    std::cerr << "[Snapshot] " << path
+              << " has a bad header or version, recompile it\n";
+    munmap(p, length_);
+    base_ = nullptr;
+    length_ = 0;
+    return false;
+  }
+  std::cout << "[Snapshot] Mapped " << path << " (" << length_
+            << " bytes)\n";
+  return true;
+}
+
+const void *ConfigSnapshot::section(SnapshotSection id, uint32_t &count,
+                                    size_t &size) const {
+  if (!base_)
+    return nullptr;
+  const FileHeader *h = reinterpret_cast<const FileHeader *>(base_);
+  const SectionEntry *dir = reinterpret_cast<const SectionEntry *>(h + 1);
+  for (uint32_t i = 0; i < h->numSections; ++i) {
+    if (dir[i].id == uint32_t(id)) {
+      count = dir[i].count;
+      size = dir[i].size;
+      return base_ + dir[i].offset;
+    }
+  }
+  return nullptr;
+}
+
+bool ConfigSnapshot::columns(SnapshotSection id, RuleColumns &out) const {
+  uint32_t count;
+  size_t size;
+  const void *p = section(id, count, size);
+  size_t padded = size / RuleColumns::kNumColumns / sizeof(uint32_t);
+  if (!p || padded * RuleColumns::kNumColumns * sizeof(uint32_t) != size ||
+      padded % RuleClassifier::kLanes != 0 || count > padded)
+    return false;
+  const uint32_t *col[RuleColumns::kNumColumns];
+  for (size_t i = 0; i < RuleColumns::kNumColumns; ++i)
+    col[i] = static_cast<const uint32_t *>(p) + i * padded;
+  out = RuleColumns{col[0], col[1], col[2], col[3], col[4], col[5],
+                    col[6], col[7], col[8], col[9], count,  padded};
+  return true;
+}
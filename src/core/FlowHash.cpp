@@ -0,0 +1,33 @@
+#include "core/FlowHash.h"
+#include <arpa/inet.h>
+#include <cstring>
+#include <netinet/ip.h>
+
+// 64 位 murmur3 终结函数，雪崩效果好且足够快
+static uint64_t mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+uint32_t flowHash(const std::vector<uint8_t> &packet) {
+  if (packet.size() < sizeof(iphdr))
+    return 0;
+  const iphdr *ip = reinterpret_cast<const iphdr *>(packet.data());
+  size_t ipLen = ip->ihl * 4;
+
+  uint32_t ports = 0;
+  bool fragmented = ntohs(ip->frag_off) & (IP_MF | IP_OFFMASK);
+  // 头长非法时只按地址与协议散列，不去读并不存在的端口
+  if (!fragmented && ip->ihl >= 5 &&
+      (ip->protocol == IPPROTO_TCP || ip->protocol == IPPROTO_UDP) &&
+      packet.size() >= ipLen + 4)
+    memcpy(&ports, packet.data() + ipLen, 4); // 源端口与目的端口
+
+  uint64_t h = mix((uint64_t(ip->saddr) << 32) | ip->daddr);
+  h = mix(h ^ ((uint64_t(ports) << 8) | ip->protocol));
+  return static_cast<uint32_t>(h ^ (h >> 32));
+}
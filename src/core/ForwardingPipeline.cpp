@@ -0,0 +1,108 @@
+#include "core/ForwardingPipeline.h"
+#include "QoS/QoSManager.h"
+#include "core/PacketCapture.h"
+#include "core/Probes.h"
+#include "core/RoutingManager.h"
+#include "firewall/Firewall.h"
+#include "nat/NATManager.h"
+#include "relay/UdpRelay.h"
+#include "relay/UserTcpStack.h"
+#include "routing/DynamicRouteProvider.h"
+#include "routing/StaticRouteProvider.h"
+#include <arpa/inet.h>
+#include <cstring>
+#include <netinet/ip.h>
+
+template <class Router, class IO>
+BasicForwardingPipeline<Router, IO>::BasicForwardingPipeline(
+    IO &io, Firewall &firewall, QoSManager &qos, Router &router,
+    NATManager &nat)
+    : io_(io), nat_(nat),
+      outbound_(makeOutboundPipeline(io, firewall, qos, router, nat)) {}
+
+template <class Router, class IO>
+void BasicForwardingPipeline<Router, IO>::setProxy(UserTcpStack *tcpStack,
+                                                   UdpRelay *udpRelay) {
+  tcpStack_ = tcpStack;
+  udpRelay_ = udpRelay;
+  outbound_.template stage<stage::Proxy>() = stage::Proxy(tcpStack, udpRelay);
+}
+
+template <class Router, class IO>
+void BasicForwardingPipeline<Router, IO>::processOutbound(
+    std::vector<uint8_t> &&packet, uint64_t capturedNs) {
+  outbound_.process(std::move(packet), capturedNs);
+}
+
+template <class Router, class IO>
+void BasicForwardingPipeline<Router, IO>::processInbound(
+    const std::vector<uint8_t> &packet) {
+  if (packet.size() < sizeof(iphdr))
+    return;
+  auto dnatted = nat_.applyDNAT(packet);
+  io_.writeToTun(dnatted);
+  // 没有映射时 applyDNAT 原样返回，目的地址不变，记为透传
+  WUTHERING_PROBE3(transmit,
+                   reinterpret_cast<const iphdr *>(dnatted.data())->daddr,
+                   dnatted.size(),
+                   reinterpret_cast<const iphdr *>(dnatted.data())->daddr !=
+                           reinterpret_cast<const iphdr *>(packet.data())->daddr
+                       ? 2
+                       : 3);
+  inbound_.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <class Router, class IO>
+StageQueue::Priority BasicForwardingPipeline<Router, IO>::classify(
+    const std::vector<uint8_t> &packet, bool inbound) const {
+  if (packet.size() < sizeof(iphdr))
+    return StageQueue::NewFlow;
+  const iphdr *iph = reinterpret_cast<const iphdr *>(packet.data());
+  size_t ipLen = iph->ihl * 4;
+  // 这里只保证数据面上经过本 worker 的 DV 报文（WAN 抓包的副本与 LAN 侧
+  // 转发的更新）不被洪泛挤掉；本机的路由更新由 DynamicRouteProvider 在
+  // 自己的线程与 socket 上收发，不经过 StageQueue
+  if (iph->protocol == IPPROTO_UDP && packet.size() >= ipLen + 4) {
+    uint16_t dport;
+    memcpy(&dport, packet.data() + ipLen + 2, sizeof(dport));
+    if (ntohs(dport) == DynamicRouteProvider::kPort)
+      return StageQueue::Control;
+  }
+  if (inbound)
+    return nat_.hasMapping(packet, true) ? StageQueue::Established
+                                         : StageQueue::NewFlow;
+  // 只有 LAN 发往外网、且不交给代理的流量会新建 NAT 映射
+  if (!isLanAddress(iph->saddr) || isLanAddress(iph->daddr))
+    return StageQueue::Established;
+  if ((tcpStack_ && iph->protocol == IPPROTO_TCP) ||
+      (udpRelay_ && iph->protocol == IPPROTO_UDP))
+    return StageQueue::Established;
+  return nat_.hasMapping(packet, false) ? StageQueue::Established
+                                        : StageQueue::NewFlow;
+}
+
+template <class Router, class IO>
+uint64_t BasicForwardingPipeline<Router, IO>::drain() {
+  uint64_t n = 0;
+  // 先回放 LAN 侧建立 NAT 映射，再回放 WAN 侧回包
+  while (auto packet = io_.readPacket()) {
+    processOutbound(std::move(*packet));
+    ++n;
+  }
+  while (auto packet = io_.readRawPacket()) {
+    processInbound(*packet);
+    ++n;
+  }
+  return n;
+}
+
+template <class Router, class IO>
+typename BasicForwardingPipeline<Router, IO>::Stats
+BasicForwardingPipeline<Router, IO>::stats() const {
+  Stats s = outbound_.stats();
+  s.inbound = inbound_.load(std::memory_order_relaxed);
+  return s;
+}
+
+template class BasicForwardingPipeline<RoutingManager, IPacketIO>;
+template class BasicForwardingPipeline<WorkerRouter, PacketCapture>;
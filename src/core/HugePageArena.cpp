@@ -0,0 +1,158 @@
+#include "core/HugePageArena.h"
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+static constexpr size_t k2MB = size_t(2) << 20;
+static constexpr size_t k1GB = size_t(1) << 30;
+
+static size_t roundUp(size_t size, size_t align) {
+  return (size + align - 1) / align * align;
+}
+
+HugePageArena::HugePageArena(int numaNode)
+    : numaNode_(numaNode), nextChunk_(k2MB) {}
+
+HugePageArena::~HugePageArena() {
+  for (auto &c : chunks_)
+    munmap(c.first, c.second);
+  for (auto &kv : large_)
+    munmap(kv.first, kv.second.length);
+}
+
+int HugePageArena::nodeOfCpu(int cpu) {
+  // /sys/devices/system/cpu/cpuN/ 下有指向所属节点的 nodeM 链接
+  std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+  DIR *dir = opendir(path.c_str());
+  if (!dir)
+    return -1;
+  int node = -1;
+  while (dirent *e = readdir(dir)) {
+    std::string name = e->d_name;
+    if (name.size() > 4 && name.compare(0, 4, "node") == 0) {
+      node = std::stoi(name.substr(4));
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+}
+
+size_t HugePageArena::classOf(size_t size) {
+  if (size <= kSmallMax)
+    return size == 0 ? 0 : (size - 1) / kSmallStep;
+  size_t cls = kSmallMax / kSmallStep;
+  for (size_t s = kSmallMax * 2; s < size; s <<= 1)
+    ++cls;
+  return cls;
+}
+
+size_t HugePageArena::classSize(size_t cls) {
+  if (cls < kSmallMax / kSmallStep)
+    return (cls + 1) * kSmallStep;
+  return kSmallMax << (cls - kSmallMax / kSmallStep + 1);
+}
+
+void *HugePageArena::mapRegion(size_t size, size_t &mapped, bool &huge) {
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  void *p = MAP_FAILED;
+  huge = true;
+  if (size % k1GB == 0) {
+    mapped = size;
+    p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+             flags | MAP_HUGETLB | MAP_HUGE_1GB, -1, 0);
+  }
+  if (p == MAP_FAILED && size >= k2MB) {
+    mapped = roundUp(size, k2MB);
+    p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+             flags | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+  }
+  if (p == MAP_FAILED) {
+    // 没有预留的 hugetlb 大页：普通页，交给透明大页尽量合并
+    huge = false;
+    mapped = roundUp(size, sysconf(_SC_PAGESIZE));
+    p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (p == MAP_FAILED)
+      return nullptr;
+    madvise(p, mapped, MADV_HUGEPAGE);
+  }
+
+  // 在首次访问之前设置策略，页面在缺页时才真正分配到节点上；
+  // 用 PREFERRED 而不是 BIND，节点内存不足时仍可从其他节点分配
+  if (numaNode_ >= 0 && numaNode_ < 64) {
+    unsigned long mask = 1UL << numaNode_;
+    syscall(SYS_mbind, p, mapped, MPOL_PREFERRED, &mask, sizeof(mask) * 8,
+            0);
+  }
+  mappedBytes_ += mapped;
+  if (huge)
+    hugeBytes_ += mapped;
+  return p;
+}
+
+void *HugePageArena::carve(size_t size) {
+  if (size_t(limit_ - cursor_) < size) {
+    // 当前块剩余部分放弃不用；块大小倍增，减少映射次数
+    size_t mapped;
+    bool huge;
+    void *chunk = mapRegion(nextChunk_, mapped, huge);
+    if (!chunk)
+      return nullptr;
+    chunks_.push_back({chunk, mapped});
+    cursor_ = static_cast<uint8_t *>(chunk);
+    limit_ = cursor_ + mapped;
+    if (nextChunk_ < k1GB)
+      nextChunk_ *= 2;
+  }
+  void *p = cursor_;
+  cursor_ += size;
+  return p;
+}
+
+void *HugePageArena::allocate(size_t size) {
+  if (size > kMediumMax) {
+    Mapping m;
+    void *p = mapRegion(size, m.length, m.huge);
+    if (p)
+      large_[p] = m;
+    return p;
+  }
+  size_t cls = classOf(size);
+  auto &list = freeLists_[cls];
+  if (!list.empty()) {
+    void *p = list.back();
+    list.pop_back();
+    return p;
+  }
+  return carve(classSize(cls));
+}
+
+void HugePageArena::deallocate(void *p, size_t size) {
+  if (!p)
+    return;
+  if (size > kMediumMax) {
+    auto it = large_.find(p);
+    if (it != large_.end()) {
+      munmap(p, it->second.length);
+      mappedBytes_ -= it->second.length;
+      if (it->second.huge)
+        hugeBytes_ -= it->second.length;
+      large_.erase(it);
+    }
+    return;
+  }
+  freeLists_[classOf(size)].push_back(p);
+}
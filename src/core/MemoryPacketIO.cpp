@@ -0,0 +1,70 @@
+#include "core/MemoryPacketIO.h"
+
+MemoryPacketIO::MemoryPacketIO(size_t rounds) : rounds_(rounds ? rounds : 1) {}
+
+void MemoryPacketIO::addLanPacket(std::vector<uint8_t> packet) {
+  lanSrc_.packets.push_back(std::move(packet));
+}
+
+void MemoryPacketIO::addWanPacket(std::vector<uint8_t> packet) {
+  wanSrc_.packets.push_back(std::move(packet));
+}
+
+void MemoryPacketIO::rewind() {
+  lanSrc_.next = lanSrc_.round = 0;
+  wanSrc_.next = wanSrc_.round = 0;
+}
+
+void MemoryPacketIO::keepOutput(size_t n) {
+  keep_ = n;
+  while (output_.size() > keep_)
+    output_.pop_front();
+}
+
+std::optional<std::vector<uint8_t>> MemoryPacketIO::next(Source &src) {
+  if (src.packets.empty() || src.round >= rounds_)
+    return std::nullopt;
+  // 流水线会就地修改报文，因此每次交出副本，原始报文可重复回放
+  std::vector<uint8_t> packet = src.packets[src.next];
+  if (++src.next == src.packets.size()) {
+    src.next = 0;
+    ++src.round;
+  }
+  return packet;
+}
+
+std::optional<std::vector<uint8_t>> MemoryPacketIO::readPacket() {
+  return next(lanSrc_);
+}
+
+std::optional<std::vector<uint8_t>> MemoryPacketIO::readRawPacket() {
+  return next(wanSrc_);
+}
+
+void MemoryPacketIO::record(const uint8_t *data, size_t len) {
+  counters_.bytes += len;
+  if (keep_ == 0)
+    return;
+  if (output_.size() == keep_)
+    output_.pop_front();
+  output_.emplace_back(data, data + len);
+}
+
+bool MemoryPacketIO::writePacket(const std::vector<uint8_t> &packet) {
+  ++counters_.toWan;
+  record(packet.data(), packet.size());
+  return true;
+}
+
+bool MemoryPacketIO::writeToTun(const uint8_t *data, size_t len) {
+  ++counters_.toTun;
+  record(data, len);
+  return true;
+}
+
+bool MemoryPacketIO::sendViaInterface(const std::vector<uint8_t> &packet,
+                                      const RouteHop &) {
+  ++counters_.toIface;
+  record(packet.data(), packet.size());
+  return true;
+}
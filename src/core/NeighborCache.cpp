@@ -0,0 +1,262 @@
+#include "core/NeighborCache.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if_arp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static constexpr uint64_t kReachableMs = 30000; // 超过后转为 STALE
+static constexpr uint64_t kProbeIntervalMs = 1000;
+static constexpr int kMaxProbes = 3;
+static constexpr uint64_t kFailedHoldMs = 5000; // 解析失败后暂不重试
+
+// 以太网 + IPv4 ARP 报文
+struct __attribute__((packed)) ArpFrame {
+  uint8_t dst[6];
+  uint8_t src[6];
+  uint16_t ethType;
+  uint16_t hwType;
+  uint16_t protoType;
+  uint8_t hwLen;
+  uint8_t protoLen;
+  uint16_t op;
+  uint8_t senderMac[6];
+  uint32_t senderIp;
+  uint8_t targetMac[6];
+  uint32_t targetIp;
+};
+
+NeighborCache::~NeighborCache() { stop(); }
+
+uint64_t NeighborCache::makeKey(int ifindex, uint32_t addr) {
+  return (uint64_t(uint32_t(ifindex)) << 32) | addr;
+}
+
+uint64_t NeighborCache::nowMs() {
+  auto now = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             now.time_since_epoch())
+      .count();
+}
+
+bool NeighborCache::start() {
+  sock_ = socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK, htons(ETH_P_ARP));
+  if (sock_ < 0) {
+    perror("[Neighbor] socket");
+    return false;
+  }
+  wakeFd_ = eventfd(0, EFD_NONBLOCK);
+  if (wakeFd_ < 0) {
+    perror("[Neighbor] eventfd");
+    close(sock_);
+    sock_ = -1;
+    return false;
+  }
+
+  running_ = true;
+  worker_ = std::thread(&NeighborCache::workerLoop, this);
+  return true;
+}
+
+void NeighborCache::stop() {
+  running_ = false;
+  if (worker_.joinable())
+    worker_.join();
+  if (sock_ >= 0) {
+    close(sock_);
+    sock_ = -1;
+  }
+  if (wakeFd_ >= 0) {
+    close(wakeFd_);
+    wakeFd_ = -1;
+  }
+}
+
+void NeighborCache::addInterface(int ifindex, const uint8_t mac[6],
+                                 uint32_t addr) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Interface &itf = interfaces_[ifindex];
+  memcpy(itf.mac.data(), mac, 6);
+  itf.addr = addr;
+}
+
+bool NeighborCache::lookup(int ifindex, uint32_t nextHop, EthHeader &header) {
+  uint64_t key = makeKey(ifindex, nextHop);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    const Entry &e = it->second;
+    if (e.state == State::Reachable || e.state == State::Stale) {
+      header = e.header;
+      return true;
+    }
+    return false;
+  }
+
+  auto itf = interfaces_.find(ifindex);
+  if (itf == interfaces_.end())
+    return false;
+  Entry &e = entries_[key];
+  // 源 MAC 与类型字段先填好，解析完成后只需补目的 MAC
+  memcpy(e.header.data() + 6, itf->second.mac.data(), 6);
+  e.header[12] = ETH_P_IP >> 8;
+  e.header[13] = ETH_P_IP & 0xff;
+  uint64_t one = 1;
+  if (wakeFd_ >= 0)
+    (void)!write(wakeFd_, &one, sizeof(one));
+  return false;
+}
+
+bool NeighborCache::lookup(Local &local, int ifindex, uint32_t nextHop,
+                           EthHeader &header) {
+  uint64_t key = makeKey(ifindex, nextHop);
+  // 先取代号再查共享表：其间若有更新，存入的表头会在下次比较代号时作废
+  uint64_t gen = generation_.load(std::memory_order_acquire);
+  if (local.generation != gen) {
+    local.headers.clear();
+    local.generation = gen;
+  } else {
+    auto hit = local.headers.find(key);
+    if (hit != local.headers.end()) {
+      header = hit->second;
+      return true;
+    }
+  }
+  if (!lookup(ifindex, nextHop, header))
+    return false;
+  local.headers.emplace(key, header);
+  return true;
+}
+
+size_t NeighborCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+void NeighborCache::sendRequest(int ifindex, uint32_t target,
+                                const uint8_t *dstMac) {
+  auto itf = interfaces_.find(ifindex);
+  if (itf == interfaces_.end())
+    return;
+
+  static const uint8_t kBroadcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+  ArpFrame f{};
+  memcpy(f.dst, dstMac ? dstMac : kBroadcast, 6);
+  memcpy(f.src, itf->second.mac.data(), 6);
+  f.ethType = htons(ETH_P_ARP);
+  f.hwType = htons(ARPHRD_ETHER);
+  f.protoType = htons(ETH_P_IP);
+  f.hwLen = 6;
+  f.protoLen = 4;
+  f.op = htons(ARPOP_REQUEST);
+  memcpy(f.senderMac, itf->second.mac.data(), 6);
+  f.senderIp = itf->second.addr;
+  f.targetIp = target;
+
+  sockaddr_ll sll{};
+  sll.sll_family = AF_PACKET;
+  sll.sll_protocol = htons(ETH_P_ARP);
+  sll.sll_ifindex = ifindex;
+  sll.sll_halen = 6;
+  memcpy(sll.sll_addr, f.dst, 6);
+  sendto(sock_, &f, sizeof(f), 0, (sockaddr *)&sll, sizeof(sll));
+}
+
+void NeighborCache::service(uint64_t now) {
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    Entry &e = it->second;
+    int ifindex = int(it->first >> 32);
+    uint32_t addr = uint32_t(it->first);
+
+    if (e.state == State::Reachable && now - e.updatedMs > kReachableMs) {
+      e.state = State::Stale;
+      e.probes = 0;
+      e.nextProbeMs = now;
+    }
+    if (e.state == State::Failed) {
+      it = now >= e.nextProbeMs ? entries_.erase(it) : std::next(it);
+      continue;
+    }
+    if (e.state == State::Reachable || now < e.nextProbeMs) {
+      ++it;
+      continue;
+    }
+
+    if (e.probes >= kMaxProbes) {
+      if (e.state == State::Stale) {
+        std::cout << "[Neighbor] Lost " << inet_ntoa(in_addr{addr})
+                  << std::endl;
+        it = entries_.erase(it);
+        generation_.fetch_add(1, std::memory_order_release);
+      } else {
+        std::cout << "[Neighbor] Failed to resolve "
+                  << inet_ntoa(in_addr{addr}) << std::endl;
+        e.state = State::Failed;
+        e.nextProbeMs = now + kFailedHoldMs;
+        ++it;
+      }
+      continue;
+    }
+    // STALE 表项单播探测，未解析的广播
+    const uint8_t *dstMac = e.state == State::Stale ? e.header.data() : nullptr;
+    sendRequest(ifindex, addr, dstMac);
+    ++e.probes;
+    e.nextProbeMs = now + kProbeIntervalMs;
+    ++it;
+  }
+}
+
+void NeighborCache::receiveAll() {
+  ArpFrame f;
+  sockaddr_ll from{};
+  socklen_t fromLen = sizeof(from);
+  ssize_t len;
+  while ((len = recvfrom(sock_, &f, sizeof(f), 0, (sockaddr *)&from,
+                         &fromLen)) >= 0) {
+    fromLen = sizeof(from);
+    if (len < (ssize_t)sizeof(f) || from.sll_pkttype == PACKET_OUTGOING ||
+        ntohs(f.hwType) != ARPHRD_ETHER || ntohs(f.protoType) != ETH_P_IP)
+      continue;
+
+    // 应答和请求都能说明发送方的地址，只更新已在表中的邻居，不被动建表
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(makeKey(from.sll_ifindex, f.senderIp));
+    if (it == entries_.end())
+      continue;
+    Entry &e = it->second;
+    bool resolved = e.state == State::Reachable || e.state == State::Stale;
+    if (!resolved)
+      std::cout << "[Neighbor] Resolved " << inet_ntoa(in_addr{f.senderIp})
+                << std::endl;
+    if (!resolved || memcmp(e.header.data(), f.senderMac, 6) != 0) {
+      memcpy(e.header.data(), f.senderMac, 6);
+      generation_.fetch_add(1, std::memory_order_release);
+    }
+    e.state = State::Reachable;
+    e.updatedMs = nowMs();
+    e.probes = 0;
+  }
+}
+
+void NeighborCache::workerLoop() {
+  pollfd fds[2] = {{sock_, POLLIN, 0}, {wakeFd_, POLLIN, 0}};
+  while (running_) {
+    // 超时兼作探测与老化的定时器，也保证 stop() 能及时退出
+    if (poll(fds, 2, 100) > 0) {
+      if (fds[1].revents & POLLIN) {
+        uint64_t n;
+        (void)!read(wakeFd_, &n, sizeof(n));
+      }
+      if (fds[0].revents & POLLIN)
+        receiveAll();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    service(nowMs());
+  }
+}
@@ -1,18 +1,97 @@
 #include "core/PacketCapture.h"
+#include "core/Checksum.h"
+#include "core/Probes.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
 #include <cstring>
 #include <fcntl.h>
 #include <iostream>
+#include <linux/filter.h>
 #include <linux/if_ether.h>
+#include <linux/if_packet.h>
 #include <linux/if_tun.h>
 #include <net/if.h>
+#include <net/if_arp.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
-#include <netpacket/packet.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
-bool PacketCapture::init(const std::string &devName) {
+static void fillL4Checksum(std::vector<uint8_t> &packet) {
+  iphdr *ip = reinterpret_cast<iphdr *>(packet.data());
+  size_t ipLen = ip->ihl * 4;
+  size_t totLen = std::min<size_t>(ntohs(ip->tot_len), packet.size());
+  if (totLen <= ipLen)
+    return;
+  uint8_t *l4 = packet.data() + ipLen;
+  size_t l4Len = totLen - ipLen;
+  uint16_t *check = nullptr;
+  if (ip->protocol == IPPROTO_TCP && l4Len >= sizeof(tcphdr))
+    check = &reinterpret_cast<tcphdr *>(l4)->check;
+  else if (ip->protocol == IPPROTO_UDP && l4Len >= sizeof(udphdr))
+    check = &reinterpret_cast<udphdr *>(l4)->check;
+  if (!check)
+    return;
+  *check = 0;
+  *check = l4Checksum(ip->saddr, ip->daddr, ip->protocol, l4, l4Len);
+  if (ip->protocol == IPPROTO_UDP && *check == 0)
+    *check = 0xffff;
+}
+
+static int openRawSocket() {
+  int sock = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
+  if (sock < 0) {
+    perror("socket IPPROTO_RAW");
+    return -1;
+  }
+  int one = 1;
+  setsockopt(sock, IPPROTO_IP, IP_HDRINCL, &one, sizeof(one));
+  return sock;
+}
+
+// fanout 组的 CBPF 程序：返回值（内核再对成员数取模）即目标分片，
+// 取 TCP/UDP 目的端口，与 NATManager 的端口分片规则一致；
+// 非 TCP/UDP 与非首片分片没有端口，统一交给 0 号分片
+static bool attachFanoutProgram(int sock) {
+  static struct sock_filter code[] = {
+      BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9), // 协议
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP, 1, 0),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 5),
+      BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 6), // 分片偏移
+      BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 3, 0),
+      BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0), // X = IP 头长度
+      BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),  // 目的端口
+      BPF_STMT(BPF_RET | BPF_A, 0),
+      BPF_STMT(BPF_RET | BPF_K, 0),
+  };
+  struct sock_fprog prog = {sizeof(code) / sizeof(code[0]), code};
+  return setsockopt(sock, SOL_PACKET, PACKET_FANOUT_DATA, &prog,
+                    sizeof(prog)) == 0;
+}
+
+PacketCapture::~PacketCapture() {
+  for (auto &kv : txPorts_) {
+    if (kv.second.packetFd >= 0)
+      close(kv.second.packetFd);
+    if (kv.second.rawFd >= 0)
+      close(kv.second.rawFd);
+  }
+  for (int fd : {tunFd_, rawFd_, rawTxFd_})
+    if (fd >= 0)
+      close(fd);
+}
+
+void PacketCapture::setNeighborCache(std::shared_ptr<NeighborCache> cache) {
+  neighbors_ = std::move(cache);
+}
+
+bool PacketCapture::init(const std::string &devName,
+                         const std::string &wanIface, size_t queue,
+                         size_t numQueues) {
   tunFd_ = open("/dev/net/tun", O_RDWR);
   if (tunFd_ < 0) {
     perror("open /dev/net/tun");
@@ -21,6 +100,9 @@ bool PacketCapture::init(const std::string &devName) {
 
   struct ifreq ifr {};
   ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+  // 多队列 TUN：同名设备每打开一次增加一个队列，内核按流把报文分到各队列
+  if (numQueues > 1)
+    ifr.ifr_flags |= IFF_MULTI_QUEUE;
   std::strncpy(ifr.ifr_name, devName.c_str(), IFNAMSIZ);
 
   if (ioctl(tunFd_, TUNSETIFF, &ifr) < 0) {
@@ -28,19 +110,24 @@ bool PacketCapture::init(const std::string &devName) {
     close(tunFd_);
     return false;
   }
+  // 非阻塞读：worker 每轮批量读到 EAGAIN 为止
+  fcntl(tunFd_, F_SETFL, fcntl(tunFd_, F_GETFL) | O_NONBLOCK);
 
   // 创建 raw socket 用于回包监听
-  rawFd_ = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_IP));
+  rawFd_ = socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK, htons(ETH_P_IP));
   if (rawFd_ < 0) {
     perror("socket rawFd_");
     return false;
   }
+  // 附带 tpacket_auxdata，用于识别校验和尚未填好的报文
+  int one = 1;
+  setsockopt(rawFd_, SOL_PACKET, PACKET_AUXDATA, &one, sizeof(one));
 
   // 可选绑定网卡
   struct sockaddr_ll sll = {};
   sll.sll_family = AF_PACKET;
   sll.sll_protocol = htons(ETH_P_IP);
-  sll.sll_ifindex = if_nametoindex("wlan0"); // 监听 wlan0
+  sll.sll_ifindex = if_nametoindex(wanIface.c_str()); // 监听 WAN 网卡
   if (sll.sll_ifindex == 0 ||
       bind(rawFd_, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
     perror("bind rawFd_");
@@ -48,8 +135,31 @@ bool PacketCapture::init(const std::string &devName) {
     return false;
   }
 
+  if (numQueues > 1) {
+    // 同一进程的各实例以 pid 为组号加入同一个 fanout 组
+    int fanout = (getpid() & 0xffff) | (PACKET_FANOUT_CBPF << 16);
+    if (setsockopt(rawFd_, SOL_PACKET, PACKET_FANOUT, &fanout,
+                   sizeof(fanout)) < 0 ||
+        !attachFanoutProgram(rawFd_)) {
+      perror("setsockopt PACKET_FANOUT");
+      close(rawFd_);
+      return false;
+    }
+  }
+
+  rawTxFd_ = openRawSocket();
+  if (rawTxFd_ < 0)
+    return false;
+  // 邻居表不可用时仍可工作，只是按路由发包全部交给内核
+  if (!neighbors_) {
+    neighbors_ = std::make_shared<NeighborCache>();
+    if (!neighbors_->start())
+      std::cerr << "[PacketCapture] Neighbor cache disabled" << std::endl;
+  }
+
   ifName_ = devName;
-  std::cout << "[PacketCapture] Created TUN device: " << ifName_ << std::endl;
+  std::cout << "[PacketCapture] Created TUN device: " << ifName_ << " queue "
+            << queue << "/" << numQueues << std::endl;
   return true;
 }
 
@@ -57,77 +167,149 @@ std::optional<std::vector<uint8_t>> PacketCapture::readPacket() {
   uint8_t buffer[2000];
   int len = read(tunFd_, buffer, sizeof(buffer));
   if (len < 0) {
-    perror("read tunFd");
+    if (errno != EAGAIN)
+      perror("read tunFd");
     return std::nullopt;
   }
+  WUTHERING_PROBE1(tun_read, len);
   return std::vector<uint8_t>(buffer, buffer + len);
 }
 
 std::optional<std::vector<uint8_t>> PacketCapture::readRawPacket() {
   uint8_t buffer[2000];
-  int len = recvfrom(rawFd_, buffer, sizeof(buffer), 0, nullptr, nullptr);
+  struct sockaddr_ll from {};
+  alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(tpacket_auxdata))];
+  struct iovec iov = {buffer, sizeof(buffer)};
+  struct msghdr msg {};
+  msg.msg_name = &from;
+  msg.msg_namelen = sizeof(from);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  int len = recvmsg(rawFd_, &msg, 0);
   if (len < 0) {
-    perror("recvfrom rawFd");
+    if (errno != EAGAIN)
+      perror("recvfrom rawFd");
+    return std::nullopt;
+  }
+  // AF_PACKET 也会收到本机从该网卡发出的报文，它们不是回包
+  if (from.sll_pkttype == PACKET_OUTGOING || len < 14 + (int)sizeof(iphdr))
     return std::nullopt;
+  std::vector<uint8_t> packet(buffer + 14, buffer + len); // 跳过以太网头
+
+  // 同机 veth 等启用了校验和卸载的路径上，L4 校验和只含伪首部，需要补全
+  for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+    if (c->cmsg_level != SOL_PACKET || c->cmsg_type != PACKET_AUXDATA)
+      continue;
+    const auto *aux = reinterpret_cast<const tpacket_auxdata *>(CMSG_DATA(c));
+    if (aux->tp_status & TP_STATUS_CSUMNOTREADY)
+      fillL4Checksum(packet);
   }
-  return std::vector<uint8_t>(buffer + 14, buffer + len); // 跳过以太网头
+  WUTHERING_PROBE1(wan_read, packet.size());
+  return packet;
 }
 
 bool PacketCapture::writePacket(const std::vector<uint8_t> &packet) {
   // 使用原始 socket 发包（IP 层发包）
-  int sock = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
-  if (sock < 0) {
-    perror("socket IPPROTO_RAW");
-    return false;
-  }
-  int one = 1;
-  setsockopt(sock, IPPROTO_IP, IP_HDRINCL, &one, sizeof(one));
-
   struct sockaddr_in dst {};
   const iphdr *ip = reinterpret_cast<const iphdr *>(packet.data());
   dst.sin_family = AF_INET;
   dst.sin_addr.s_addr = ip->daddr;
 
-  int sent = sendto(sock, packet.data(), packet.size(), 0,
+  int sent = sendto(rawTxFd_, packet.data(), packet.size(), 0,
                     (struct sockaddr *)&dst, sizeof(dst));
-  close(sock);
   return sent == (int)packet.size();
 }
 
-bool PacketCapture::writeToTun(const std::vector<uint8_t> &packet) {
-  int written = write(tunFd_, packet.data(), packet.size());
-  return written == (int)packet.size();
+bool PacketCapture::writeToTun(const uint8_t *data, size_t len) {
+  int written = write(tunFd_, data, len);
+  return written == (int)len;
 }
 
-bool PacketCapture::sendViaInterface(const std::vector<uint8_t> &packet,
-                                     const std::string &gateway,
-                                     const std::string &iface) {
-  int sock = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
-  if (sock < 0) {
-    perror("socket");
-    return false;
-  }
-
-  int one = 1;
-  setsockopt(sock, IPPROTO_IP, IP_HDRINCL, &one, sizeof(one));
+PacketCapture::TxPort *PacketCapture::txPort(const std::string &iface) {
+  auto it = txPorts_.find(iface);
+  if (it != txPorts_.end())
+    return &it->second;
 
+  TxPort port;
+  port.ifindex = if_nametoindex(iface.c_str());
+  if (port.ifindex == 0) {
+    perror("if_nametoindex");
+    return nullptr;
+  }
+  port.rawFd = openRawSocket();
+  if (port.rawFd < 0)
+    return nullptr;
   // 绑定到指定接口
-  if (setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, iface.c_str(),
+  if (setsockopt(port.rawFd, SOL_SOCKET, SO_BINDTODEVICE, iface.c_str(),
                  iface.length()) < 0) {
     perror("setsockopt BINDTODEVICE");
-    close(sock);
-    return false;
+    close(port.rawFd);
+    return nullptr;
   }
 
-  struct sockaddr_in dst {};
+  struct ifreq ifr {};
+  std::strncpy(ifr.ifr_name, iface.c_str(), IFNAMSIZ - 1);
+  if (ioctl(port.rawFd, SIOCGIFADDR, &ifr) == 0)
+    port.addr =
+        reinterpret_cast<sockaddr_in *>(&ifr.ifr_addr)->sin_addr.s_addr;
+  // 只有带 IPv4 地址的以太网接口才能自己做 ARP
+  if (port.addr != 0 && ioctl(port.rawFd, SIOCGIFHWADDR, &ifr) == 0 &&
+      ifr.ifr_hwaddr.sa_family == ARPHRD_ETHER) {
+    // 协议号为 0 的 AF_PACKET 只发不收
+    port.packetFd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (port.packetFd >= 0) {
+      port.ethernet = true;
+      neighbors_->addInterface(
+          port.ifindex, reinterpret_cast<uint8_t *>(ifr.ifr_hwaddr.sa_data),
+          port.addr);
+    }
+  }
+  std::cout << "[PacketCapture] TX port " << iface
+            << (port.ethernet ? " (ethernet)" : " (kernel)") << std::endl;
+  return &txPorts_.emplace(iface, port).first->second;
+}
+
+bool PacketCapture::sendViaInterface(const std::vector<uint8_t> &packet,
+                                     const RouteHop &hop) {
+  TxPort *port = txPort(*hop.iface);
+  if (!port)
+    return false;
+
   const struct iphdr *ip =
       reinterpret_cast<const struct iphdr *>(packet.data());
-  dst.sin_family = AF_INET;
-  dst.sin_addr.s_addr = ip->daddr; // 直接发送到目标 IP 即可
+  // 网关为空、0.0.0.0 或本接口地址时目的地址直连
+  uint32_t nextHop = ip->daddr;
+  uint32_t gw = hop.gateway;
+  if (gw != 0 && gw != INADDR_NONE && gw != port->addr)
+    nextHop = gw;
+
+  NeighborCache::EthHeader eth;
+  if (port->ethernet &&
+      neighbors_->lookup(neighborLocal_, port->ifindex, nextHop, eth)) {
+    struct sockaddr_ll sll {};
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_IP);
+    sll.sll_ifindex = port->ifindex;
+    struct iovec iov[2] = {{eth.data(), eth.size()},
+                           {const_cast<uint8_t *>(packet.data()),
+                            packet.size()}};
+    struct msghdr msg {};
+    msg.msg_name = &sll;
+    msg.msg_namelen = sizeof(sll);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    ssize_t sent = sendmsg(port->packetFd, &msg, 0);
+    return sent == ssize_t(eth.size() + packet.size());
+  }
 
-  int sent = sendto(sock, packet.data(), packet.size(), 0,
+  // 邻居尚未解析：交给内核路由，后台解析完成后后续报文走快路径
+  struct sockaddr_in dst {};
+  dst.sin_family = AF_INET;
+  dst.sin_addr.s_addr = ip->daddr;
+  int sent = sendto(port->rawFd, packet.data(), packet.size(), 0,
                     (struct sockaddr *)&dst, sizeof(dst));
-  close(sock);
   return sent == (int)packet.size();
 }
 
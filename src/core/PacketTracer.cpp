@@ -0,0 +1,147 @@
+#include "core/PacketTracer.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+struct Ring {
+  std::vector<PacketTracer::Record> records;
+  size_t next = 0;
+  size_t count = 0;
+  uint32_t counter = 0;
+  uint32_t seenGeneration = 0;
+};
+
+static thread_local Ring ring;
+static std::string outputDir = ".";
+
+static std::string addressString(uint32_t addr) {
+  char buf[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &addr, buf, sizeof(buf));
+  return buf;
+}
+
+// 以 nth_element 取分位数，samples 会被重排
+static uint64_t percentile(std::vector<uint64_t> &samples, double p) {
+  size_t idx = std::min(samples.size() - 1, size_t(p * samples.size()));
+  std::nth_element(samples.begin(), samples.begin() + idx, samples.end());
+  return samples[idx];
+}
+
+static void logPercentiles(const std::string &name, const char *stage,
+                           std::vector<uint64_t> &samples) {
+  if (samples.empty())
+    return;
+  uint64_t p50 = percentile(samples, 0.50);
+  uint64_t p99 = percentile(samples, 0.99);
+  uint64_t max = *std::max_element(samples.begin(), samples.end());
+  // 各 worker 的导出线程可能同时打印，整行一次写出
+  std::ostringstream line;
+  line << "[Trace] " << name << " " << stage << ": " << samples.size()
+       << " samples, p50 " << p50 << " ns, p99 " << p99 << " ns, max " << max
+       << " ns\n";
+  std::cerr << line.str();
+}
+
+void PacketTracer::setSampleRate(uint32_t every) {
+  sampleEvery_.store(every, std::memory_order_relaxed);
+}
+
+void PacketTracer::setOutputDir(const std::string &dir) { outputDir = dir; }
+
+void PacketTracer::requestDump() {
+  dumpGeneration_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PacketTracer::poll(const std::string &name, bool wait) {
+  uint32_t generation = dumpGeneration_.load(std::memory_order_relaxed);
+  if (generation == ring.seenGeneration)
+    return;
+  ring.seenGeneration = generation;
+  if (ring.count == 0) {
+    std::cerr << "[Trace] " << name << ": no samples\n";
+    return;
+  }
+
+  // 按时间先后取出快照，满环约 300 KB 的拷贝；格式化、写文件与求分位数
+  // 交给后台线程，worker 不因导出而停止转发
+  std::vector<Record> records;
+  records.reserve(ring.count);
+  size_t first = (ring.next + kRingSize - ring.count) % kRingSize;
+  for (size_t i = 0; i < ring.count; ++i)
+    records.push_back(ring.records[(first + i) % kRingSize]);
+  if (wait)
+    dump(name, records);
+  else
+    std::thread(dump, name, std::move(records)).detach();
+}
+
+uint64_t PacketTracer::nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+PacketTracer::Record *PacketTracer::begin(uint32_t every,
+                                          uint64_t capturedNs) {
+  if (++ring.counter < every)
+    return nullptr;
+  ring.counter = 0;
+  if (ring.records.empty())
+    ring.records.resize(kRingSize);
+  Record &record = ring.records[ring.next];
+  ring.next = (ring.next + 1) % kRingSize;
+  ring.count = std::min(ring.count + 1, kRingSize);
+  record = Record{};
+  record.capturedNs = capturedNs;
+  record.startNs = nowNs();
+  return &record;
+}
+
+void PacketTracer::dump(const std::string &name,
+                        const std::vector<Record> &records) {
+  std::string path = outputDir + "/trace-" + name + ".txt";
+  std::ofstream out(path, std::ios::trunc);
+  if (!out) {
+    std::cerr << "[Trace] Cannot write " << path << "\n";
+    return;
+  }
+
+  // 按时间先后输出，每行一个报文：各阶段为该阶段自身的耗时
+  const char *const *names = nullptr;
+  std::vector<std::vector<uint64_t>> perStage(kMaxStages);
+  std::vector<uint64_t> queued, total;
+  for (const Record &r : records) {
+    if (!r.names || r.stages == 0)
+      continue;
+    names = r.names;
+    out << addressString(r.srcIp) << " " << addressString(r.dstIp) << " "
+        << int(r.protocol);
+    if (r.capturedNs && r.capturedNs <= r.startNs) {
+      out << " queue=" << r.startNs - r.capturedNs;
+      queued.push_back(r.startNs - r.capturedNs);
+    }
+    uint32_t prev = 0;
+    for (size_t s = 0; s < r.stages; ++s) {
+      out << " " << r.names[s] << "=" << r.stageNs[s] - prev;
+      perStage[s].push_back(r.stageNs[s] - prev);
+      prev = r.stageNs[s];
+    }
+    out << " total=" << prev << "\n";
+    total.push_back(prev);
+  }
+  std::ostringstream line;
+  line << "[Trace] " << name << ": " << records.size()
+       << " samples written to " << path << "\n";
+  std::cerr << line.str();
+
+  // 分位数定位尾延迟集中在哪个阶段
+  logPercentiles(name, "queue", queued);
+  for (size_t s = 0; s < kMaxStages && !perStage[s].empty(); ++s)
+    logPercentiles(name, names[s], perStage[s]);
+  logPercentiles(name, "total", total);
+}
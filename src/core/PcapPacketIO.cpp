@@ -0,0 +1,147 @@
+#include "core/PcapPacketIO.h"
+#include <iostream>
+#include <sys/time.h>
+
+static constexpr uint32_t kMagicUsec = 0xa1b2c3d4;
+static constexpr uint32_t kMagicNsec = 0xa1b23c4d;
+static constexpr uint32_t kLinkEthernet = 1;
+static constexpr uint32_t kLinkRaw = 101;
+static constexpr uint32_t kLinkLinuxSll = 113;
+static constexpr uint32_t kLinkIpv4 = 228;
+static constexpr uint32_t kMaxSnapLen = 262144;
+
+struct PcapFileHeader {
+  uint32_t magic;
+  uint16_t versionMajor;
+  uint16_t versionMinor;
+  int32_t thisZone;
+  uint32_t sigFigs;
+  uint32_t snapLen;
+  uint32_t linkType;
+};
+
+struct PcapRecordHeader {
+  uint32_t tsSec;
+  uint32_t tsFrac;
+  uint32_t capLen;
+  uint32_t origLen;
+};
+
+uint32_t PcapPacketIO::field(uint32_t v) const {
+  return swapped_ ? __builtin_bswap32(v) : v;
+}
+
+bool PcapPacketIO::open(const std::string &inPath,
+                        const std::string &outPath) {
+  in_.open(inPath, std::ios::binary);
+  if (!in_) {
+    std::cerr << "[Pcap] Cannot open " << inPath << "\n";
+    return false;
+  }
+
+  PcapFileHeader hdr{};
+  if (!in_.read(reinterpret_cast<char *>(&hdr), sizeof(hdr))) {
+    std::cerr << "[Pcap] Truncated header in " << inPath << "\n";
+    return false;
+  }
+  if (hdr.magic == kMagicUsec || hdr.magic == kMagicNsec) {
+    swapped_ = false;
+  } else if (__builtin_bswap32(hdr.magic) == kMagicUsec ||
+             __builtin_bswap32(hdr.magic) == kMagicNsec) {
+    swapped_ = true;
+  } else {
+    std::cerr << "[Pcap] Not a pcap file: " << inPath << "\n";
+    return false;
+  }
+  linkType_ = field(hdr.linkType);
+  if (linkType_ != kLinkEthernet && linkType_ != kLinkRaw &&
+      linkType_ != kLinkLinuxSll && linkType_ != kLinkIpv4) {
+    std::cerr << "[Pcap] Unsupported link type " << linkType_ << "\n";
+    return false;
+  }
+
+  if (!outPath.empty()) {
+    out_.open(outPath, std::ios::binary | std::ios::trunc);
+    if (!out_) {
+      std::cerr << "[Pcap] Cannot create " << outPath << "\n";
+      return false;
+    }
+    PcapFileHeader outHdr{kMagicUsec, 2, 4, 0, 0, kMaxSnapLen, kLinkRaw};
+    out_.write(reinterpret_cast<const char *>(&outHdr), sizeof(outHdr));
+  }
+
+  std::cout << "[Pcap] Replaying " << inPath << " (link type " << linkType_
+            << ")\n";
+  return true;
+}
+
+std::optional<std::vector<uint8_t>> PcapPacketIO::readPacket() {
+  PcapRecordHeader rec;
+  std::vector<uint8_t> frame;
+  while (in_.read(reinterpret_cast<char *>(&rec), sizeof(rec))) {
+    uint32_t capLen = field(rec.capLen);
+    if (capLen > kMaxSnapLen) {
+      std::cerr << "[Pcap] Corrupt record, stop reading\n";
+      return std::nullopt;
+    }
+    frame.resize(capLen);
+    if (!in_.read(reinterpret_cast<char *>(frame.data()), capLen))
+      return std::nullopt;
+
+    // 剥去链路层头，只交出 IPv4 报文
+    size_t off = 0;
+    uint16_t etherType = 0x0800;
+    if (linkType_ == kLinkEthernet) {
+      off = 14;
+      if (capLen >= 14)
+        etherType = (frame[12] << 8) | frame[13];
+      if (etherType == 0x8100 && capLen >= 18) { // 802.1Q
+        etherType = (frame[16] << 8) | frame[17];
+        off = 18;
+      }
+    } else if (linkType_ == kLinkLinuxSll) {
+      off = 16;
+      if (capLen >= 16)
+        etherType = (frame[14] << 8) | frame[15];
+    }
+    if (capLen < off + 20 || etherType != 0x0800 || (frame[off] >> 4) != 4)
+      continue;
+
+    ++readCount_;
+    frame.erase(frame.begin(), frame.begin() + off);
+    return frame;
+  }
+  return std::nullopt;
+}
+
+std::optional<std::vector<uint8_t>> PcapPacketIO::readRawPacket() {
+  // 抓包文件只提供 LAN 侧输入
+  return std::nullopt;
+}
+
+bool PcapPacketIO::record(const uint8_t *data, size_t len) {
+  ++writeCount_;
+  if (!out_.is_open())
+    return true;
+  timeval tv;
+  gettimeofday(&tv, nullptr);
+  PcapRecordHeader rec{static_cast<uint32_t>(tv.tv_sec),
+                       static_cast<uint32_t>(tv.tv_usec),
+                       static_cast<uint32_t>(len), static_cast<uint32_t>(len)};
+  out_.write(reinterpret_cast<const char *>(&rec), sizeof(rec));
+  out_.write(reinterpret_cast<const char *>(data), len);
+  return bool(out_);
+}
+
+bool PcapPacketIO::writePacket(const std::vector<uint8_t> &packet) {
+  return record(packet.data(), packet.size());
+}
+
+bool PcapPacketIO::writeToTun(const uint8_t *data, size_t len) {
+  return record(data, len);
+}
+
+bool PcapPacketIO::sendViaInterface(const std::vector<uint8_t> &packet,
+                                    const RouteHop &) {
+  return record(packet.data(), packet.size());
+}
@@ -0,0 +1,33 @@
+#include "core/PipelineStages.h"
+#include "relay/UdpRelay.h"
+#include "relay/UserTcpStack.h"
+#include <arpa/inet.h>
+
+std::ostream &operator<<(std::ostream &os, Ipv4Addr ip) {
+  // 流状态异常（如压测时屏蔽了 stdout）时跳过格式化
+  if (!os)
+    return os;
+  char buf[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &ip.addr, buf, sizeof(buf));
+  return os << buf;
+}
+
+namespace stage {
+
+bool Proxy::operator()(PacketContext &ctx, PipelineStats &stats) {
+  if (!ctx.toWan)
+    return true;
+  if (tcpStack_ && ctx.protocol == IPPROTO_TCP) {
+    tcpStack_->handlePacket(ctx.packet);
+    ++stats.proxied;
+    return false;
+  }
+  if (udpRelay_ && ctx.protocol == IPPROTO_UDP &&
+      udpRelay_->handlePacket(std::move(ctx.packet))) {
+    ++stats.proxied;
+    return false;
+  }
+  return true;
+}
+
+} // namespace stage
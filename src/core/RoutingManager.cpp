@@ -14,3 +14,22 @@ RoutingManager::lookupRoute(const std::string &dstIp) {
   }
   return std::nullopt;
 }
+
+std::optional<RouteEntry> RoutingManager::lookupRoute(const std::string &dstIp,
+                                                      uint32_t flowHash) {
+  for (const auto &provider : providers_) {
+    auto result = provider->lookup(dstIp, flowHash);
+    if (result.has_value()) {
+      return result;
+    }
+  }
+  return std::nullopt;
+}
+
+bool RoutingManager::resolve(uint32_t dst, uint32_t flowHash, RouteHop &hop) {
+  for (const auto &provider : providers_) {
+    if (provider->resolve(dst, flowHash, hop))
+      return true;
+  }
+  return false;
+}
@@ -0,0 +1,241 @@
+#include "core/RuleClassifier.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdlib>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CLASSIFIER_X86 1
+#endif
+
+using MatchFn = size_t (*)(const RuleColumns &, const ClassifierKey &);
+
+static size_t matchScalar(const RuleColumns &c, const ClassifierKey &k) {
+  uint32_t anyPort = k.hasPorts ? 0 : 1;
+  for (size_t i = 0; i < c.count; ++i) {
+    // 各条件按位与，循环体内除命中判断外没有分支
+    uint32_t hit = ((k.srcIp & c.srcMask[i]) == c.srcIp[i]) &
+                   ((k.dstIp & c.dstMask[i]) == c.dstIp[i]) &
+                   ((k.proto & c.protoMask[i]) == c.proto[i]) &
+                   (anyPort | ((c.srcPortLo[i] <= k.srcPort) &
+                               (k.srcPort <= c.srcPortHi[i]) &
+                               (c.dstPortLo[i] <= k.dstPort) &
+                               (k.dstPort <= c.dstPortHi[i])));
+    if (hit)
+      return i;
+  }
+  return RuleClassifier::kNoMatch;
+}
+
+#ifdef CLASSIFIER_X86
+// lambda 不继承 target 属性，按列加载用宏展开
+#define LOAD(col) _mm256_loadu_si256(reinterpret_cast<const __m256i *>(col + i))
+__attribute__((target("avx2"))) static size_t
+matchAvx2(const RuleColumns &c, const ClassifierKey &k) {
+  const __m256i srcIp = _mm256_set1_epi32(k.srcIp);
+  const __m256i dstIp = _mm256_set1_epi32(k.dstIp);
+  const __m256i proto = _mm256_set1_epi32(k.proto);
+  // 端口不超过 16 位，有符号比较即可
+  const __m256i srcPort = _mm256_set1_epi32(k.srcPort);
+  const __m256i dstPort = _mm256_set1_epi32(k.dstPort);
+  const __m256i anyPort = _mm256_set1_epi32(k.hasPorts ? 0 : -1);
+
+  for (size_t i = 0; i < c.count; i += 8) {
+    __m256i m = _mm256_cmpeq_epi32(_mm256_and_si256(srcIp, LOAD(c.srcMask)),
+                                   LOAD(c.srcIp));
+    m = _mm256_and_si256(
+        m, _mm256_cmpeq_epi32(_mm256_and_si256(dstIp, LOAD(c.dstMask)),
+                              LOAD(c.dstIp)));
+    m = _mm256_and_si256(
+        m, _mm256_cmpeq_epi32(_mm256_and_si256(proto, LOAD(c.protoMask)),
+                              LOAD(c.proto)));
+    // 端口越界：lo > port 或 port > hi
+    __m256i out = _mm256_cmpgt_epi32(LOAD(c.srcPortLo), srcPort);
+    out = _mm256_or_si256(out, _mm256_cmpgt_epi32(srcPort, LOAD(c.srcPortHi)));
+    out = _mm256_or_si256(out, _mm256_cmpgt_epi32(LOAD(c.dstPortLo), dstPort));
+    out = _mm256_or_si256(out, _mm256_cmpgt_epi32(dstPort, LOAD(c.dstPortHi)));
+    m = _mm256_andnot_si256(_mm256_andnot_si256(anyPort, out), m);
+
+    unsigned bits = _mm256_movemask_ps(_mm256_castsi256_ps(m));
+    if (bits)
+      return i + __builtin_ctz(bits);
+  }
+  return RuleClassifier::kNoMatch;
+}
+
+#undef LOAD
+
+#define LOAD(col) _mm512_loadu_si512(col + i)
+__attribute__((target("avx512f"))) static size_t
+matchAvx512(const RuleColumns &c, const ClassifierKey &k) {
+  const __m512i srcIp = _mm512_set1_epi32(k.srcIp);
+  const __m512i dstIp = _mm512_set1_epi32(k.dstIp);
+  const __m512i proto = _mm512_set1_epi32(k.proto);
+  const __m512i srcPort = _mm512_set1_epi32(k.srcPort);
+  const __m512i dstPort = _mm512_set1_epi32(k.dstPort);
+  const __mmask16 anyPort = k.hasPorts ? 0 : 0xffff;
+
+  for (size_t i = 0; i < c.count; i += 16) {
+    __mmask16 m = _mm512_cmpeq_epi32_mask(
+        _mm512_and_si512(srcIp, LOAD(c.srcMask)), LOAD(c.srcIp));
+    m = _mm512_mask_cmpeq_epi32_mask(
+        m, _mm512_and_si512(dstIp, LOAD(c.dstMask)), LOAD(c.dstIp));
+    m = _mm512_mask_cmpeq_epi32_mask(
+        m, _mm512_and_si512(proto, LOAD(c.protoMask)), LOAD(c.proto));
+    __mmask16 ports = _mm512_cmple_epu32_mask(LOAD(c.srcPortLo), srcPort);
+    ports = _mm512_mask_cmple_epu32_mask(ports, srcPort, LOAD(c.srcPortHi));
+    ports = _mm512_mask_cmple_epu32_mask(ports, LOAD(c.dstPortLo), dstPort);
+    ports = _mm512_mask_cmple_epu32_mask(ports, dstPort, LOAD(c.dstPortHi));
+    m &= ports | anyPort;
+    if (m)
+      return i + __builtin_ctz(m);
+  }
+  return RuleClassifier::kNoMatch;
+}
+#undef LOAD
+#endif
+
+static MatchFn selectKernel(const char **name) {
+#ifdef CLASSIFIER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    *name = "avx512";
+    return matchAvx512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    *name = "avx2";
+    return matchAvx2;
+  }
+#endif
+  *name = "scalar";
+  return matchScalar;
+}
+
+static const char *gKernelName = nullptr;
+static const MatchFn gMatch = selectKernel(&gKernelName);
+
+const char *RuleClassifier::kernelName() { return gKernelName; }
+
+void RuleClassifier::build(const std::vector<ClassifierRule> &rules) {
+  size_t padded = (rules.size() + kLanes - 1) / kLanes * kLanes;
+  storage_.assign(padded * RuleColumns::kNumColumns, 0);
+
+  uint32_t *col[RuleColumns::kNumColumns];
+  for (size_t c = 0; c < RuleColumns::kNumColumns; ++c)
+    col[c] = storage_.data() + c * padded;
+  for (size_t i = 0; i < padded; ++i) {
+    if (i >= rules.size()) {
+      // 填充行：协议比较永远不等
+      col[8][i] = ~uint32_t(0);
+      col[9][i] = ~uint32_t(0);
+      continue;
+    }
+    const ClassifierRule &r = rules[i];
+    col[0][i] = r.srcIp & r.srcMask;
+    col[1][i] = r.srcMask;
+    col[2][i] = r.dstIp & r.dstMask;
+    col[3][i] = r.dstMask;
+    col[4][i] = r.srcPortLo;
+    col[5][i] = r.srcPortHi;
+    col[6][i] = r.dstPortLo;
+    col[7][i] = r.dstPortHi;
+    col[8][i] = r.proto;
+    col[9][i] = r.proto ? 0xff : 0;
+  }
+  columns_ = RuleColumns{col[0], col[1], col[2], col[3], col[4],
+                         col[5], col[6], col[7], col[8], col[9],
+                         rules.size(), padded};
+}
+
+void RuleClassifier::attach(const RuleColumns &columns) {
+  storage_.clear();
+  columns_ = columns;
+}
+
+size_t RuleClassifier::match(const ClassifierKey &key) const {
+  if (columns_.count == 0)
+    return kNoMatch;
+  return gMatch(columns_, key);
+}
+
+ClassifierKey RuleClassifier::keyOf(const std::vector<uint8_t> &packet) {
+  ClassifierKey key;
+  if (packet.size() < sizeof(iphdr))
+    return key;
+  const iphdr *ip = reinterpret_cast<const iphdr *>(packet.data());
+  size_t ipLen = ip->ihl * 4;
+  key.srcIp = ip->saddr;
+  key.dstIp = ip->daddr;
+  key.proto = ip->protocol;
+  if (ip->protocol == IPPROTO_TCP && packet.size() >= ipLen + sizeof(tcphdr)) {
+    const tcphdr *tcp =
+        reinterpret_cast<const tcphdr *>(packet.data() + ipLen);
+    key.srcPort = ntohs(tcp->source);
+    key.dstPort = ntohs(tcp->dest);
+    key.hasPorts = true;
+  } else if (ip->protocol == IPPROTO_UDP &&
+             packet.size() >= ipLen + sizeof(udphdr)) {
+    const udphdr *udp =
+        reinterpret_cast<const udphdr *>(packet.data() + ipLen);
+    key.srcPort = ntohs(udp->source);
+    key.dstPort = ntohs(udp->dest);
+    key.hasPorts = true;
+  }
+  return key;
+}
+
+// 十进制协议号 1..255，须整串都是数字
+static bool parseProtocolNumber(const std::string &text, uint8_t &proto) {
+  char *end = nullptr;
+  errno = 0;
+  long value = std::strtol(text.c_str(), &end, 10);
+  if (text.empty() || *end != '\0' || errno != 0 || value < 1 || value > 255)
+    return false;
+  proto = uint8_t(value);
+  return true;
+}
+
+bool RuleClassifier::parseAddress(const std::string &text, uint32_t &addr,
+                                  uint32_t &mask) {
+  if (text == "ANY") {
+    addr = mask = 0;
+    return true;
+  }
+  std::string ip = text;
+  int prefixLen = 32;
+  size_t slash = text.find('/');
+  if (slash != std::string::npos) {
+    ip = text.substr(0, slash);
+    // 整个后缀都须是数字："/"、"/abc" 与 "/24x" 都不能当作 /0 接受
+    const char *begin = text.c_str() + slash + 1;
+    char *end = nullptr;
+    errno = 0;
+    long value = std::strtol(begin, &end, 10);
+    if (end == begin || *end != '\0' || errno != 0 || value < 0 || value > 32)
+      return false;
+    prefixLen = int(value);
+  }
+  in_addr a;
+  if (!inet_aton(ip.c_str(), &a))
+    return false;
+  mask = prefixLen == 0 ? 0 : htonl(~uint32_t(0) << (32 - prefixLen));
+  addr = a.s_addr & mask;
+  return true;
+}
+
+bool RuleClassifier::parseProtocol(const std::string &text, uint8_t &proto) {
+  if (text == "ANY")
+    proto = 0;
+  else if (text == "TCP")
+    proto = IPPROTO_TCP;
+  else if (text == "UDP")
+    proto = IPPROTO_UDP;
+  else if (text == "ICMP")
+    proto = IPPROTO_ICMP;
+  else
+    return parseProtocolNumber(text, proto);
+  return true;
+}
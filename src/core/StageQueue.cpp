@@ -0,0 +1,37 @@
+#include "core/StageQueue.h"
+#include <utility>
+
+StageQueue::StageQueue(size_t capacity) {
+  for (auto &ring : rings_)
+    ring.slots.resize(capacity ? capacity : 1);
+}
+
+bool StageQueue::push(Priority priority, std::vector<uint8_t> &&packet,
+                      bool inbound, uint64_t capturedNs) {
+  Ring &ring = rings_[priority];
+  if (ring.size == ring.slots.size()) {
+    ++ring.dropped;
+    return false;
+  }
+  Item &slot = ring.slots[(ring.head + ring.size) % ring.slots.size()];
+  slot.packet = std::move(packet);
+  slot.inbound = inbound;
+  slot.capturedNs = capturedNs;
+  ++ring.size;
+  ++queued_;
+  return true;
+}
+
+bool StageQueue::pop(Item &out) {
+  for (auto &ring : rings_) {
+    if (ring.size == 0)
+      continue;
+    // 交换而不是移动，槽位保留 out 原有的缓冲区供下次入队复用
+    std::swap(out, ring.slots[ring.head]);
+    ring.head = (ring.head + 1) % ring.slots.size();
+    --ring.size;
+    --queued_;
+    return true;
+  }
+  return false;
+}
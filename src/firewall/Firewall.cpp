@@ -1,25 +1,16 @@
 #include "firewall/Firewall.h"
-#include <arpa/inet.h>
 #include <fstream>
 #include <iostream>
-#include <netinet/ip.h>
-#include <netinet/tcp.h>
-#include <netinet/udp.h>
 #include <sstream>
 
-static bool ipMatch(const std::string &ruleIp, uint32_t actual) {
-  if (ruleIp == "ANY")
-    return true;
-  in_addr ruleAddr;
-  inet_aton(ruleIp.c_str(), &ruleAddr);
-  return ruleAddr.s_addr == actual;
-}
-
 bool Firewall::loadRules(const std::string &path) {
   std::ifstream in(path);
   if (!in)
     return false;
 
+  std::vector<ClassifierRule> parsed;
+  actions_.clear();
+  bool ok = true;
   std::string line;
   while (std::getline(in, line)) {
     if (line.empty() || line[0] == '#')
@@ -27,68 +18,78 @@ bool Firewall::loadRules(const std::string &path) {
 
     std::istringstream ss(line);
     FirewallRule rule;
-    std::string srcPortStr, dstPortStr, actionStr;
-
-    ss >> rule.srcIp >> rule.dstIp >> srcPortStr >> dstPortStr >>
-        rule.protocol >> actionStr;
+    unsigned srcPort, dstPort;
+    std::string actionStr;
 
-    rule.srcPort = static_cast<uint16_t>(std::stoi(srcPortStr));
-    rule.dstPort = static_cast<uint16_t>(std::stoi(dstPortStr));
+    if (!(ss >> rule.srcIp >> rule.dstIp >> srcPort >> dstPort >>
+          rule.protocol >> actionStr) ||
+        srcPort > 65535 || dstPort > 65535) {
+      std::cerr << "[Firewall] Malformed rule: " << line << "\n";
+      ok = false;
+      continue;
+    }
+    rule.srcPort = srcPort;
+    rule.dstPort = dstPort;
     rule.action =
         (actionStr == "ALLOW") ? FirewallRule::ALLOW : FirewallRule::DENY;
 
-    rules_.push_back(rule);
+    ClassifierRule c;
+    if (!RuleClassifier::parseAddress(rule.srcIp, c.srcIp, c.srcMask) ||
+        !RuleClassifier::parseAddress(rule.dstIp, c.dstIp, c.dstMask)) {
+      std::cerr << "[Firewall] Bad address in rule: " << line << "\n";
+      ok = false;
+      continue;
+    }
+    if (!RuleClassifier::parseProtocol(rule.protocol, c.proto)) {
+      std::cerr << "[Firewall] Bad protocol in rule: " << line << "\n";
+      ok = false;
+      continue;
+    }
+    // 端口 0 表示任意端口
+    if (rule.srcPort != 0)
+      c.srcPortLo = c.srcPortHi = rule.srcPort;
+    if (rule.dstPort != 0)
+      c.dstPortLo = c.dstPortHi = rule.dstPort;
+
+    actions_.push_back(rule.action);
+    parsed.push_back(c);
   }
+  classifier_.build(parsed);
 
-  std::cout << "[Firewall] Loaded " << rules_.size() << " rules.\n";
-  return true;
+  std::cout << "[Firewall] Loaded " << actions_.size() << " rules ("
+            << RuleClassifier::kernelName() << ").\n";
+  return ok;
 }
 
-bool Firewall::match(const FirewallRule &rule,
-                     const std::vector<uint8_t> &packet) {
-  const iphdr *ip = reinterpret_cast<const iphdr *>(packet.data());
-
-  if (!ipMatch(rule.srcIp, ip->saddr))
-    return false;
-  if (!ipMatch(rule.dstIp, ip->daddr))
+bool Firewall::loadSnapshot(const ConfigSnapshot &snapshot) {
+  RuleColumns columns;
+  uint32_t count;
+  size_t size;
+  const void *actions =
+      snapshot.section(SnapshotSection::FirewallActions, count, size);
+  if (!snapshot.columns(SnapshotSection::FirewallRules, columns) ||
+      !actions || count != columns.count || size != count) {
+    std::cerr << "[Firewall] Snapshot has no valid firewall rules\n";
     return false;
-
-  // Check protocol
-  uint8_t protocol = ip->protocol;
-  if (rule.protocol != "ANY") {
-    if ((rule.protocol == "TCP" && protocol != IPPROTO_TCP) ||
-        (rule.protocol == "UDP" && protocol != IPPROTO_UDP)) {
-      return false;
-    }
-  }
-
-  // Check ports if TCP/UDP
-  if (protocol == IPPROTO_TCP &&
-      packet.size() >= ip->ihl * 4 + sizeof(tcphdr)) {
-    const tcphdr *tcp =
-        reinterpret_cast<const tcphdr *>(packet.data() + ip->ihl * 4);
-    if (rule.srcPort != 0 && ntohs(tcp->source) != rule.srcPort)
-      return false;
-    if (rule.dstPort != 0 && ntohs(tcp->dest) != rule.dstPort)
-      return false;
-  } else if (protocol == IPPROTO_UDP &&
-             packet.size() >= ip->ihl * 4 + sizeof(udphdr)) {
-    const udphdr *udp =
-        reinterpret_cast<const udphdr *>(packet.data() + ip->ihl * 4);
-    if (rule.srcPort != 0 && ntohs(udp->source) != rule.srcPort)
-      return false;
-    if (rule.dstPort != 0 && ntohs(udp->dest) != rule.dstPort)
-      return false;
   }
-
+  classifier_.attach(columns);
+  const uint8_t *p = static_cast<const uint8_t *>(actions);
+  actions_.assign(p, p + count);
+  std::cout << "[Firewall] Loaded " << count << " rules from snapshot ("
+            << RuleClassifier::kernelName() << ").\n";
   return true;
 }
 
+void Firewall::saveSnapshot(ConfigSnapshotWriter &writer) const {
+  writer.addColumns(SnapshotSection::FirewallRules, classifier_.columns());
+  writer.add(SnapshotSection::FirewallActions, actions_.size(),
+             actions_.data(), actions_.size());
+}
+
 bool Firewall::allow(const std::vector<uint8_t> &packet) {
-  for (const auto &rule : rules_) {
-    if (match(rule, packet)) {
-      return rule.action == FirewallRule::ALLOW;
-    }
+  size_t idx = classifier_.match(RuleClassifier::keyOf(packet));
+  if (idx != RuleClassifier::kNoMatch) {
+    return actions_[idx] == FirewallRule::ALLOW;
   }
   return true; // 默认允许
 }
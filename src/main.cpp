@@ -1,126 +1,420 @@
 #include "QoS/QoSManager.h"
+#include "core/ConfigSnapshot.h"
+#include "core/ForwardingPipeline.h"
+#include "core/HugePageArena.h"
+#include "core/MemoryPacketIO.h"
 #include "core/PacketCapture.h"
+#include "core/PacketTracer.h"
+#include "core/PcapPacketIO.h"
 #include "core/RoutingManager.h"
+#include "core/StageQueue.h"
 #include "firewall/Firewall.h"
 #include "nat/NATManager.h"
+#include "nat/NatOffload.h"
+#include "relay/RelayManager.h"
+#include "relay/Socks5Pool.h"
+#include "relay/UdpRelay.h"
+#include "relay/UserTcpStack.h"
 #include "routing/DynamicRouteProvider.h"
 #include "routing/StaticRouteProvider.h"
 
-#include <arpa/inet.h>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
-#include <netinet/ip.h>
-#include <netinet/tcp.h>
 #include <poll.h>
+#include <pthread.h>
 #include <thread>
+#include <vector>
 
-std::string extractDstIp(const std::vector<uint8_t> &packet) {
-  const struct iphdr *iph =
-      reinterpret_cast<const struct iphdr *>(packet.data());
-  in_addr dst;
-  dst.s_addr = iph->daddr;
-  return std::string(inet_ntoa(dst));
+static void usage(const char *prog) {
+  std::cerr << "Usage: " << prog
+            << " [--tun <dev>] [--wan <iface>] [--config-dir <dir>] [--proxy]"
+               " [--quiet]\n       [--workers <n> [--pin-cpus]] [--offload]"
+               " [--state-dir <dir>] [--snapshot <file>]\n"
+               "       [--new-flow-limit <n>] [--trace-sample <n> [--trace-dir"
+               " <dir>]]\n"
+               "       [--pcap <in.pcap> [--pcap-out <out.pcap>]"
+               " [--rounds <n>]]\n";
 }
 
-std::string extractSrcIp(const std::vector<uint8_t> &packet) {
-  const struct iphdr *iph =
-      reinterpret_cast<const struct iphdr *>(packet.data());
-  in_addr src;
-  src.s_addr = iph->saddr;
-  return std::string(inet_ntoa(src));
+static void onTraceSignal(int) { PacketTracer::requestDump(); }
+
+// 每个 worker 独占一个 TUN 队列、一个 fanout 成员与一个 NAT 分片；
+// NAT/QoS 表从本 worker 的大页内存池分配，绑核时放在所在 CPU 的 NUMA 节点
+struct Worker {
+  Worker(size_t shard, size_t shards, int cpu)
+      : shard(shard), cpu(cpu),
+        arena(cpu >= 0 ? HugePageArena::nodeOfCpu(cpu) : -1), qos(&arena),
+        nat(shard, shards, &arena) {}
+  size_t shard;
+  int cpu; // 绑定的 CPU，-1 为不绑核
+  HugePageArena arena;
+  PacketCapture cap;
+  QoSManager qos;
+  NATManager nat;
+  std::unique_ptr<WorkerPipeline> pipeline;
+};
+
+// 每轮每个 fd 最多读入 kCaptureBatch 个报文，却只处理 kProcessBudget 个：
+// 过载时积压留在 StageQueue 里按优先级丢弃，而不是在内核缓冲区里随机丢弃
+static constexpr size_t kCaptureBatch = 64;
+static constexpr size_t kProcessBudget = 64;
+static constexpr size_t kStageDepth = 1024;
+// 持续积压时走不到空闲时的批量发送，每隔这么多轮也发出积攒的 ACK 与 UDP 报文
+static constexpr size_t kFlushEveryRounds = 8;
+
+// 采集阶段：非阻塞地读入一批报文，分类后入队
+static void capture(Worker &w, StageQueue &queue, bool inbound) {
+  for (size_t i = 0; i < kCaptureBatch; ++i) {
+    errno = 0;
+    auto packet = inbound ? w.cap.readRawPacket() : w.cap.readPacket();
+    if (!packet) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      continue; // 本机发出等被跳过的报文
+    }
+    uint64_t capturedNs = PacketTracer::enabled() ? PacketTracer::nowNs() : 0;
+    StageQueue::Priority priority = w.pipeline->classify(*packet, inbound);
+    queue.push(priority, std::move(*packet), inbound, capturedNs);
+  }
 }
 
-bool isFromLan(const std::string &ip) {
-  return ip.rfind("192.168.", 0) == 0 || ip.rfind("10.", 0) == 0 ||
-         ip.rfind("172.", 0) == 0;
+// worker 事件循环：LAN 侧 TUN 队列与 WAN 侧回包都在本线程处理，NAT 分片
+// 只被本线程访问；代理模式下只有一个 worker，同时驱动用户态协议栈与 UDP 中继
+static void runWorker(Worker &w, UserTcpStack *tcpStack, UdpRelay *udpRelay) {
+  if (w.cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(w.cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+  int tunFd = w.cap.getTunFd();
+  int wanFd = w.cap.getWanFd();
+  uint64_t lastExpireMs = NATManager::nowMs();
+  StageQueue queue(kStageDepth);
+  StageQueue::Item item;
+  uint64_t lastDropped = 0;
+  size_t busyRounds = 0;
+  std::string traceName = "worker" + std::to_string(w.shard);
+
+  while (true) {
+    PacketTracer::poll(traceName);
+    struct pollfd pfds[4] = {{tunFd, POLLIN, 0},
+                             {wanFd, POLLIN, 0},
+                             {-1, POLLIN, 0},
+                             {-1, POLLIN, 0}};
+    if (tcpStack)
+      pfds[2].fd = tcpStack->getEventFd();
+    if (udpRelay)
+      pfds[3].fd = udpRelay->getEventFd();
+
+    // 先不等待地检查一次；TUN 暂时读空且没有积压时，再批量发出积攒的
+    // ACK 与 UDP 报文并阻塞等待
+    int ret = poll(pfds, 4, 0);
+    if (ret == 0 && queue.empty()) {
+      busyRounds = 0;
+      if (tcpStack) {
+        tcpStack->flush();
+        if (udpRelay)
+          udpRelay->flush();
+        ret = poll(pfds, 4, tcpStack->nextTimeoutMs(100));
+      } else {
+        ret = poll(pfds, 4, 100);
+      }
+    }
+    if (ret < 0) {
+      if (errno != EINTR) // SIGUSR1 导出追踪时会打断 poll
+        perror("poll");
+      continue;
+    }
+    if (tcpStack)
+      tcpStack->poll();
+    if (udpRelay)
+      udpRelay->poll();
+
+    uint64_t now = NATManager::nowMs();
+    if (now - lastExpireMs >= 1000) {
+      w.nat.expire(now);
+      lastExpireMs = now;
+      uint64_t dropped = queue.dropped(StageQueue::Control) +
+                         queue.dropped(StageQueue::Established) +
+                         queue.dropped(StageQueue::NewFlow) +
+                         w.nat.admissionRejected();
+      if (dropped != lastDropped)
+        std::cerr << "[Overload] Worker " << w.shard << " dropped control "
+                  << queue.dropped(StageQueue::Control) << ", established "
+                  << queue.dropped(StageQueue::Established) << ", new "
+                  << queue.dropped(StageQueue::NewFlow)
+                  << "; admission rejected " << w.nat.admissionRejected()
+                  << "\n";
+      lastDropped = dropped;
+    }
+
+    // WAN 侧回包先入队，同一类别内回包排在 LAN 侧报文之前
+    if (pfds[1].revents & POLLIN)
+      capture(w, queue, true);
+    if (pfds[0].revents & POLLIN)
+      capture(w, queue, false);
+    for (size_t i = 0; i < kProcessBudget && queue.pop(item); ++i) {
+      if (item.inbound)
+        w.pipeline->processInbound(item.packet);
+      else
+        w.pipeline->processOutbound(std::move(item.packet), item.capturedNs);
+    }
+    if (tcpStack && ++busyRounds >= kFlushEveryRounds) {
+      busyRounds = 0;
+      tcpStack->flush();
+      if (udpRelay)
+        udpRelay->flush();
+    }
+  }
 }
 
-int main() {
-  PacketCapture cap;
-  if (!cap.init("tun0"))
+// 离线回放：用抓包文件代替 TUN/网卡跑完整流水线，结束后打印吞吐
+static int runReplay(const std::string &inPath, const std::string &outPath,
+                     size_t rounds, Firewall &firewall, QoSManager &qos,
+                     RoutingManager &router, NATManager &nat) {
+  PcapPacketIO pcap;
+  if (!pcap.open(inPath, outPath))
     return 1;
 
-  RoutingManager router;
-  auto staticRouter = std::make_shared<StaticRouteProvider>();
-  staticRouter->loadFromFile("config/routes.conf");
-  router.addProvider(staticRouter);
+  // 多轮回放时先把报文全部装入内存，排除文件读取的开销
+  std::unique_ptr<MemoryPacketIO> mem;
+  IPacketIO *io = &pcap;
+  if (rounds > 1) {
+    mem = std::make_unique<MemoryPacketIO>(rounds);
+    while (auto packet = pcap.readPacket())
+      mem->addLanPacket(std::move(*packet));
+    io = mem.get();
+  }
 
-  auto dynamicRouter =
-      std::make_shared<DynamicRouteProvider>("tun0", "192.168.99.1");
-  dynamicRouter->start();
-  router.addProvider(dynamicRouter);
+  ForwardingPipeline pipeline(*io, firewall, qos, router, nat);
+  auto begin = std::chrono::steady_clock::now();
+  uint64_t n = pipeline.drain();
+  double secs = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - begin)
+                    .count();
+  if (PacketTracer::enabled()) {
+    PacketTracer::requestDump();
+    PacketTracer::poll("replay", true);
+  }
 
-  NATManager nat;
-  nat.setPublicIp("wlan0");
+  auto st = pipeline.stats();
+  std::cerr << "[Replay] " << n << " packets in " << secs << " s ("
+            << (secs > 0 ? n / secs : 0) << " pps): blocked " << st.blocked
+            << ", rate limited " << st.rateLimited << ", no route "
+            << st.noRoute << ", snat " << st.snat << ", routed " << st.routed
+            << "\n";
+  return 0;
+}
 
-  Firewall firewall;
-  firewall.loadRules("config/firewall.rules");
-  QoSManager qos;
-  qos.loadRules("config/qos.rules");
+int main(int argc, char **argv) {
+  // --proxy：LAN 发往外网的 TCP 在用户态终结、UDP 经 UDP ASSOCIATE，
+  // 均由 SOCKS5 代理转发，其余流量仍走 NAT
+  // --pcap：离线回放抓包文件，不需要 root 与真实网卡
+  // --tun/--wan/--config-dir：供 netns 压测等场景改用非默认的网卡与配置
+  // --workers：多队列 TUN 与 fanout 分流到多个 worker，NAT 按端口分片
+  // --pin-cpus：worker i 绑定到 CPU i，其 NAT/QoS 表放在该 CPU 的 NUMA 节点
+  // --offload：已建立 NAT 映射的回包由 WAN 网卡上的 eBPF 程序直接 DNAT 进 TUN
+  // --state-dir：NAT 映射写入该目录下的状态文件，重启后原样恢复（如 /dev/shm）
+  // --snapshot：用 wuthering-configc 编译好的快照代替 --config-dir 下的
+  // 防火墙、QoS 与静态路由文本配置
+  // --new-flow-limit：每个源地址每秒可新建的 NAT 映射数，每个分片的总量为其
+  // 16 倍；0 表示不限制
+  // --trace-sample：每 n 个 LAN 侧报文抽样一个，记录流水线各阶段耗时；
+  // 收到 SIGUSR1（回放结束时自动）各 worker 把明细写到 --trace-dir 下
+  bool proxyMode = false;
+  bool offloadMode = false;
+  bool quiet = false;
+  size_t workers = 1;
+  bool pinCpus = false;
+  std::string tunName = "tun0", wanIface = "wlan0", configDir = "config";
+  std::string pcapIn, pcapOut, stateDir, snapshotPath;
+  size_t rounds = 1;
+  uint32_t flowLimit = 1000;
+  uint32_t traceSample = 0;
+  std::string traceDir = ".";
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--proxy") {
+      proxyMode = true;
+    } else if (arg == "--quiet") {
+      quiet = true;
+    } else if (arg == "--tun" && hasValue) {
+      tunName = argv[++i];
+    } else if (arg == "--wan" && hasValue) {
+      wanIface = argv[++i];
+    } else if (arg == "--config-dir" && hasValue) {
+      configDir = argv[++i];
+    } else if (arg == "--pcap" && hasValue) {
+      pcapIn = argv[++i];
+    } else if (arg == "--pcap-out" && hasValue) {
+      pcapOut = argv[++i];
+    } else if (arg == "--rounds" && hasValue) {
+      rounds = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--new-flow-limit" && hasValue) {
+      flowLimit = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--trace-sample" && hasValue) {
+      traceSample = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--trace-dir" && hasValue) {
+      traceDir = argv[++i];
+    } else if (arg == "--snapshot" && hasValue) {
+      snapshotPath = argv[++i];
+    } else if (arg == "--state-dir" && hasValue) {
+      stateDir = argv[++i];
+    } else if (arg == "--offload") {
+      offloadMode = true;
+    } else if (arg == "--pin-cpus") {
+      pinCpus = true;
+    } else if (arg == "--workers" && hasValue) {
+      workers = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  // 逐包日志会淹没回放吞吐，--quiet 直接屏蔽 stdout
+  if (quiet)
+    std::cout.setstate(std::ios::badbit);
+  if (traceSample) {
+    PacketTracer::setOutputDir(traceDir);
+    PacketTracer::setSampleRate(traceSample);
+    signal(SIGUSR1, onTraceSignal);
+  }
 
-  std::cout << "[Router] System started.\n";
+  // 快照被防火墙与各 QoS 直接引用，须比它们长寿；快照不可用时直接退出，
+  // 文本配置仍按原先的方式跳过错误行继续运行
+  ConfigSnapshot snapshot;
+  bool useSnapshot = !snapshotPath.empty();
+  if (useSnapshot && !snapshot.open(snapshotPath))
+    return 1;
+  auto loadQos = [&](QoSManager &qos) {
+    if (useSnapshot)
+      return qos.loadSnapshot(snapshot);
+    qos.loadRules(configDir + "/qos.rules");
+    return true;
+  };
 
-  std::thread rawListener([&]() {
-    while (true) {
-      auto rawPkt = cap.readRawPacket();
-      if (!rawPkt)
-        continue;
-      auto dnatted = nat.applyDNAT(*rawPkt);
-      cap.writeToTun(dnatted);
-    }
-  });
+  auto staticRouter = std::make_shared<StaticRouteProvider>();
+  Firewall firewall;
+  if (useSnapshot) {
+    if (!staticRouter->loadSnapshot(snapshot) ||
+        !firewall.loadSnapshot(snapshot))
+      return 1;
+  } else {
+    staticRouter->loadFromFile(configDir + "/routes.conf");
+    firewall.loadRules(configDir + "/firewall.rules");
+  }
 
-  int tunFd = cap.getTunFd();
+  // 离线回放经 RoutingManager 与 IPacketIO 组合，只用静态路由
+  if (!pcapIn.empty()) {
+    RoutingManager router;
+    router.addProvider(staticRouter);
+    NATManager nat;
+    nat.setPublicIp(wanIface);
+    QoSManager qos;
+    if (!loadQos(qos))
+      return 1;
+    return runReplay(pcapIn, pcapOut, rounds, firewall, qos, router, nat);
+  }
 
-  while (true) {
-    struct pollfd pfd = {tunFd, POLLIN, 0};
-    int ret = poll(&pfd, 1, 100);
-    if (ret < 0) {
-      perror("poll");
-      continue;
-    }
+  // 用户态协议栈与 UDP 中继是单线程的
+  if (proxyMode && workers > 1) {
+    std::cerr << "[Router] --proxy runs a single worker\n";
+    workers = 1;
+  }
 
-    if (pfd.revents & POLLIN) {
-      auto packet = cap.readPacket();
-      if (!packet)
-        continue;
+  // CPU 数未知时 hardware_concurrency() 返回 0，此时不绑核
+  unsigned cpus = std::thread::hardware_concurrency();
+  if (pinCpus && cpus == 0) {
+    std::cerr << "[Router] CPU count unknown, workers are not pinned\n";
+    pinCpus = false;
+  }
 
-      std::string srcIp = extractSrcIp(*packet);
-      std::string dstIp = extractDstIp(*packet);
-      const struct iphdr *iph =
-          reinterpret_cast<const struct iphdr *>(packet->data());
-      uint8_t proto = iph->protocol;
+  // worker 流水线直接引用两个路由提供者，动态路由须在此之前创建
+  DynamicRouteProvider dynamicRouter(tunName, "192.168.99.1");
+  WorkerRouter router(*staticRouter, dynamicRouter);
 
-      std::cout << "[Cap] From " << srcIp << " to " << dstIp << "\n";
+  // 按分片号依次 init，fanout 组成员的顺序即分片号
+  std::vector<std::unique_ptr<Worker>> pool;
+  for (size_t i = 0; i < workers; ++i) {
+    int cpu = pinCpus ? int(i % cpus) : -1;
+    auto w = std::make_unique<Worker>(i, workers, cpu);
+    if (cpu >= 0)
+      std::cout << "[Router] Worker " << i << " on CPU " << cpu
+                << ", NUMA node " << w->arena.numaNode() << "\n";
+    if (i > 0)
+      w->cap.setNeighborCache(pool[0]->cap.neighborCache());
+    if (!w->cap.init(tunName, wanIface, i, workers))
+      return 1;
+    w->nat.setPublicIp(wanIface);
+    if (!stateDir.empty())
+      w->nat.attachState(stateDir + "/nat-" + std::to_string(i) + ".state");
+    w->nat.setFlowLimit(flowLimit, flowLimit * 16);
+    if (!loadQos(w->qos))
+      return 1;
+    w->qos.setRateShare(workers);
+    w->pipeline = std::make_unique<WorkerPipeline>(w->cap, firewall, w->qos,
+                                                   router, w->nat);
+    pool.push_back(std::move(w));
+  }
+  PacketCapture &cap = pool[0]->cap;
 
-      if (!firewall.allow(*packet)) {
-        std::cout << "[Firewall] Blocked packet from " << srcIp << " to "
-                  << dstIp << "\n";
-        continue;
-      }
+  // 挂载失败（内核不支持 tcx、权限不足等）时仍由用户态处理全部回包
+  std::unique_ptr<NatOffload> offload;
+  if (offloadMode) {
+    offload = std::make_unique<NatOffload>();
+    if (offload->attach(wanIface, tunName)) {
+      for (auto &w : pool)
+        w->nat.setOffload(offload.get());
+    } else {
+      std::cerr << "[Router] NAT offload unavailable, using user space\n";
+      offload.reset();
+    }
+  }
 
-      if (!qos.allow(*packet)) {
-        std::cout << "[QoS] Rate limited packet from " << srcIp << "\n";
-        continue;
-      }
+  dynamicRouter.start();
+  dynamicRouter.advertise("192.168.99.0", "255.255.255.0");
 
-      auto route = router.lookupRoute(dstIp);
-      if (!route) {
-        std::cout << "[Router] No route for " << dstIp << "\n";
-        continue;
-      }
-      if (isFromLan(srcIp) && !isFromLan(dstIp)) {
-        auto snatted = nat.applySNAT(*packet);
-        cap.writePacket(snatted);
-      } else {
-        std::cout << "[Router] Route to " << dstIp << " via " << route->gateway
-                  << " on " << route->iface << "\n";
-        cap.sendViaInterface(*packet, route->gateway, route->iface);
-      }
+  std::shared_ptr<Socks5Pool> proxyPool;
+  std::unique_ptr<RelayManager> relay;
+  std::unique_ptr<UserTcpStack> tcpStack;
+  std::unique_ptr<UdpRelay> udpRelay;
+  if (proxyMode) {
+    socks5::ProxyConfig proxy;
+    proxy.loadFromFile(configDir + "/proxy.conf");
+    proxyPool = std::make_shared<Socks5Pool>(proxy);
+    proxyPool->start();
+    relay = std::make_unique<RelayManager>(2, 64 * 1024, true);
+    relay->setPool(proxyPool);
+    relay->start();
+    tcpStack = std::make_unique<UserTcpStack>(
+        *relay, [&cap](const std::vector<uint8_t> &pkt) { cap.writeToTun(pkt); });
+    udpRelay = std::make_unique<UdpRelay>(
+        proxy, [&cap](const uint8_t *data, size_t len) {
+          cap.writeToTun(data, len);
+        });
+    if (!udpRelay->start()) {
+      std::cerr << "[Router] UDP relay unavailable, UDP is routed directly\n";
+      udpRelay.reset();
     }
+    pool[0]->pipeline->setProxy(tcpStack.get(), udpRelay.get());
   }
 
-  dynamicRouter->stop();
-  rawListener.join();
+  std::cout << "[Router] System started.\n";
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < pool.size(); ++i)
+    threads.emplace_back(runWorker, std::ref(*pool[i]), nullptr, nullptr);
+  runWorker(*pool[0], tcpStack.get(), udpRelay.get());
+
+  dynamicRouter.stop();
+  for (auto &t : threads)
+    t.join();
   return 0;
 }
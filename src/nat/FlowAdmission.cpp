@@ -0,0 +1,48 @@
+#include "nat/FlowAdmission.h"
+#include <algorithm>
+
+static constexpr uint64_t kCost = 1000;
+
+void FlowAdmission::configure(uint32_t perSource, uint32_t total) {
+  perSource_ = perSource;
+  total_ = total;
+  slots_.assign(perSource ? kSlots : 0, Slot{});
+  totalBucket_ = Bucket{};
+}
+
+void FlowAdmission::refill(Bucket &bucket, uint32_t rate, uint64_t nowMs) {
+  // 速率为每秒 rate 个令牌，即每毫秒 rate 个千分之一令牌；
+  // 空闲 2 秒即补满，更长的间隔不必参与乘法
+  uint64_t burst = uint64_t(rate) * 2 * kCost;
+  uint64_t elapsed = std::min<uint64_t>(nowMs - bucket.lastMs, 2000);
+  bucket.milliTokens = std::min(burst, bucket.milliTokens + elapsed * rate);
+  bucket.lastMs = nowMs;
+}
+
+bool FlowAdmission::admit(uint32_t srcIp, uint64_t nowMs) {
+  if (!perSource_)
+    return true;
+
+  // Fibonacci 哈希取高位，相邻地址分散到不同槽位
+  size_t idx = (uint32_t(srcIp * 2654435761u) >> 20) % kSlots;
+  Slot &slot = slots_[idx];
+  if (slot.srcIp != srcIp) {
+    slot.srcIp = srcIp;
+    slot.bucket = Bucket{nowMs, uint64_t(perSource_) * 2 * kCost};
+  }
+  refill(slot.bucket, perSource_, nowMs);
+  if (slot.bucket.milliTokens < kCost) {
+    ++rejected_;
+    return false;
+  }
+  if (total_) {
+    refill(totalBucket_, total_, nowMs);
+    if (totalBucket_.milliTokens < kCost) {
+      ++rejected_;
+      return false;
+    }
+    totalBucket_.milliTokens -= kCost;
+  }
+  slot.bucket.milliTokens -= kCost;
+  return true;
+}
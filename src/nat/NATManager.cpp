@@ -1,5 +1,9 @@
 #include "nat/NATManager.h"
+#include "core/Checksum.h"
+#include "core/Probes.h"
+#include "nat/NatOffload.h"
 #include <arpa/inet.h>
+#include <chrono>
 #include <cstring>
 #include <ifaddrs.h>
 #include <iostream>
@@ -8,7 +12,113 @@
 #include <netinet/tcp.h>
 #include <netinet/udp.h>
 
-static uint16_t ipChecksum(void *vdata, size_t length);
+static constexpr uint32_t kPortBase = 40000;
+// 空闲超时：TCP 不跟踪连接状态，按已建立连接的宽松值处理
+static constexpr uint64_t kTcpIdleMs = 3600 * 1000;
+static constexpr uint64_t kUdpIdleMs = 120 * 1000;
+static constexpr uint64_t kOtherIdleMs = 30 * 1000;
+// 每次 expire 最多检查的映射数：开启卸载时每个映射要一次 bpf() 查询，
+// 分片满载（约 5 万映射）时约一分钟扫完一轮，仍远短于空闲超时
+static constexpr size_t kExpireSlice = 1024;
+
+// 改写报文的源（或目的）地址与端口，并增量修正 IP 与 TCP/UDP 校验和；
+// 端口为主机字节序
+static void rewriteEndpoint(std::vector<uint8_t> &packet, bool source,
+                            uint32_t newIp, uint16_t newPort) {
+  iphdr *ip = reinterpret_cast<iphdr *>(packet.data());
+  size_t ipLen = ip->ihl * 4;
+  uint32_t &addr = source ? ip->saddr : ip->daddr;
+  uint32_t oldIp = addr;
+  addr = newIp;
+  ip->check = 0;
+  ip->check = ipChecksum(ip, ipLen);
+
+  uint16_t *port = nullptr;
+  uint16_t *check = nullptr;
+  if (ip->protocol == IPPROTO_TCP &&
+      packet.size() >= ipLen + sizeof(tcphdr)) {
+    tcphdr *tcp = reinterpret_cast<tcphdr *>(packet.data() + ipLen);
+    port = source ? &tcp->source : &tcp->dest;
+    check = &tcp->check;
+  } else if (ip->protocol == IPPROTO_UDP &&
+             packet.size() >= ipLen + sizeof(udphdr)) {
+    udphdr *udp = reinterpret_cast<udphdr *>(packet.data() + ipLen);
+    port = source ? &udp->source : &udp->dest;
+    // UDP 校验和为 0 表示未计算，保持不变
+    check = udp->check ? &udp->check : nullptr;
+  }
+  if (!port)
+    return;
+
+  uint16_t oldPort = *port;
+  *port = htons(newPort);
+  // 伪首部包含地址，地址与端口的变化都要计入 L4 校验和
+  if (check) {
+    *check = checksumUpdate32(*check, oldIp, newIp);
+    *check = checksumUpdate16(*check, oldPort, *port);
+    if (ip->protocol == IPPROTO_UDP && *check == 0)
+      *check = 0xffff;
+  }
+}
+
+NATManager::NATManager(size_t shard, size_t numShards, HugePageArena *arena)
+    : shard_(shard), numShards_(numShards ? numShards : 1),
+      natTable_(0, std::hash<uint64_t>(), std::equal_to<uint64_t>(), arena),
+      reverseTable_(0, std::hash<uint64_t>(), std::equal_to<uint64_t>(),
+                    arena) {
+  nextPort_ = firstPort();
+  // 按本分片 TCP+UDP 端口总数一次分好桶，表增长时不再整体 rehash
+  natTable_.reserve(shardFlows());
+  reverseTable_.reserve(shardFlows());
+}
+
+size_t NATManager::shardFlows() const {
+  return (65536 - kPortBase) / numShards_ * 2;
+}
+
+bool NATManager::attachState(const std::string &path) {
+  uint32_t publicIp = inet_addr(publicIp_.c_str());
+  if (!state_.open(path, shard_, numShards_, publicIp, shardFlows()))
+    return false;
+
+  uint64_t now = nowMs();
+  state_.forEach([&](uint32_t slot, const NatStateRecord &r) {
+    if (r.externalPort < kPortBase ||
+        shardOfPort(r.externalPort, numShards_) != shard_) {
+      state_.erase(slot);
+      return;
+    }
+    in_addr addr;
+    addr.s_addr = r.internalIp;
+    // 上一个进程的空闲时间无从得知，按刚活跃处理
+    NATEntry entry{inet_ntoa(addr), r.internalPort, publicIp_,
+                   r.externalPort, r.protocol};
+    entry.lastSeenMs = now;
+    entry.stateSlot = slot;
+    uint64_t natKey = makeKey(r.externalIp, r.externalPort, r.protocol);
+    natTable_[natKey] = entry;
+    reverseTable_[makeKey(r.internalIp, r.internalPort, r.protocol)] = natKey;
+  });
+  uint32_t port = state_.nextPort();
+  if (port >= kPortBase && port <= 65535 &&
+      shardOfPort(port, numShards_) == shard_)
+    nextPort_ = port;
+  std::cout << "[NAT] Shard " << shard_ << " resumed with " << natTable_.size()
+            << " mappings, next port " << nextPort_ << "\n";
+  return true;
+}
+
+void NATManager::setOffload(NatOffload *offload) {
+  offload_ = offload;
+  if (!offload_)
+    return;
+  for (auto &kv : natTable_) {
+    const NATEntry &entry = kv.second;
+    offload_->install(inet_addr(entry.externalIp.c_str()), entry.externalPort,
+                      entry.protocol, inet_addr(entry.internalIp.c_str()),
+                      entry.internalPort);
+  }
+}
 
 void NATManager::setPublicIp(const std::string &iface) {
   struct ifaddrs *ifAddrStruct = nullptr;
@@ -29,19 +139,113 @@ void NATManager::setPublicIp(const std::string &iface) {
   publicIp_ = "127.0.0.1";
 }
 
-uint16_t NATManager::allocateExternalPort() {
-  static uint16_t port = 40000;
-  return port++;
+uint16_t NATManager::firstPort() const {
+  size_t offset = (shard_ + numShards_ - kPortBase % numShards_) % numShards_;
+  return kPortBase + offset;
+}
+
+uint16_t NATManager::allocateExternalPort(uint8_t protocol) {
+  // 只在本分片的端口中轮转，跳过仍被占用的端口；转满一圈说明已耗尽
+  size_t candidates = (65536 - kPortBase) / numShards_;
+  uint32_t addr = inet_addr(publicIp_.c_str());
+  for (size_t i = 0; i < candidates; ++i) {
+    uint16_t port = nextPort_;
+    nextPort_ += numShards_;
+    if (nextPort_ > 65535)
+      nextPort_ = firstPort();
+    if (!natTable_.count(makeKey(addr, port, protocol)))
+      return port;
+  }
+  return 0;
+}
+
+// 报文的 TCP/UDP 源或目的端口（主机字节序），其他协议为 0
+static uint16_t l4Port(const std::vector<uint8_t> &packet, bool source) {
+  const iphdr *ip = reinterpret_cast<const iphdr *>(packet.data());
+  size_t ipLen = ip->ihl * 4;
+  // 与 applySNAT/applyDNAT 一致：头部不完整时按无端口处理
+  size_t l4Len = ip->protocol == IPPROTO_TCP   ? sizeof(tcphdr)
+                 : ip->protocol == IPPROTO_UDP ? sizeof(udphdr)
+                                               : 0;
+  if (l4Len == 0 || packet.size() < ipLen + l4Len)
+    return 0;
+  const udphdr *l4 = reinterpret_cast<const udphdr *>(packet.data() + ipLen);
+  return ntohs(source ? l4->source : l4->dest);
+}
+
+bool NATManager::hasMapping(const std::vector<uint8_t> &packet,
+                            bool inbound) const {
+  if (packet.size() < sizeof(iphdr))
+    return false;
+  const iphdr *ip = reinterpret_cast<const iphdr *>(packet.data());
+  if (inbound)
+    return natTable_.count(
+        makeKey(ip->daddr, l4Port(packet, false), ip->protocol));
+  return reverseTable_.count(
+      makeKey(ip->saddr, l4Port(packet, true), ip->protocol));
 }
 
-std::string NATManager::makeNatKey(const std::string &ip, uint16_t port,
-                                   uint8_t protocol) {
-  return ip + ":" + std::to_string(port) + ":" + std::to_string(protocol);
+void NATManager::setFlowLimit(uint32_t perSource, uint32_t total) {
+  admission_.configure(perSource, total);
 }
 
-std::string NATManager::makeReverseKey(const std::string &ip, uint16_t port,
-                                       uint8_t protocol) {
-  return ip + ":" + std::to_string(port) + ":" + std::to_string(protocol);
+uint64_t NATManager::nowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+size_t NATManager::expire(uint64_t now) {
+  // 从上次停下的桶继续，每次只扫一段；扩容后桶号错位只会让个别映射
+  // 晚一轮或多查一次，不影响正确性
+  size_t buckets = natTable_.bucket_count();
+  if (expireCursor_ >= buckets)
+    expireCursor_ = 0;
+  std::vector<uint64_t> idleKeys;
+  size_t checked = 0;
+  for (size_t n = 0; n < buckets && checked < kExpireSlice; ++n) {
+    size_t bucket = expireCursor_;
+    expireCursor_ = (expireCursor_ + 1) % buckets;
+    for (auto it = natTable_.begin(bucket); it != natTable_.end(bucket);
+         ++it) {
+      ++checked;
+      NATEntry &entry = it->second;
+      // 回包由内核处理时用户态看不到，按内核计数是否增长刷新活跃时间
+      NatOffload::Counters counters;
+      if (offload_ &&
+          offload_->counters(inet_addr(entry.externalIp.c_str()),
+                             entry.externalPort, entry.protocol, counters) &&
+          counters.packets != entry.offloadPackets) {
+        entry.offloadPackets = counters.packets;
+        entry.lastSeenMs = now;
+      }
+
+      uint64_t idle = entry.protocol == IPPROTO_TCP   ? kTcpIdleMs
+                      : entry.protocol == IPPROTO_UDP ? kUdpIdleMs
+                                                      : kOtherIdleMs;
+      if (now - entry.lastSeenMs >= idle)
+        idleKeys.push_back(it->first);
+    }
+  }
+
+  for (uint64_t key : idleKeys) {
+    NATEntry &entry = natTable_.find(key)->second;
+    if (offload_)
+      offload_->remove(inet_addr(entry.externalIp.c_str()),
+                       entry.externalPort, entry.protocol);
+    state_.erase(entry.stateSlot);
+    reverseTable_.erase(makeKey(inet_addr(entry.internalIp.c_str()),
+                                entry.internalPort, entry.protocol));
+    natTable_.erase(key);
+  }
+  if (!idleKeys.empty())
+    std::cout << "[NAT] Expired " << idleKeys.size()
+              << " idle mappings in shard " << shard_ << "\n";
+  return idleKeys.size();
+}
+
+uint64_t NATManager::makeKey(uint32_t ip, uint16_t port, uint8_t protocol) {
+  return (uint64_t(ip) << 24) | (uint64_t(port) << 8) | protocol;
 }
 
 std::vector<uint8_t> NATManager::applySNAT(const std::vector<uint8_t> &packet) {
@@ -63,56 +267,57 @@ std::vector<uint8_t> NATManager::applySNAT(const std::vector<uint8_t> &packet) {
   in_addr src;
   src.s_addr = ip->saddr;
   std::string srcIp = inet_ntoa(src);
-  std::string reverseKey = makeReverseKey(srcIp, srcPort, proto);
+  uint64_t reverseKey = makeKey(ip->saddr, srcPort, proto);
 
   std::cout << "[SNAT] Original src:" << srcIp << ":" << srcPort
             << ",protocol:" << (int)proto << "\n";
 
   // 如果已存在映射，直接复用
-  if (reverseTable_.count(reverseKey)) {
-    std::string existingNatKey = reverseTable_[reverseKey];
-    const NATEntry &entry = natTable_[existingNatKey];
+  auto existing = reverseTable_.find(reverseKey);
+  if (existing != reverseTable_.end()) {
+    NATEntry &entry = natTable_[existing->second];
+    entry.lastSeenMs = nowMs();
 
     in_addr newAddr;
     inet_aton(entry.externalIp.c_str(), &newAddr);
-    ip->saddr = newAddr.s_addr;
-
-    if (proto == IPPROTO_TCP) {
-      tcphdr *tcp = reinterpret_cast<tcphdr *>(modified.data() + ip->ihl * 4);
-      tcp->source = htons(entry.externalPort);
-    } else if (proto == IPPROTO_UDP) {
-      udphdr *udp = reinterpret_cast<udphdr *>(modified.data() + ip->ihl * 4);
-      udp->source = htons(entry.externalPort);
-    }
-
-    ip->check = 0;
-    ip->check = ipChecksum(ip, ip->ihl * 4);
+    rewriteEndpoint(modified, true, newAddr.s_addr, entry.externalPort);
+    WUTHERING_PROBE3(nat_hit, 1, entry.externalPort, proto);
 
     std::cout << "[SNAT] Reused mapping: " << entry.externalIp << ":"
               << entry.externalPort << "\n";
     return modified;
   }
 
-  // 分配新端口并创建映射
-  uint16_t externalPort = allocateExternalPort();
-  std::string natKey = makeNatKey(publicIp_, externalPort, proto);
-  natTable_[natKey] = NATEntry{srcIp, srcPort, publicIp_, externalPort, proto};
-  reverseTable_[reverseKey] = natKey;
+  // 新建映射要占用端口与两条表项，先过准入控制
+  if (!admission_.admit(src.s_addr, nowMs())) {
+    WUTHERING_PROBE1(nat_reject, src.s_addr);
+    std::cout << "[SNAT] New flow from " << srcIp
+              << " rejected by admission control\n";
+    return {};
+  }
 
+  // 分配新端口并创建映射
+  uint16_t externalPort = allocateExternalPort(proto);
+  if (externalPort == 0) {
+    std::cerr << "[SNAT] No free external port in shard " << shard_ << "\n";
+    return {};
+  }
   in_addr newAddr;
   inet_aton(publicIp_.c_str(), &newAddr);
-  ip->saddr = newAddr.s_addr;
-
-  if (proto == IPPROTO_TCP) {
-    tcphdr *tcp = reinterpret_cast<tcphdr *>(modified.data() + ip->ihl * 4);
-    tcp->source = htons(externalPort);
-  } else if (proto == IPPROTO_UDP) {
-    udphdr *udp = reinterpret_cast<udphdr *>(modified.data() + ip->ihl * 4);
-    udp->source = htons(externalPort);
-  }
+  uint64_t natKey = makeKey(newAddr.s_addr, externalPort, proto);
+  NATEntry &entry = natTable_[natKey];
+  entry = NATEntry{srcIp, srcPort, publicIp_, externalPort, proto};
+  entry.lastSeenMs = nowMs();
+  // 状态文件槽位用尽时映射照常工作，只是重启后不再保留
+  entry.stateSlot = state_.insert(NatStateRecord{
+      newAddr.s_addr, src.s_addr, externalPort, srcPort, proto, 0, 0});
+  state_.setNextPort(nextPort_);
+  reverseTable_[reverseKey] = natKey;
+  if (offload_)
+    offload_->install(newAddr.s_addr, externalPort, proto, src.s_addr, srcPort);
 
-  ip->check = 0;
-  ip->check = ipChecksum(ip, ip->ihl * 4);
+  rewriteEndpoint(modified, true, newAddr.s_addr, externalPort);
+  WUTHERING_PROBE3(nat_create, src.s_addr, srcPort, externalPort);
 
   std::cout << "[SNAT] Mapped to: " << publicIp_ << ":" << externalPort << "\n";
   return modified;
@@ -134,56 +339,24 @@ std::vector<uint8_t> NATManager::applyDNAT(const std::vector<uint8_t> &packet) {
     dstPort = ntohs(udp->dest);
   }
 
-  std::string dstIp = inet_ntoa(*(in_addr *)&ip->daddr);
-  std::string key = makeNatKey(dstIp, dstPort, proto);
+  uint64_t key = makeKey(ip->daddr, dstPort, proto);
 
   auto it = natTable_.find(key);
   if (it == natTable_.end()) {
+    WUTHERING_PROBE3(nat_miss, ip->daddr, dstPort, proto);
     return packet; // 没找到映射，不处理
   }
 
-  const NATEntry &entry = it->second;
+  NATEntry &entry = it->second;
+  entry.lastSeenMs = nowMs();
 
   std::cout << "[DNAT] Matched mapping: " << entry.internalIp << ":"
             << entry.internalPort << "\n";
 
   in_addr newAddr;
   inet_aton(entry.internalIp.c_str(), &newAddr);
-  ip->daddr = newAddr.s_addr;
-
-  if (proto == IPPROTO_TCP) {
-    tcphdr *tcp = reinterpret_cast<tcphdr *>(modified.data() + ip->ihl * 4);
-    tcp->dest = htons(entry.internalPort);
-  } else if (proto == IPPROTO_UDP) {
-    udphdr *udp = reinterpret_cast<udphdr *>(modified.data() + ip->ihl * 4);
-    udp->dest = htons(entry.internalPort);
-  }
-
-  ip->check = 0;
-  ip->check = ipChecksum(ip, ip->ihl * 4);
+  rewriteEndpoint(modified, false, newAddr.s_addr, entry.internalPort);
+  WUTHERING_PROBE3(nat_hit, 0, dstPort, proto);
 
   return modified;
 }
-
-static uint16_t ipChecksum(void *vdata, size_t length) {
-  char *data = reinterpret_cast<char *>(vdata);
-  uint64_t acc = 0;
-
-  for (size_t i = 0; i + 1 < length; i += 2) {
-    uint16_t word;
-    memcpy(&word, data + i, 2);
-    acc += ntohs(word);
-  }
-
-  if (length & 1) {
-    uint16_t word = 0;
-    memcpy(&word, data + length - 1, 1);
-    acc += ntohs(word);
-  }
-
-  while (acc >> 16) {
-    acc = (acc & 0xffff) + (acc >> 16);
-  }
-
-  return htons(~acc);
-}
@@ -0,0 +1,330 @@
+#include "nat/NatOffload.h"
+#include <arpa/inet.h>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/pkt_cls.h>
+#include <map>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+// 旧版内核头文件中没有 tcx 的挂载类型
+static constexpr uint32_t kAttachTcxIngress = 46; // BPF_TCX_INGRESS
+static constexpr uint32_t kMaxEntries = 65536;
+
+// 与 eBPF 程序约定的 map 布局，地址端口均为网络字节序
+struct OffloadKey {
+  uint32_t addr;
+  uint16_t port;
+  uint8_t proto;
+  uint8_t pad;
+};
+struct OffloadValue {
+  uint32_t addr;
+  uint16_t port;
+  uint16_t pad;
+  uint32_t ifindex;
+  uint32_t pad2;
+  uint64_t packets; // 由程序原子累加
+  uint64_t bytes;
+};
+
+static long sysBpf(int cmd, bpf_attr &attr) {
+  return syscall(SYS_bpf, cmd, &attr, sizeof(attr));
+}
+
+// 极简 eBPF 汇编器：跳转目标用标签表示，最后统一回填偏移
+namespace {
+class Assembler {
+public:
+  void emit(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm) {
+    bpf_insn i{};
+    i.code = code;
+    i.dst_reg = dst;
+    i.src_reg = src;
+    i.off = off;
+    i.imm = imm;
+    code_.push_back(i);
+  }
+  void movReg(uint8_t dst, uint8_t src) {
+    emit(BPF_ALU64 | BPF_MOV | BPF_X, dst, src, 0, 0);
+  }
+  void movImm(uint8_t dst, int32_t imm) {
+    emit(BPF_ALU64 | BPF_MOV | BPF_K, dst, 0, 0, imm);
+  }
+  void aluImm(uint8_t op, uint8_t dst, int32_t imm) {
+    emit(BPF_ALU64 | op | BPF_K, dst, 0, 0, imm);
+  }
+  void load(uint8_t size, uint8_t dst, uint8_t src, int16_t off) {
+    emit(BPF_LDX | size | BPF_MEM, dst, src, off, 0);
+  }
+  void store(uint8_t size, uint8_t dst, int16_t off, uint8_t src) {
+    emit(BPF_STX | size | BPF_MEM, dst, src, off, 0);
+  }
+  void storeImm(uint8_t size, uint8_t dst, int16_t off, int32_t imm) {
+    emit(BPF_ST | size | BPF_MEM, dst, 0, off, imm);
+  }
+  void atomicAdd(uint8_t dst, int16_t off, uint8_t src) {
+    emit(BPF_STX | BPF_DW | BPF_ATOMIC, dst, src, off, BPF_ADD);
+  }
+  void loadMapFd(uint8_t dst, int fd) {
+    emit(BPF_LD | BPF_DW | BPF_IMM, dst, BPF_PSEUDO_MAP_FD, 0, fd);
+    emit(0, 0, 0, 0, 0);
+  }
+  void jumpImm(uint8_t op, uint8_t dst, int32_t imm, const char *label) {
+    fixups_.push_back({code_.size(), label});
+    emit(BPF_JMP | op | BPF_K, dst, 0, 0, imm);
+  }
+  void jumpReg(uint8_t op, uint8_t dst, uint8_t src, const char *label) {
+    fixups_.push_back({code_.size(), label});
+    emit(BPF_JMP | op | BPF_X, dst, src, 0, 0);
+  }
+  void jump(const char *label) { jumpImm(BPF_JA, 0, 0, label); }
+  void call(int32_t fn) { emit(BPF_JMP | BPF_CALL, 0, 0, 0, fn); }
+  void exit() { emit(BPF_JMP | BPF_EXIT, 0, 0, 0, 0); }
+  void label(const char *name) { labels_[name] = code_.size(); }
+
+  const std::vector<bpf_insn> &finish() {
+    for (auto &f : fixups_)
+      code_[f.first].off = labels_.at(f.second) - f.first - 1;
+    return code_;
+  }
+
+private:
+  std::vector<bpf_insn> code_;
+  std::vector<std::pair<size_t, std::string>> fixups_;
+  std::map<std::string, size_t> labels_;
+};
+} // namespace
+
+// 以太网 + 20 字节 IPv4 头之后的偏移
+static constexpr int kIpOff = ETH_HLEN;
+static constexpr int kL4Off = ETH_HLEN + 20;
+
+static std::vector<bpf_insn> buildProgram(int mapFd) {
+  enum { R0, R1, R2, R3, R4, R5, R6, R7, R8, R9, R10 };
+  Assembler a;
+  a.movReg(R6, R1); // ctx
+  a.load(BPF_W, R2, R6, offsetof(__sk_buff, data));
+  a.load(BPF_W, R3, R6, offsetof(__sk_buff, data_end));
+  // UDP 需要到 L4 头结束，TCP 需要到校验和字段之后
+  a.movReg(R4, R2);
+  a.aluImm(BPF_ADD, R4, kL4Off + 8);
+  a.jumpReg(BPF_JGT, R4, R3, "pass");
+  a.load(BPF_H, R5, R2, 12);
+  a.jumpImm(BPF_JNE, R5, htons(ETH_P_IP), "pass");
+  a.load(BPF_B, R5, R2, kIpOff);
+  a.jumpImm(BPF_JNE, R5, 0x45, "pass"); // 无选项的 IPv4
+  a.load(BPF_H, R5, R2, kIpOff + 6);
+  a.aluImm(BPF_AND, R5, htons(0x3fff)); // MF 与片偏移
+  a.jumpImm(BPF_JNE, R5, 0, "pass");
+  a.load(BPF_B, R7, R2, kIpOff + 9);
+  a.jumpImm(BPF_JEQ, R7, IPPROTO_UDP, "udp");
+  a.jumpImm(BPF_JNE, R7, IPPROTO_TCP, "pass");
+  a.movReg(R4, R2);
+  a.aluImm(BPF_ADD, R4, kL4Off + 20);
+  a.jumpReg(BPF_JGT, R4, R3, "pass");
+  // 栈上 [-24] 为 L4 校验和偏移，[-32] 为附加的校验和标志
+  a.storeImm(BPF_DW, R10, -24, kL4Off + 16);
+  a.storeImm(BPF_DW, R10, -32, 0);
+  a.jump("key");
+  a.label("udp");
+  a.storeImm(BPF_DW, R10, -24, kL4Off + 6);
+  a.storeImm(BPF_DW, R10, -32, BPF_F_MARK_MANGLED_0); // 校验和为 0 保持不变
+
+  a.label("key");
+  a.load(BPF_W, R5, R2, kIpOff + 16); // daddr
+  a.store(BPF_W, R10, -8, R5);
+  a.load(BPF_H, R5, R2, kL4Off + 2); // dport
+  a.store(BPF_H, R10, -4, R5);
+  a.store(BPF_B, R10, -2, R7);
+  a.storeImm(BPF_B, R10, -1, 0);
+  a.loadMapFd(R1, mapFd);
+  a.movReg(R2, R10);
+  a.aluImm(BPF_ADD, R2, -8);
+  a.call(BPF_FUNC_map_lookup_elem);
+  a.jumpImm(BPF_JEQ, R0, 0, "pass");
+  a.movReg(R8, R0);
+
+  a.movImm(R1, 1);
+  a.atomicAdd(R8, offsetof(OffloadValue, packets), R1);
+  a.load(BPF_W, R1, R6, offsetof(__sk_buff, len));
+  a.atomicAdd(R8, offsetof(OffloadValue, bytes), R1);
+
+  // 先修正校验和再改写字段：地址变化计入 L4 伪首部，端口变化只影响 L4
+  a.load(BPF_W, R9, R10, -8); // 原目的地址
+  a.movReg(R1, R6);
+  a.load(BPF_DW, R2, R10, -24);
+  a.movReg(R3, R9);
+  a.load(BPF_W, R4, R8, offsetof(OffloadValue, addr));
+  a.load(BPF_DW, R5, R10, -32);
+  a.aluImm(BPF_OR, R5, BPF_F_PSEUDO_HDR | 4);
+  a.call(BPF_FUNC_l4_csum_replace);
+  a.movReg(R1, R6);
+  a.load(BPF_DW, R2, R10, -24);
+  a.load(BPF_H, R3, R10, -4);
+  a.load(BPF_H, R4, R8, offsetof(OffloadValue, port));
+  a.load(BPF_DW, R5, R10, -32);
+  a.aluImm(BPF_OR, R5, 2);
+  a.call(BPF_FUNC_l4_csum_replace);
+  a.movReg(R1, R6);
+  a.movImm(R2, kIpOff + 10);
+  a.movReg(R3, R9);
+  a.load(BPF_W, R4, R8, offsetof(OffloadValue, addr));
+  a.movImm(R5, 4);
+  a.call(BPF_FUNC_l3_csum_replace);
+
+  a.load(BPF_W, R1, R8, offsetof(OffloadValue, addr));
+  a.store(BPF_W, R10, -16, R1);
+  a.movReg(R1, R6);
+  a.movImm(R2, kIpOff + 16);
+  a.movReg(R3, R10);
+  a.aluImm(BPF_ADD, R3, -16);
+  a.movImm(R4, 4);
+  a.movImm(R5, 0);
+  a.call(BPF_FUNC_skb_store_bytes);
+  a.load(BPF_H, R1, R8, offsetof(OffloadValue, port));
+  a.store(BPF_H, R10, -12, R1);
+  a.movReg(R1, R6);
+  a.movImm(R2, kL4Off + 2);
+  a.movReg(R3, R10);
+  a.aluImm(BPF_ADD, R3, -12);
+  a.movImm(R4, 2);
+  a.movImm(R5, 0);
+  a.call(BPF_FUNC_skb_store_bytes);
+
+  // TUN 是三层设备，重定向时内核会剥掉以太网头
+  a.load(BPF_W, R1, R8, offsetof(OffloadValue, ifindex));
+  a.movImm(R2, BPF_F_INGRESS);
+  a.call(BPF_FUNC_redirect);
+  a.exit();
+
+  a.label("pass");
+  a.movImm(R0, TC_ACT_UNSPEC); // 交给后续程序与协议栈
+  a.exit();
+  return a.finish();
+}
+
+NatOffload::~NatOffload() { detach(); }
+
+bool NatOffload::attach(const std::string &wanIface,
+                        const std::string &tunIface) {
+  uint32_t wanIfindex = if_nametoindex(wanIface.c_str());
+  tunIfindex_ = if_nametoindex(tunIface.c_str());
+  if (wanIfindex == 0 || tunIfindex_ == 0) {
+    std::cerr << "[Offload] Unknown interface " << wanIface << " or "
+              << tunIface << std::endl;
+    return false;
+  }
+
+  bpf_attr attr{};
+  attr.map_type = BPF_MAP_TYPE_HASH;
+  attr.key_size = sizeof(OffloadKey);
+  attr.value_size = sizeof(OffloadValue);
+  attr.max_entries = kMaxEntries;
+  mapFd_ = sysBpf(BPF_MAP_CREATE, attr);
+  if (mapFd_ < 0) {
+    perror("[Offload] BPF_MAP_CREATE");
+    return false;
+  }
+
+  auto prog = buildProgram(mapFd_);
+  static char log[65536];
+  static const char license[] = "GPL";
+  attr = bpf_attr{};
+  attr.prog_type = BPF_PROG_TYPE_SCHED_CLS;
+  attr.insns = reinterpret_cast<uint64_t>(prog.data());
+  attr.insn_cnt = prog.size();
+  attr.license = reinterpret_cast<uint64_t>(license);
+  attr.log_buf = reinterpret_cast<uint64_t>(log);
+  attr.log_size = sizeof(log);
+  attr.log_level = 1;
+  progFd_ = sysBpf(BPF_PROG_LOAD, attr);
+  if (progFd_ < 0) {
+    perror("[Offload] BPF_PROG_LOAD");
+    std::cerr << log << std::endl;
+    detach();
+    return false;
+  }
+
+  attr = bpf_attr{};
+  attr.link_create.prog_fd = progFd_;
+  attr.link_create.target_ifindex = wanIfindex;
+  attr.link_create.attach_type = kAttachTcxIngress;
+  linkFd_ = sysBpf(BPF_LINK_CREATE, attr);
+  if (linkFd_ < 0) {
+    perror("[Offload] BPF_LINK_CREATE (tcx ingress)");
+    detach();
+    return false;
+  }
+
+  std::cout << "[Offload] Attached to " << wanIface << ", redirecting to "
+            << tunIface << std::endl;
+  return true;
+}
+
+void NatOffload::detach() {
+  for (int *fd : {&linkFd_, &progFd_, &mapFd_}) {
+    if (*fd >= 0)
+      close(*fd);
+    *fd = -1;
+  }
+}
+
+static OffloadKey makeKey(uint32_t extIp, uint16_t extPort, uint8_t proto) {
+  OffloadKey key{};
+  key.addr = extIp;
+  key.port = htons(extPort);
+  key.proto = proto;
+  return key;
+}
+
+bool NatOffload::install(uint32_t extIp, uint16_t extPort, uint8_t proto,
+                         uint32_t intIp, uint16_t intPort) {
+  if (mapFd_ < 0 || (proto != IPPROTO_TCP && proto != IPPROTO_UDP))
+    return false;
+  OffloadKey key = makeKey(extIp, extPort, proto);
+  OffloadValue value{};
+  value.addr = intIp;
+  value.port = htons(intPort);
+  value.ifindex = tunIfindex_;
+
+  bpf_attr attr{};
+  attr.map_fd = mapFd_;
+  attr.key = reinterpret_cast<uint64_t>(&key);
+  attr.value = reinterpret_cast<uint64_t>(&value);
+  attr.flags = BPF_ANY;
+  return sysBpf(BPF_MAP_UPDATE_ELEM, attr) == 0;
+}
+
+void NatOffload::remove(uint32_t extIp, uint16_t extPort, uint8_t proto) {
+  if (mapFd_ < 0)
+    return;
+  OffloadKey key = makeKey(extIp, extPort, proto);
+  bpf_attr attr{};
+  attr.map_fd = mapFd_;
+  attr.key = reinterpret_cast<uint64_t>(&key);
+  sysBpf(BPF_MAP_DELETE_ELEM, attr);
+}
+
+bool NatOffload::counters(uint32_t extIp, uint16_t extPort, uint8_t proto,
+                          Counters &out) {
+  if (mapFd_ < 0)
+    return false;
+  OffloadKey key = makeKey(extIp, extPort, proto);
+  OffloadValue value{};
+  bpf_attr attr{};
+  attr.map_fd = mapFd_;
+  attr.key = reinterpret_cast<uint64_t>(&key);
+  attr.value = reinterpret_cast<uint64_t>(&value);
+  if (sysBpf(BPF_MAP_LOOKUP_ELEM, attr) != 0)
+    return false;
+  out.packets = value.packets;
+  out.bytes = value.bytes;
+  return true;
+}
@@ -0,0 +1,135 @@
+#include "nat/NatStateStore.h"
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char kMagic[8] = {'W', 'U', 'N', 'A', 'T', 'S', 'T', '1'};
+// 头部或槽位格式变化时递增
+static constexpr uint32_t kVersion = 1;
+
+struct NatStateStore::Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint32_t recordSize;
+  uint32_t capacity;
+  uint32_t shard;
+  uint32_t numShards;
+  uint32_t publicIp;
+  uint32_t nextPort;
+  uint8_t reserved[24]; // 凑满一条缓存行，槽位数组从 64 字节处开始
+};
+static_assert(sizeof(NatStateRecord) == 16, "record layout");
+
+NatStateStore::~NatStateStore() { close(); }
+
+bool NatStateStore::open(const std::string &path, uint32_t shard,
+                         uint32_t numShards, uint32_t publicIp,
+                         size_t capacity) {
+  static_assert(sizeof(Header) == 64, "header layout");
+  close();
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    perror(("[NATState] open " + path).c_str());
+    return false;
+  }
+  size_t length = sizeof(Header) + capacity * sizeof(NatStateRecord);
+  struct stat st;
+  bool sized = fstat(fd, &st) == 0 && size_t(st.st_size) == length;
+  if (!sized && ftruncate(fd, length) != 0) {
+    perror("[NATState] ftruncate");
+    ::close(fd);
+    return false;
+  }
+  void *p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    perror("[NATState] mmap");
+    return false;
+  }
+  header_ = static_cast<Header *>(p);
+  records_ = reinterpret_cast<NatStateRecord *>(header_ + 1);
+  mapLength_ = length;
+
+  Header expect{};
+  memcpy(expect.magic, kMagic, sizeof(kMagic));
+  expect.version = kVersion;
+  expect.headerSize = sizeof(Header);
+  expect.recordSize = sizeof(NatStateRecord);
+  expect.capacity = capacity;
+  expect.shard = shard;
+  expect.numShards = numShards;
+  expect.publicIp = publicIp;
+  // nextPort 以外的字段全部一致才沿用旧内容
+  bool compatible = sized && memcmp(header_, &expect,
+                                    offsetof(Header, nextPort)) == 0;
+  if (!compatible) {
+    if (sized)
+      std::cerr << "[NATState] " << path
+                << " has a different layout or shard, starting empty\n";
+    memset(p, 0, length);
+    *header_ = expect;
+    return true;
+  }
+
+  size_t restored = 0;
+  for (size_t i = 0; i < capacity; ++i)
+    restored += records_[i].used != 0;
+  std::cout << "[NATState] Attached " << path << " with " << restored
+            << " mappings\n";
+  return true;
+}
+
+void NatStateStore::close() {
+  if (header_)
+    munmap(header_, mapLength_);
+  header_ = nullptr;
+  records_ = nullptr;
+  mapLength_ = 0;
+}
+
+void NatStateStore::forEach(
+    const std::function<void(uint32_t, const NatStateRecord &)> &fn) const {
+  if (!header_)
+    return;
+  for (uint32_t i = 0; i < header_->capacity; ++i)
+    if (__atomic_load_n(&records_[i].used, __ATOMIC_ACQUIRE))
+      fn(i, records_[i]);
+}
+
+uint32_t NatStateStore::insert(const NatStateRecord &record) {
+  if (!header_)
+    return kNoSlot;
+  uint32_t capacity = header_->capacity;
+  for (uint32_t n = 0; n < capacity; ++n) {
+    uint32_t slot = (hint_ + n) % capacity;
+    NatStateRecord &r = records_[slot];
+    if (r.used)
+      continue;
+    // 先写内容再置位，进程在中途退出时新进程看到的槽位要么完整要么为空
+    r = record;
+    r.used = 0;
+    __atomic_store_n(&r.used, 1, __ATOMIC_RELEASE);
+    hint_ = (slot + 1) % capacity;
+    return slot;
+  }
+  return kNoSlot;
+}
+
+void NatStateStore::erase(uint32_t slot) {
+  if (header_ && slot < header_->capacity)
+    __atomic_store_n(&records_[slot].used, 0, __ATOMIC_RELEASE);
+}
+
+uint32_t NatStateStore::nextPort() const {
+  return header_ ? header_->nextPort : 0;
+}
+
+void NatStateStore::setNextPort(uint32_t port) {
+  if (header_)
+    header_->nextPort = port;
+}
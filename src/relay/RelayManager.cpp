@@ -0,0 +1,630 @@
+#include "relay/RelayManager.h"
+#include "relay/RingBuffer.h"
+#include "relay/Socks5.h"
+#include "relay/Socks5Pool.h"
+#include "relay/SplicePipe.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr int kMaxEvents = 256;
+static constexpr int kPumpBudget = 16; // 单次调度最多转发轮数，避免饿死其他会话
+// 建连到 CONNECT 应答的总时限，代理迟迟不应答时据此回收两端 fd
+static constexpr uint64_t kHandshakeDeadlineMs = 10000;
+
+struct RelayManager::Session {
+  enum State { CONNECTING, GREETING, METHOD, REQUEST, REPLY, RELAYING };
+
+  // epoll_event.data.ptr 指向的端点，用于区分事件来自哪一侧
+  struct Endpoint {
+    Session *session;
+    bool proxySide;
+  };
+
+  explicit Session(size_t bufferSize) : up(bufferSize), down(bufferSize) {}
+
+  uint64_t id = 0;
+  int clientFd = -1;
+  int proxyFd = -1;
+  State state = CONNECTING;
+  uint64_t deadlineMs = 0; // 握手须在此之前完成
+  std::string dst;
+
+  std::vector<uint8_t> request; // 预先编码好的 CONNECT 请求
+  std::vector<uint8_t> hsOut;   // 正在发送的握手报文
+  size_t hsOutPos = 0;
+  std::vector<uint8_t> hsIn; // 已收到的握手应答
+
+  RingBuffer up;   // client → proxy
+  RingBuffer down; // proxy → client
+
+  // splice 模式下以管道代替环形缓冲区
+  bool spliced = false;
+  SplicePipe upPipe;
+  SplicePipe downPipe;
+
+  // 边沿触发下需要自行记住尚未消费完的就绪状态
+  bool clientReadable = false;
+  bool clientWritable = false;
+  bool proxyReadable = false;
+  bool proxyWritable = false;
+
+  bool clientEof = false;
+  bool proxyEof = false;
+  bool clientShut = false; // 已向 client 传递 EOF
+  bool proxyShut = false;  // 已向 proxy 传递 EOF
+  bool yielded = false;
+  bool closed = false;
+
+  Endpoint clientEp{this, false};
+  Endpoint proxyEp{this, true};
+};
+
+struct RelayManager::Worker {
+  int epollFd = -1;
+  int wakeFd = -1;
+  std::thread thread;
+
+  std::mutex pendingMutex;
+  std::vector<std::unique_ptr<Session>> pending;
+
+  std::unordered_map<uint64_t, std::unique_ptr<Session>> sessions;
+  std::vector<uint64_t> ready;  // 用完预算、需继续调度的会话
+  std::vector<uint64_t> closed; // 本轮关闭、待回收的会话
+  // 尚在握手的会话按接管顺序排列，截止时间近似递增，只需检查队头
+  std::deque<std::pair<uint64_t, uint64_t>> handshakes; // (deadlineMs, id)
+};
+
+static bool setNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static bool wouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK; }
+
+static bool isSocket(int fd) {
+  struct stat st;
+  return fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode);
+}
+
+RelayManager::RelayManager(size_t numWorkers, size_t bufferSize,
+                           bool useSplice)
+    : bufferSize_(bufferSize), useSplice_(useSplice) {
+  if (numWorkers == 0)
+    numWorkers = 1;
+  for (size_t i = 0; i < numWorkers; ++i)
+    workers_.push_back(std::make_unique<Worker>());
+}
+
+RelayManager::~RelayManager() { stop(); }
+
+void RelayManager::setProxy(const socks5::ProxyConfig &proxy) {
+  proxy_ = proxy;
+}
+
+void RelayManager::setPool(std::shared_ptr<Socks5Pool> pool) {
+  pool_ = std::move(pool);
+  if (pool_)
+    proxy_ = pool_->proxy();
+}
+
+bool RelayManager::start() {
+  if (running_)
+    return true;
+
+  // 对端关闭后继续写会触发 SIGPIPE，统一改为由 EPIPE 处理
+  signal(SIGPIPE, SIG_IGN);
+
+  // 每个会话占用两个 fd，尽量放开上限
+  rlimit lim{};
+  if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &lim);
+  }
+
+  for (auto &w : workers_) {
+    w->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    w->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (w->epollFd < 0 || w->wakeFd < 0) {
+      perror("[RelayManager] epoll/eventfd");
+      return false;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr; // nullptr 表示唤醒事件
+    epoll_ctl(w->epollFd, EPOLL_CTL_ADD, w->wakeFd, &ev);
+  }
+
+  running_ = true;
+  for (auto &w : workers_)
+    w->thread = std::thread(&RelayManager::workerLoop, this, std::ref(*w));
+
+  std::cout << "[RelayManager] Started " << workers_.size() << " workers.\n";
+  return true;
+}
+
+void RelayManager::stop() {
+  if (!running_.exchange(false))
+    return;
+
+  for (auto &w : workers_) {
+    uint64_t one = 1;
+    write(w->wakeFd, &one, sizeof(one));
+  }
+  for (auto &w : workers_) {
+    if (w->thread.joinable())
+      w->thread.join();
+    for (auto &p : w->pending) {
+      close(p->clientFd);
+      close(p->proxyFd);
+      --sessionCount_;
+    }
+    w->pending.clear();
+    close(w->epollFd);
+    close(w->wakeFd);
+    w->epollFd = w->wakeFd = -1;
+  }
+}
+
+size_t RelayManager::sessionCount() const { return sessionCount_; }
+
+uint64_t RelayManager::openSession(int clientFd, const std::string &dstIp,
+                                   uint16_t dstPort) {
+  auto request = socks5::buildRequest(socks5::kCmdConnect, dstIp, dstPort);
+  if (!running_ || request.empty() || !setNonBlocking(clientFd)) {
+    close(clientFd);
+    return 0;
+  }
+
+  // 优先取预协商连接：跳过建连与方法协商，直接发送 CONNECT
+  int proxyFd = pool_ ? pool_->acquire() : -1;
+  bool pooled = proxyFd >= 0 && setNonBlocking(proxyFd);
+  if (proxyFd >= 0 && !pooled) {
+    close(proxyFd);
+    proxyFd = -1;
+  }
+
+  if (!pooled) {
+    proxyFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (proxyFd < 0) {
+      perror("[RelayManager] socket");
+      close(clientFd);
+      return 0;
+    }
+    int one = 1;
+    setsockopt(proxyFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sockaddr_in proxyAddr{};
+    proxyAddr.sin_family = AF_INET;
+    proxyAddr.sin_port = htons(proxy_.port);
+    inet_pton(AF_INET, proxy_.ip.c_str(), &proxyAddr.sin_addr);
+
+    if (connect(proxyFd, reinterpret_cast<sockaddr *>(&proxyAddr),
+                sizeof(proxyAddr)) < 0 &&
+        errno != EINPROGRESS) {
+      perror("[RelayManager] connect to proxy");
+      close(proxyFd);
+      close(clientFd);
+      return 0;
+    }
+  }
+
+  auto s = std::make_unique<Session>(bufferSize_);
+  s->id = nextId_++;
+  s->clientFd = clientFd;
+  s->proxyFd = proxyFd;
+  s->request = std::move(request);
+  s->deadlineMs = nowMs() + kHandshakeDeadlineMs;
+  if (pooled) {
+    // 空闲连接的发送缓冲区为空，10 字节的请求通常一次即可写完
+    ssize_t n = send(proxyFd, s->request.data(), s->request.size(),
+                     MSG_NOSIGNAL);
+    if (n < 0 && !wouldBlock()) {
+      close(proxyFd);
+      close(clientFd);
+      return 0;
+    }
+    s->hsOut = std::move(s->request);
+    s->hsOutPos = n > 0 ? n : 0;
+    s->state = s->hsOutPos == s->hsOut.size() ? Session::REPLY
+                                               : Session::REQUEST;
+  }
+  s->dst = dstIp + ":" + std::to_string(dstPort);
+  // 管道建立失败时退回环形缓冲区
+  s->spliced = useSplice_ && isSocket(clientFd) &&
+               s->upPipe.open(bufferSize_) && s->downPipe.open(bufferSize_);
+  uint64_t id = s->id;
+
+  Worker &w = *workers_[id % workers_.size()];
+  // 先计数再入队：worker 可能立即接管并关闭会话，届时计数不能先于递增而递减
+  ++sessionCount_;
+  {
+    std::lock_guard<std::mutex> lock(w.pendingMutex);
+    w.pending.push_back(std::move(s));
+  }
+  uint64_t inc = 1;
+  write(w.wakeFd, &inc, sizeof(inc));
+  return id;
+}
+
+void RelayManager::adoptPending(Worker &worker) {
+  uint64_t cnt;
+  while (read(worker.wakeFd, &cnt, sizeof(cnt)) > 0) {
+  }
+
+  std::vector<std::unique_ptr<Session>> pending;
+  {
+    std::lock_guard<std::mutex> lock(worker.pendingMutex);
+    pending.swap(worker.pending);
+  }
+
+  for (auto &s : pending) {
+    // 两端各注册一次即可，边沿触发下无需再调整关注事件
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = &s->clientEp;
+    bool ok = epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, s->clientFd, &ev) == 0;
+    ev.data.ptr = &s->proxyEp;
+    ok = ok && epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, s->proxyFd, &ev) == 0;
+
+    Session &ref = *s;
+    if (s->state != Session::RELAYING)
+      worker.handshakes.emplace_back(s->deadlineMs, s->id);
+    worker.sessions.emplace(s->id, std::move(s));
+    if (!ok) {
+      perror("[RelayManager] epoll_ctl");
+      closeSession(worker, ref);
+    }
+  }
+}
+
+void RelayManager::workerLoop(Worker &worker) {
+  epoll_event events[kMaxEvents];
+
+  while (running_) {
+    int timeout = worker.ready.empty() ? 200 : 0;
+    int n = epoll_wait(worker.epollFd, events, kMaxEvents, timeout);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("[RelayManager] epoll_wait");
+      break;
+    }
+
+    for (int i = 0; i < n; ++i) {
+      if (events[i].data.ptr == nullptr) {
+        adoptPending(worker);
+        continue;
+      }
+      auto *ep = static_cast<Session::Endpoint *>(events[i].data.ptr);
+      if (!ep->session->closed)
+        handleEvent(worker, *ep->session, ep->proxySide, events[i].events);
+    }
+
+    std::vector<uint64_t> ready;
+    ready.swap(worker.ready);
+    for (uint64_t id : ready) {
+      auto it = worker.sessions.find(id);
+      if (it != worker.sessions.end() && !it->second->closed)
+        handleEvent(worker, *it->second, false, 0);
+    }
+
+    expireHandshakes(worker);
+
+    // 同一批事件中可能还引用着已关闭的会话，批处理结束后再释放
+    for (uint64_t id : worker.closed)
+      worker.sessions.erase(id);
+    worker.closed.clear();
+  }
+
+  for (auto &kv : worker.sessions) {
+    if (!kv.second->closed)
+      closeSession(worker, *kv.second);
+  }
+  worker.sessions.clear();
+  worker.closed.clear();
+  worker.ready.clear();
+  worker.handshakes.clear();
+}
+
+void RelayManager::expireHandshakes(Worker &worker) {
+  uint64_t now = nowMs();
+  while (!worker.handshakes.empty() &&
+         worker.handshakes.front().first <= now) {
+    auto it = worker.sessions.find(worker.handshakes.front().second);
+    worker.handshakes.pop_front();
+    if (it == worker.sessions.end())
+      continue;
+    Session &s = *it->second;
+    if (s.closed || s.state == Session::RELAYING)
+      continue;
+    std::cerr << "[RelayManager] SOCKS5 handshake for " << s.dst
+              << " timed out\n";
+    closeSession(worker, s);
+  }
+}
+
+void RelayManager::handleEvent(Worker &worker, Session &s, bool proxySide,
+                               uint32_t events) {
+  // 错误与挂断都交给后续的 read/write 去发现具体原因
+  bool readable = events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR);
+  bool writable = events & (EPOLLOUT | EPOLLHUP | EPOLLERR);
+  if (proxySide) {
+    s.proxyReadable |= readable;
+    s.proxyWritable |= writable;
+  } else {
+    s.clientReadable |= readable;
+    s.clientWritable |= writable;
+  }
+
+  s.yielded = false;
+  bool ok = s.state == Session::RELAYING || driveHandshake(s);
+  ok = ok && pump(s);
+  if (!ok) {
+    closeSession(worker, s);
+    return;
+  }
+  if (s.yielded)
+    worker.ready.push_back(s.id);
+}
+
+bool RelayManager::driveHandshake(Session &s) {
+  if (s.state == Session::CONNECTING) {
+    if (!s.proxyWritable)
+      return true;
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(s.proxyFd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0) {
+      std::cerr << "[RelayManager] connect to proxy: " << strerror(err)
+                << "\n";
+      return false;
+    }
+    s.state = Session::GREETING;
+    s.hsOut = socks5::buildGreeting();
+    s.hsOutPos = 0;
+  }
+
+  while (s.state != Session::RELAYING) {
+    if (s.state == Session::GREETING || s.state == Session::REQUEST) {
+      if (!s.proxyWritable)
+        return true;
+      while (s.hsOutPos < s.hsOut.size()) {
+        ssize_t n = send(s.proxyFd, s.hsOut.data() + s.hsOutPos,
+                         s.hsOut.size() - s.hsOutPos, MSG_NOSIGNAL);
+        if (n < 0) {
+          if (!wouldBlock())
+            return false;
+          s.proxyWritable = false;
+          return true;
+        }
+        s.hsOutPos += n;
+      }
+      s.hsIn.clear();
+      s.state =
+          s.state == Session::GREETING ? Session::METHOD : Session::REPLY;
+      continue;
+    }
+
+    // METHOD / REPLY：只读取应答本身的字节，避免吞掉随后到达的转发数据
+    size_t need = 2;
+    if (s.state == Session::REPLY) {
+      need = socks5::replyLength(s.hsIn.data(), s.hsIn.size());
+      if (need == socks5::kMalformedReply)
+        return false;
+      if (need == 0)
+        need = 5;
+    }
+
+    if (s.hsIn.size() < need) {
+      if (!s.proxyReadable)
+        return true;
+      size_t have = s.hsIn.size();
+      s.hsIn.resize(need);
+      ssize_t n = recv(s.proxyFd, s.hsIn.data() + have, need - have, 0);
+      if (n <= 0) {
+        s.hsIn.resize(have);
+        if (n < 0 && wouldBlock()) {
+          s.proxyReadable = false;
+          return true;
+        }
+        return false;
+      }
+      s.hsIn.resize(have + n);
+      continue;
+    }
+
+    if (s.state == Session::METHOD) {
+      if (!socks5::parseMethodReply(s.hsIn.data(), s.hsIn.size()))
+        return false;
+      s.state = Session::REQUEST;
+      s.hsOut = std::move(s.request);
+      s.hsOutPos = 0;
+      continue;
+    }
+
+    if (s.hsIn[1] != socks5::kReplySucceeded) {
+      std::cerr << "[RelayManager] SOCKS5 connect to " << s.dst
+                << " refused, code " << int(s.hsIn[1]) << "\n";
+      return false;
+    }
+    s.state = Session::RELAYING;
+    s.hsIn.clear();
+    s.hsIn.shrink_to_fit();
+    s.hsOut.clear();
+    s.hsOut.shrink_to_fit();
+  }
+  return true;
+}
+
+bool RelayManager::pump(Session &s) {
+  if (s.spliced)
+    return pumpSplice(s);
+
+  bool relaying = s.state == Session::RELAYING;
+
+  for (int round = 0; round < kPumpBudget; ++round) {
+    bool progress = false;
+
+    // client → up：握手期间也先行缓存，缓冲区满即停止读取形成背压
+    if (s.clientReadable && !s.clientEof && !s.up.full()) {
+      ssize_t n = s.up.readFrom(s.clientFd);
+      if (n > 0) {
+        progress = true;
+      } else if (n == 0) {
+        s.clientEof = true;
+        progress = true;
+      } else if (wouldBlock()) {
+        s.clientReadable = false;
+      } else {
+        return false;
+      }
+    }
+
+    if (relaying) {
+      if (s.proxyWritable && !s.up.empty()) {
+        ssize_t n = s.up.writeTo(s.proxyFd);
+        if (n > 0)
+          progress = true;
+        else if (n < 0 && wouldBlock())
+          s.proxyWritable = false;
+        else if (n < 0)
+          return false;
+      }
+      if (s.clientEof && s.up.empty() && !s.proxyShut) {
+        shutdown(s.proxyFd, SHUT_WR);
+        s.proxyShut = true;
+      }
+
+      if (s.proxyReadable && !s.proxyEof && !s.down.full()) {
+        ssize_t n = s.down.readFrom(s.proxyFd);
+        if (n > 0) {
+          progress = true;
+        } else if (n == 0) {
+          s.proxyEof = true;
+          progress = true;
+        } else if (wouldBlock()) {
+          s.proxyReadable = false;
+        } else {
+          return false;
+        }
+      }
+    }
+
+    if (s.clientWritable && !s.down.empty()) {
+      ssize_t n = s.down.writeTo(s.clientFd);
+      if (n > 0)
+        progress = true;
+      else if (n < 0 && wouldBlock())
+        s.clientWritable = false;
+      else if (n < 0)
+        return false;
+    }
+    if (s.proxyEof && s.down.empty() && !s.clientShut) {
+      shutdown(s.clientFd, SHUT_WR);
+      s.clientShut = true;
+    }
+
+    if (s.clientShut && s.proxyShut)
+      return false; // 双向都已结束
+    if (!progress)
+      return true;
+  }
+
+  s.yielded = true;
+  return true;
+}
+
+// 单方向 splice：src → pipe → dst；返回 false 表示出错
+static bool spliceStep(SplicePipe &pipe, int src, int dst, bool &srcReadable,
+                       bool &srcEof, bool &dstWritable, bool &progress) {
+  if (srcReadable && !srcEof && pipe.size() < pipe.capacity()) {
+    ssize_t n = pipe.fill(src, pipe.capacity() - pipe.size());
+    if (n > 0) {
+      progress = true;
+    } else if (n == 0) {
+      srcEof = true;
+      progress = true;
+    } else if (!wouldBlock()) {
+      return false;
+    } else if (pipe.empty()) {
+      // 管道按页计容量，非空时的 EAGAIN 可能只是管道满，
+      // 只有管道为空时才能确定 src 已读空
+      srcReadable = false;
+    }
+  }
+
+  if (dstWritable && !pipe.empty()) {
+    ssize_t n = pipe.drain(dst, pipe.size());
+    if (n > 0)
+      progress = true;
+    else if (n < 0 && wouldBlock())
+      dstWritable = false;
+    else if (n < 0)
+      return false;
+  }
+  return true;
+}
+
+bool RelayManager::pumpSplice(Session &s) {
+  // 握手期间不读取 client，数据留在内核 socket 缓冲区里
+  if (s.state != Session::RELAYING)
+    return true;
+
+  for (int round = 0; round < kPumpBudget; ++round) {
+    bool progress = false;
+
+    if (!spliceStep(s.upPipe, s.clientFd, s.proxyFd, s.clientReadable,
+                    s.clientEof, s.proxyWritable, progress) ||
+        !spliceStep(s.downPipe, s.proxyFd, s.clientFd, s.proxyReadable,
+                    s.proxyEof, s.clientWritable, progress))
+      return false;
+
+    if (s.clientEof && s.upPipe.empty() && !s.proxyShut) {
+      shutdown(s.proxyFd, SHUT_WR);
+      s.proxyShut = true;
+    }
+    if (s.proxyEof && s.downPipe.empty() && !s.clientShut) {
+      shutdown(s.clientFd, SHUT_WR);
+      s.clientShut = true;
+    }
+
+    if (s.clientShut && s.proxyShut)
+      return false;
+    if (!progress)
+      return true;
+  }
+
+  s.yielded = true;
+  return true;
+}
+
+uint64_t RelayManager::nowMs() {
+  auto now = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             now.time_since_epoch())
+      .count();
+}
+
+void RelayManager::closeSession(Worker &worker, Session &s) {
+  if (s.closed)
+    return;
+  s.closed = true;
+  close(s.clientFd);
+  close(s.proxyFd);
+  worker.closed.push_back(s.id);
+  --sessionCount_;
+}
@@ -0,0 +1,86 @@
+#include "relay/RingBuffer.h"
+#include <algorithm>
+#include <cstring>
+#include <sys/uio.h>
+
+static size_t roundUpPow2(size_t n) {
+  size_t cap = 1;
+  while (cap < n)
+    cap <<= 1;
+  return cap;
+}
+
+RingBuffer::RingBuffer(size_t capacity) : capacity_(roundUpPow2(capacity)) {}
+
+uint8_t *RingBuffer::storage() {
+  if (!data_)
+    data_.reset(new uint8_t[capacity_]);
+  return data_.get();
+}
+
+size_t RingBuffer::write(const uint8_t *data, size_t len) {
+  len = std::min(len, space());
+  if (len == 0)
+    return 0;
+
+  uint8_t *buf = storage();
+  size_t pos = tail_ & (capacity_ - 1);
+  size_t first = std::min(len, capacity_ - pos);
+  memcpy(buf + pos, data, first);
+  memcpy(buf, data + first, len - first);
+  tail_ += len;
+  return len;
+}
+
+size_t RingBuffer::peek(size_t offset, uint8_t *out, size_t len) const {
+  if (offset >= size())
+    return 0;
+  len = std::min(len, size() - offset);
+
+  const uint8_t *buf = data_.get();
+  size_t pos = (head_ + offset) & (capacity_ - 1);
+  size_t first = std::min(len, capacity_ - pos);
+  memcpy(out, buf + pos, first);
+  memcpy(out + first, buf, len - first);
+  return len;
+}
+
+void RingBuffer::consume(size_t n) {
+  head_ += std::min(n, size());
+  if (empty())
+    head_ = tail_ = 0;
+}
+
+ssize_t RingBuffer::readFrom(int fd) {
+  size_t avail = space();
+  if (avail == 0)
+    return -1;
+
+  // 空闲区可能跨越缓冲区末尾，用 readv 一次读满两段
+  uint8_t *buf = storage();
+  size_t pos = tail_ & (capacity_ - 1);
+  size_t first = std::min(avail, capacity_ - pos);
+  iovec iov[2] = {{buf + pos, first}, {buf, avail - first}};
+  ssize_t n = readv(fd, iov, avail > first ? 2 : 1);
+  if (n > 0)
+    tail_ += n;
+  return n;
+}
+
+ssize_t RingBuffer::writeTo(int fd) {
+  size_t avail = size();
+  if (avail == 0)
+    return 0;
+
+  uint8_t *buf = storage();
+  size_t pos = head_ & (capacity_ - 1);
+  size_t first = std::min(avail, capacity_ - pos);
+  iovec iov[2] = {{buf + pos, first}, {buf, avail - first}};
+  ssize_t n = writev(fd, iov, avail > first ? 2 : 1);
+  if (n > 0) {
+    head_ += n;
+    if (empty())
+      head_ = tail_ = 0;
+  }
+  return n;
+}
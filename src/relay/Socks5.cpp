@@ -0,0 +1,182 @@
+#include "relay/Socks5.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace socks5 {
+
+bool ProxyConfig::loadFromFile(const std::string &path) {
+  std::ifstream in(path);
+  if (!in)
+    return false;
+
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::istringstream ss(line);
+    std::string ipStr, portStr;
+    ss >> ipStr >> portStr;
+    in_addr addr;
+    if (inet_pton(AF_INET, ipStr.c_str(), &addr) != 1 || portStr.empty())
+      return false;
+    char *end = nullptr;
+    errno = 0;
+    unsigned long value = std::strtoul(portStr.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0' || value == 0 || value > 65535) {
+      std::cerr << "[Socks5] Invalid proxy port '" << portStr << "' in "
+                << path << "\n";
+      return false;
+    }
+    ip = ipStr;
+    port = static_cast<uint16_t>(value);
+    std::cout << "[Socks5] Proxy " << ip << ":" << port << "\n";
+    return true;
+  }
+  return false;
+}
+
+static bool recvFull(int fd, uint8_t *buf, size_t len) {
+  size_t got = 0;
+  while (got < len) {
+    ssize_t n = recv(fd, buf + got, len - got, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    got += n;
+  }
+  return true;
+}
+
+static void setIoTimeout(int fd, int timeoutMs) {
+  timeval tv{timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+// 非阻塞 connect，以 poll 等待至多 timeoutMs；成功后恢复阻塞模式
+static bool connectWithTimeout(int fd, const sockaddr_in &addr,
+                               int timeoutMs) {
+  int flags = fcntl(fd, F_GETFL);
+  fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+  int rc = connect(fd, reinterpret_cast<const sockaddr *>(&addr),
+                   sizeof(addr));
+  if (rc < 0 && errno == EINPROGRESS) {
+    pollfd pfd{fd, POLLOUT, 0};
+    do {
+      rc = poll(&pfd, 1, timeoutMs);
+    } while (rc < 0 && errno == EINTR);
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (rc > 0 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 &&
+        err == 0)
+      rc = 0;
+    else
+      rc = -1;
+  }
+  fcntl(fd, F_SETFL, flags);
+  return rc == 0;
+}
+
+int connectAndNegotiate(const ProxyConfig &proxy, int timeoutMs) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(proxy.port);
+  inet_pton(AF_INET, proxy.ip.c_str(), &addr.sin_addr);
+
+  auto greeting = buildGreeting();
+  uint8_t reply[2];
+  if (!connectWithTimeout(fd, addr, timeoutMs)) {
+    close(fd);
+    return -1;
+  }
+  setIoTimeout(fd, timeoutMs);
+  if (send(fd, greeting.data(), greeting.size(), MSG_NOSIGNAL) !=
+          static_cast<ssize_t>(greeting.size()) ||
+      !recvFull(fd, reply, sizeof(reply)) ||
+      !parseMethodReply(reply, sizeof(reply))) {
+    close(fd);
+    return -1;
+  }
+  // 握手完成后转发可能长时间空闲，去掉收发超时
+  setIoTimeout(fd, 0);
+  return fd;
+}
+
+std::vector<uint8_t> buildGreeting() {
+  return {kVersion, 0x01, kMethodNoAuth};
+}
+
+bool parseMethodReply(const uint8_t *data, size_t len) {
+  return len >= 2 && data[0] == kVersion && data[1] == kMethodNoAuth;
+}
+
+std::vector<uint8_t> buildRequest(uint8_t cmd, const std::string &dstIp,
+                                  uint16_t dstPort) {
+  in_addr addr;
+  if (inet_pton(AF_INET, dstIp.c_str(), &addr) != 1)
+    return {};
+
+  std::vector<uint8_t> req(10);
+  req[0] = kVersion;
+  req[1] = cmd;
+  req[2] = 0x00; // reserved
+  req[3] = kAtypIPv4;
+  memcpy(req.data() + 4, &addr, 4);
+  req[8] = dstPort >> 8;
+  req[9] = dstPort & 0xff;
+  return req;
+}
+
+size_t replyLength(const uint8_t *data, size_t len) {
+  // VER REP RSV ATYP BND.ADDR BND.PORT
+  if (len < 5)
+    return 0;
+  switch (data[3]) {
+  case kAtypIPv4:
+    return 4 + 4 + 2;
+  case kAtypIPv6:
+    return 4 + 16 + 2;
+  case kAtypDomain:
+    return 4 + 1 + data[4] + 2;
+  default:
+    return kMalformedReply;
+  }
+}
+
+void writeUdpHeader(uint8_t *out, uint32_t ip, uint16_t port) {
+  out[0] = 0x00; // RSV
+  out[1] = 0x00;
+  out[2] = 0x00; // FRAG：不使用分片
+  out[3] = kAtypIPv4;
+  memcpy(out + 4, &ip, 4);
+  memcpy(out + 8, &port, 2);
+}
+
+size_t parseUdpHeader(const uint8_t *data, size_t len, uint32_t &ip,
+                      uint16_t &port) {
+  if (len < kUdpHeaderLen || data[2] != 0x00 || data[3] != kAtypIPv4)
+    return 0;
+  memcpy(&ip, data + 4, 4);
+  memcpy(&port, data + 8, 2);
+  return kUdpHeaderLen;
+}
+
+} // namespace socks5
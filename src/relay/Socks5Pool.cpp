@@ -0,0 +1,130 @@
+#include "relay/Socks5Pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <poll.h>
+#include <unistd.h>
+#include <vector>
+
+static constexpr uint64_t kTickMs = 100;
+static constexpr uint64_t kMaxIdleAgeMs = 30000; // 代理可能回收长时间空闲的连接
+static constexpr double kHorizonSec = 0.5; // 池中保留约 0.5 秒的新建连接量
+static constexpr double kEwmaAlpha = 0.2;
+
+Socks5Pool::Socks5Pool(const socks5::ProxyConfig &proxy, size_t minIdle,
+                       size_t maxIdle)
+    : proxy_(proxy), minIdle_(minIdle), maxIdle_(std::max(minIdle, maxIdle)),
+      target_(minIdle) {}
+
+Socks5Pool::~Socks5Pool() { stop(); }
+
+void Socks5Pool::start() {
+  if (running_.exchange(true))
+    return;
+  lastTickMs_ = nowMs();
+  thread_ = std::thread(&Socks5Pool::refillLoop, this);
+}
+
+void Socks5Pool::stop() {
+  if (!running_.exchange(false))
+    return;
+  cv_.notify_all();
+  if (thread_.joinable())
+    thread_.join();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto &c : idle_)
+    close(c.fd);
+  idle_.clear();
+}
+
+size_t Socks5Pool::idleCount() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return idle_.size();
+}
+
+uint64_t Socks5Pool::nowMs() {
+  auto now = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             now.time_since_epoch())
+      .count();
+}
+
+// 空闲连接上不应有任何可读事件；可读意味着代理已关闭或发来了异常数据
+bool Socks5Pool::isHealthy(int fd) {
+  pollfd pfd = {fd, POLLIN, 0};
+  return poll(&pfd, 1, 0) == 0;
+}
+
+int Socks5Pool::acquire() {
+  ++acquired_;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!idle_.empty()) {
+    // 取最新建立的连接，最旧的留给后台按存活时间淘汰
+    IdleConn c = idle_.back();
+    idle_.pop_back();
+    if (idle_.size() < target_)
+      cv_.notify_one();
+    if (isHealthy(c.fd))
+      return c.fd;
+    close(c.fd);
+  }
+  cv_.notify_one();
+  return -1;
+}
+
+void Socks5Pool::updateTarget(uint64_t now) {
+  uint64_t elapsed = now - lastTickMs_;
+  if (elapsed < kTickMs)
+    return;
+  double rate = acquired_.exchange(0) * 1000.0 / elapsed;
+  rateEwma_ = kEwmaAlpha * rate + (1 - kEwmaAlpha) * rateEwma_;
+  lastTickMs_ = now;
+
+  size_t want = minIdle_ + static_cast<size_t>(std::ceil(rateEwma_ * kHorizonSec));
+  target_ = std::min(want, maxIdle_);
+}
+
+void Socks5Pool::refillLoop() {
+  while (running_) {
+    uint64_t now = nowMs();
+    updateTarget(now);
+
+    size_t deficit = 0;
+    std::vector<int> expired;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!idle_.empty() && now - idle_.front().createdMs > kMaxIdleAgeMs) {
+        expired.push_back(idle_.front().fd);
+        idle_.pop_front();
+      }
+      // 负载下降后多余的空闲连接逐步归还代理
+      while (idle_.size() > target_) {
+        expired.push_back(idle_.front().fd);
+        idle_.pop_front();
+      }
+      if (expired.empty() && idle_.size() >= target_) {
+        cv_.wait_for(lock, std::chrono::milliseconds(kTickMs));
+        continue;
+      }
+      deficit = target_ - idle_.size();
+    }
+    for (int fd : expired)
+      close(fd);
+
+    // 建连在锁外进行，补满一个连接就立即可供取用
+    for (size_t i = 0; i < deficit && running_; ++i) {
+      int fd = socks5::connectAndNegotiate(proxy_);
+      if (fd < 0) {
+        std::cerr << "[Socks5Pool] Failed to reach proxy " << proxy_.ip << ":"
+                  << proxy_.port << "\n";
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait_for(lock, std::chrono::seconds(1)); // 代理不可用时退避
+        break;
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      idle_.push_back({fd, nowMs()});
+    }
+  }
+}
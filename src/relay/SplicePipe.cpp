@@ -0,0 +1,48 @@
+#include "relay/SplicePipe.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+SplicePipe::~SplicePipe() { close(); }
+
+void SplicePipe::close() {
+  if (fds_[0] >= 0) {
+    ::close(fds_[0]);
+    ::close(fds_[1]);
+  }
+  fds_[0] = fds_[1] = -1;
+  bytes_ = 0;
+  capacity_ = 0;
+}
+
+bool SplicePipe::open(size_t capacity) {
+  if (pipe2(fds_, O_NONBLOCK | O_CLOEXEC) < 0) {
+    fds_[0] = fds_[1] = -1;
+    return false;
+  }
+  // 超过 /proc/sys/fs/pipe-max-size 时失败，保留默认容量即可
+  int cap = fcntl(fds_[1], F_SETPIPE_SZ, static_cast<int>(capacity));
+  if (cap < 0)
+    cap = fcntl(fds_[1], F_GETPIPE_SZ);
+  capacity_ = cap > 0 ? cap : 0;
+  return true;
+}
+
+ssize_t SplicePipe::fill(int srcFd, size_t maxBytes) {
+  ssize_t n = splice(srcFd, nullptr, fds_[1], nullptr, maxBytes,
+                     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (n > 0)
+    bytes_ += n;
+  return n;
+}
+
+ssize_t SplicePipe::drain(int dstFd, size_t maxBytes) {
+  if (bytes_ == 0)
+    return 0;
+  if (maxBytes > bytes_)
+    maxBytes = bytes_;
+  ssize_t n = splice(fds_[0], nullptr, dstFd, nullptr, maxBytes,
+                     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (n > 0)
+    bytes_ -= n;
+  return n;
+}
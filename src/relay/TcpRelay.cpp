@@ -1,15 +1,101 @@
 #include "relay/TcpRelay.h"
+#include "relay/Socks5.h"
+#include "relay/Socks5Pool.h"
 #include <arpa/inet.h>
+#include <cerrno>
 #include <cstring>
 #include <iostream>
+#include <linux/errqueue.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
-TcpRelay::TcpRelay(const std::string &dstIp, uint16_t dstPort) {
-  sockFd_ = socket(AF_INET, SOCK_STREAM, 0);
+// 循环读写直到凑满 len 字节，处理短读/短写
+static bool readFull(int fd, uint8_t *buf, size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = read(fd, buf + done, len - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    done += n;
+  }
+  return true;
+}
+
+// 非阻塞 fd 上遇到 EAGAIN 时等待就绪后重试
+static void waitFor(int fd, short events) {
+  pollfd pfd = {fd, events, 0};
+  poll(&pfd, 1, -1);
+}
+
+// 经管道把 src 的一段数据 splice 到 dst；管道在返回前总会被清空。
+// 转出中途出错时拆掉管道：残留数据会占满管道，使下次 fill 一直 EAGAIN，
+// 而 src 可读导致 poll 立即返回，形成忙等
+static ssize_t spliceThrough(SplicePipe &pipe, int src, int dst,
+                             size_t maxBytes) {
+  if (!pipe.isOpen() && !pipe.open(maxBytes))
+    return -1;
+
+  ssize_t n;
+  while ((n = pipe.fill(src, maxBytes)) < 0) {
+    if (errno == EAGAIN)
+      waitFor(src, POLLIN);
+    else if (errno != EINTR)
+      return -1;
+  }
+  if (n == 0)
+    return 0;
+
+  while (!pipe.empty()) {
+    if (pipe.drain(dst, pipe.size()) < 0) {
+      if (errno == EAGAIN)
+        waitFor(dst, POLLOUT);
+      else if (errno != EINTR) {
+        pipe.close();
+        return -1;
+      }
+    }
+  }
+  return n;
+}
+
+static bool writeFull(int fd, const uint8_t *buf, size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = send(fd, buf + done, len - done, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    done += n;
+  }
+  return true;
+}
+
+TcpRelay::TcpRelay(const std::string &dstIp, uint16_t dstPort,
+                   const socks5::ProxyConfig &proxy) {
+  sockFd_ = socks5::connectAndNegotiate(proxy);
   if (sockFd_ < 0) {
-    perror("[TcpRelay] socket");
+    perror("[TcpRelay] connect to proxy");
+    return;
+  }
+
+  if (!socks5Connect(dstIp, dstPort)) {
+    close(sockFd_);
+    sockFd_ = -1;
+  }
+}
+
+TcpRelay::TcpRelay(const std::string &dstIp, uint16_t dstPort,
+                   Socks5Pool &pool) {
+  sockFd_ = pool.acquire();
+  if (sockFd_ < 0)
+    sockFd_ = socks5::connectAndNegotiate(pool.proxy());
+  if (sockFd_ < 0) {
+    perror("[TcpRelay] connect to proxy");
     return;
   }
 
@@ -30,62 +116,113 @@ bool TcpRelay::isConnected() const { return sockFd_ >= 0; }
 bool TcpRelay::sendPayload(const std::vector<uint8_t> &data) {
   if (sockFd_ < 0)
     return false;
-  ssize_t written = write(sockFd_, data.data(), data.size());
-  return written == static_cast<ssize_t>(data.size());
+  if (zeroCopy_ && data.size() >= zeroCopyThreshold_)
+    return sendZeroCopy(data.data(), data.size());
+  return writeFull(sockFd_, data.data(), data.size());
 }
 
 std::optional<std::vector<uint8_t>> TcpRelay::receivePayload() {
   if (sockFd_ < 0)
     return std::nullopt;
 
-  uint8_t buffer[2000];
-  ssize_t len = read(sockFd_, buffer, sizeof(buffer));
+  // 直接读入返回的 vector，省掉一次栈缓冲区拷贝
+  std::vector<uint8_t> buffer(16 * 1024);
+  ssize_t len = read(sockFd_, buffer.data(), buffer.size());
   if (len <= 0)
     return std::nullopt;
 
-  return std::vector<uint8_t>(buffer, buffer + len);
+  buffer.resize(len);
+  return buffer;
 }
 
-int TcpRelay::getSocketFd() const { return sockFd_; }
+ssize_t TcpRelay::spliceFrom(int srcFd, size_t maxBytes) {
+  if (sockFd_ < 0)
+    return -1;
+  return spliceThrough(inPipe_, srcFd, sockFd_, maxBytes);
+}
 
-bool TcpRelay::socks5Connect(const std::string &dstIp, uint16_t dstPort) {
-  sockaddr_in proxyAddr{};
-  proxyAddr.sin_family = AF_INET;
-  proxyAddr.sin_port = htons(7897); // Clash 本地代理端口
-  inet_pton(AF_INET, "127.0.0.1", &proxyAddr.sin_addr);
+ssize_t TcpRelay::spliceTo(int dstFd, size_t maxBytes) {
+  if (sockFd_ < 0)
+    return -1;
+  return spliceThrough(outPipe_, sockFd_, dstFd, maxBytes);
+}
 
-  if (connect(sockFd_, reinterpret_cast<sockaddr *>(&proxyAddr),
-              sizeof(proxyAddr)) < 0) {
-    perror("[TcpRelay] connect to proxy");
+bool TcpRelay::enableZeroCopy(size_t threshold) {
+  int one = 1;
+  if (sockFd_ < 0 ||
+      setsockopt(sockFd_, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0)
     return false;
+  zeroCopy_ = true;
+  zeroCopyThreshold_ = threshold;
+  return true;
+}
+
+bool TcpRelay::sendZeroCopy(const uint8_t *data, size_t len) {
+  size_t done = 0;
+  uint32_t calls = 0;
+  while (done < len) {
+    ssize_t n = send(sockFd_, data + done, len - done,
+                     MSG_ZEROCOPY | MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && errno == ENOBUFS) // optmem 不足时退回普通拷贝发送
+      break;
+    if (n <= 0)
+      return false;
+    done += n;
+    ++calls;
+  }
+  bool ok = done == len || writeFull(sockFd_, data + done, len - done);
+  if (calls == 0)
+    return ok;
+
+  // data 归调用方所有，必须等内核通过错误队列确认不再引用这些页后才能返回
+  uint32_t last = zcIssued_ + calls - 1;
+  zcIssued_ += calls;
+  for (;;) {
+    char control[128];
+    msghdr msg{};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(sockFd_, &msg, MSG_ERRQUEUE) < 0) {
+      if (errno != EAGAIN && errno != EINTR)
+        return false;
+      waitFor(sockFd_, 0); // POLLERR 总会被报告
+      continue;
+    }
+
+    for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+      if (cm->cmsg_level != SOL_IP || cm->cmsg_type != IP_RECVERR)
+        continue;
+      auto *serr = reinterpret_cast<sock_extended_err *>(CMSG_DATA(cm));
+      if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+      // 内核仍然做了拷贝（如回环），继续用零拷贝只会多一次通知开销
+      if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+        zeroCopy_ = false;
+      if (static_cast<int32_t>(serr->ee_data - last) >= 0)
+        return ok;
+    }
   }
+}
 
-  // 协议阶段 1: 协议版本 + 支持的方法数 + 方法
-  uint8_t request1[] = {0x05, 0x01, 0x00}; // SOCKS5, 1 method, no auth
-  if (write(sockFd_, request1, sizeof(request1)) != sizeof(request1))
-    return false;
+int TcpRelay::getSocketFd() const { return sockFd_; }
 
-  uint8_t response1[2];
-  if (read(sockFd_, response1, 2) != 2 || response1[1] != 0x00)
+bool TcpRelay::socks5Connect(const std::string &dstIp, uint16_t dstPort) {
+  // 协议阶段 2: 连接请求（阶段 1 方法协商已在建连时完成）
+  auto request2 = socks5::buildRequest(socks5::kCmdConnect, dstIp, dstPort);
+  if (request2.empty() ||
+      !writeFull(sockFd_, request2.data(), request2.size()))
     return false;
 
-  // 协议阶段 2: 连接请求
-  in_addr addr;
-  inet_pton(AF_INET, dstIp.c_str(), &addr);
-  uint8_t request2[10];
-  request2[0] = 0x05; // version
-  request2[1] = 0x01; // connect
-  request2[2] = 0x00; // reserved
-  request2[3] = 0x01; // IPv4
-  memcpy(request2 + 4, &addr, 4);
-  request2[8] = dstPort >> 8;
-  request2[9] = dstPort & 0xff;
-
-  if (write(sockFd_, request2, sizeof(request2)) != sizeof(request2))
+  // 应答长度取决于 BND.ADDR 类型，先读定长前缀再补齐
+  uint8_t response2[4 + 1 + 255 + 2];
+  if (!readFull(sockFd_, response2, 5))
     return false;
-
-  uint8_t response2[10];
-  if (read(sockFd_, response2, 10) != 10 || response2[1] != 0x00)
+  size_t replyLen = socks5::replyLength(response2, 5);
+  if (replyLen == socks5::kMalformedReply ||
+      !readFull(sockFd_, response2 + 5, replyLen - 5) ||
+      response2[1] != socks5::kReplySucceeded)
     return false;
 
   std::cout << "[TcpRelay] Connected via SOCKS5 to " << dstIp << ":" << dstPort
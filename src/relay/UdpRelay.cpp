@@ -0,0 +1,475 @@
+#include "relay/UdpRelay.h"
+#include "core/Checksum.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static constexpr size_t kBatch = 64;
+static constexpr size_t kSlotSize = 2048;
+// 回包解封装时 IP+UDP 头（28 字节）会覆盖 SOCKS 头（10 字节）及其前面的空间
+static constexpr size_t kHeadroom =
+    sizeof(iphdr) + sizeof(udphdr) - socks5::kUdpHeaderLen;
+static constexpr uint64_t kFlowIdleMs = 60000;
+static constexpr uint64_t kRetryMs = 1000;
+// 同一远端在各关联上都被占用时，空闲超过此时长的流可被新流接管
+static constexpr uint64_t kReassignMs = 2000;
+// 关联建立期间最多暂存的报文数
+static constexpr size_t kMaxPending = 256;
+
+size_t UdpRelay::FlowKeyHash::operator()(const FlowKey &k) const {
+  uint64_t h = k.client * 0x9E3779B97F4A7C15ULL ^ k.remote;
+  return h ^ (h >> 31);
+}
+
+UdpRelay::UdpRelay(const socks5::ProxyConfig &proxy, Output output,
+                   size_t numAssociations, size_t maxAssociations)
+    : proxy_(proxy), output_(std::move(output)),
+      baseAssocs_(numAssociations ? numAssociations : 1),
+      maxAssocs_(std::max(maxAssociations, baseAssocs_)),
+      assocs_(baseAssocs_),
+      rxBuf_(kBatch * kSlotSize) {}
+
+UdpRelay::~UdpRelay() { stop(); }
+
+uint64_t UdpRelay::makeKey(uint32_t ip, uint16_t port) {
+  return (uint64_t(ip) << 16) | port;
+}
+
+uint64_t UdpRelay::nowMs() {
+  auto now = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             now.time_since_epoch())
+      .count();
+}
+
+int UdpRelay::getEventFd() const { return epollFd_; }
+
+bool UdpRelay::start() {
+  epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd_ < 0) {
+    perror("[UdpRelay] epoll_create1");
+    return false;
+  }
+
+  for (size_t i = 0; i < assocs_.size(); ++i)
+    openAssociation(i);
+  std::cout << "[UdpRelay] Opening " << assocs_.size()
+            << " associations to " << proxy_.ip << ":" << proxy_.port
+            << "\n";
+  return true;
+}
+
+void UdpRelay::stop() {
+  for (size_t i = 0; i < assocs_.size(); ++i)
+    closeAssociation(i);
+  if (epollFd_ >= 0)
+    close(epollFd_);
+  epollFd_ = -1;
+}
+
+// 发起非阻塞连接，之后的握手由 poll() 中控制连接的事件推进
+bool UdpRelay::openAssociation(size_t idx) {
+  Association &a = assocs_[idx];
+  uint64_t now = nowMs();
+  a.retryAtMs = now + kRetryMs;
+  a.ctrlFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (a.ctrlFd < 0) {
+    perror("[UdpRelay] socket");
+    return false;
+  }
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(proxy_.port);
+  inet_pton(AF_INET, proxy_.ip.c_str(), &addr.sin_addr);
+  if (connect(a.ctrlFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) <
+          0 &&
+      errno != EINPROGRESS) {
+    closeAssociation(idx);
+    return false;
+  }
+  a.state = Association::Connecting;
+  a.deadlineMs = now + socks5::kHandshakeTimeoutMs;
+  a.replyLen = 0;
+
+  // data.u64：低位区分数据 socket 与控制连接；可写即连接完成
+  epoll_event ev{};
+  ev.events = EPOLLOUT;
+  ev.data.u64 = (idx << 1) | 1;
+  epoll_ctl(epollFd_, EPOLL_CTL_ADD, a.ctrlFd, &ev);
+  return true;
+}
+
+// 控制连接可读写时推进一步，返回 false 表示建立失败
+bool UdpRelay::advanceHandshake(size_t idx) {
+  Association &a = assocs_[idx];
+  if (a.state == Association::Connecting) {
+    int err = 0;
+    socklen_t errLen = sizeof(err);
+    auto greeting = socks5::buildGreeting();
+    if (getsockopt(a.ctrlFd, SOL_SOCKET, SO_ERROR, &err, &errLen) < 0 ||
+        err != 0 ||
+        send(a.ctrlFd, greeting.data(), greeting.size(), MSG_NOSIGNAL) !=
+            static_cast<ssize_t>(greeting.size()))
+      return false;
+    a.state = Association::Greeting;
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.u64 = (idx << 1) | 1;
+    epoll_ctl(epollFd_, EPOLL_CTL_MOD, a.ctrlFd, &ev);
+    return true;
+  }
+
+  for (;;) {
+    // 按已收到的前缀计算应答的完整长度
+    size_t need = 2;
+    if (a.state == Association::Requesting) {
+      need = a.replyLen < 5 ? 5 : socks5::replyLength(a.reply, a.replyLen);
+      if (need == socks5::kMalformedReply || need > sizeof(a.reply))
+        return false;
+    }
+    if (a.replyLen < need) {
+      ssize_t n = recv(a.ctrlFd, a.reply + a.replyLen, need - a.replyLen, 0);
+      if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return true; // 等待下一次可读
+      if (n <= 0)
+        return false;
+      a.replyLen += n;
+      continue;
+    }
+    if (a.state == Association::Requesting)
+      return finishAssociation(idx);
+
+    // 客户端地址填 0.0.0.0:0，表示由代理按首个报文的来源地址绑定
+    auto request = socks5::buildRequest(socks5::kCmdUdpAssociate, "0.0.0.0", 0);
+    if (!socks5::parseMethodReply(a.reply, a.replyLen) ||
+        send(a.ctrlFd, request.data(), request.size(), MSG_NOSIGNAL) !=
+            static_cast<ssize_t>(request.size()))
+      return false;
+    a.state = Association::Requesting;
+    a.replyLen = 0;
+  }
+}
+
+bool UdpRelay::finishAssociation(size_t idx) {
+  Association &a = assocs_[idx];
+  if (a.reply[1] != socks5::kReplySucceeded || a.reply[3] != socks5::kAtypIPv4)
+    return false;
+  uint32_t relayIp;
+  uint16_t relayPort;
+  memcpy(&relayIp, a.reply + 4, 4);
+  memcpy(&relayPort, a.reply + 8, 2);
+  // 代理回复 0.0.0.0 时表示与控制连接同一地址
+  if (relayIp == 0)
+    inet_pton(AF_INET, proxy_.ip.c_str(), &relayIp);
+
+  // connect 后收发无需携带地址，也过滤掉非中继来源的报文
+  a.udpFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  sockaddr_in relay{};
+  relay.sin_family = AF_INET;
+  relay.sin_addr.s_addr = relayIp;
+  relay.sin_port = relayPort;
+  if (a.udpFd < 0 ||
+      connect(a.udpFd, reinterpret_cast<sockaddr *>(&relay), sizeof(relay)) <
+          0) {
+    perror("[UdpRelay] connect relay");
+    return false;
+  }
+  int bufSize = 4 * 1024 * 1024;
+  setsockopt(a.udpFd, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+  setsockopt(a.udpFd, SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof(bufSize));
+
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.u64 = idx << 1;
+  epoll_ctl(epollFd_, EPOLL_CTL_ADD, a.udpFd, &ev);
+  a.state = Association::Ready;
+  if (idx < baseAssocs_)
+    std::cout << "[UdpRelay] Association " << idx << " ready\n";
+
+  // 发出建立期间暂存的报文
+  sendBatch(a);
+  return true;
+}
+
+// why 为空时不打印，代理不可达时每秒一次的重试失败不刷屏
+void UdpRelay::failAssociation(size_t idx, const char *why) {
+  if (why)
+    std::cerr << "[UdpRelay] Association " << idx << " " << why << "\n";
+  closeAssociation(idx);
+  assocs_[idx].retryAtMs = nowMs() + kRetryMs;
+}
+
+size_t UdpRelay::addAssociation() {
+  // 优先复用已回收的按需关联槽位，保持 epoll 中下标稳定
+  size_t idx = baseAssocs_;
+  while (idx < assocs_.size() && assocs_[idx].state != Association::Closed)
+    ++idx;
+  if (idx == maxAssocs_)
+    return assocs_.size();
+  if (idx == assocs_.size())
+    assocs_.emplace_back();
+  if (!openAssociation(idx))
+    return assocs_.size();
+  return idx;
+}
+
+void UdpRelay::closeAssociation(size_t idx) {
+  Association &a = assocs_[idx];
+  if (a.udpFd >= 0)
+    close(a.udpFd);
+  if (a.ctrlFd >= 0)
+    close(a.ctrlFd);
+  a.udpFd = a.ctrlFd = -1;
+  a.state = Association::Closed;
+  a.pending.clear();
+
+  // 关联失效后其上的流全部作废，后续报文会重新分配关联
+  for (const auto &kv : a.remotes)
+    flows_.erase(FlowKey{kv.second.client, kv.first});
+  a.remotes.clear();
+}
+
+// 按客户端地址散列选起点，跳过同一远端已被占用的关联。都被占用时接管
+// 其中已收到应答或空闲较久、且最久未活动的流；没有可接管的流才按需新建
+// 关联。无可用关联时返回 size()
+size_t UdpRelay::chooseAssociation(const FlowKey &key, uint64_t now) {
+  size_t n = assocs_.size();
+  size_t start = FlowKeyHash()(FlowKey{key.client, 0}) % n;
+  size_t victim = n;
+  uint64_t oldest = now;
+  bool anyOpen = false;
+  for (size_t k = 0; k < n; ++k) {
+    size_t idx = (start + k) % n;
+    Association &a = assocs_[idx];
+    if (a.state == Association::Closed)
+      continue;
+    anyOpen = true;
+    auto rit = a.remotes.find(key.remote);
+    if (rit == a.remotes.end())
+      return idx;
+    auto fit = flows_.find(FlowKey{rit->second.client, key.remote});
+    if (fit == flows_.end())
+      continue;
+    uint64_t seen = fit->second.lastSeenMs;
+    bool answered = rit->second.lastReplyMs >= seen;
+    if ((answered || now - seen >= kReassignMs) && seen <= oldest) {
+      oldest = seen;
+      victim = idx;
+    }
+  }
+
+  if (victim != n) {
+    // 旧流迟到的回包会交给接管它的新流，对请求-应答式的 UDP（DNS 等）无碍
+    Association &a = assocs_[victim];
+    flows_.erase(FlowKey{a.remotes[key.remote].client, key.remote});
+    a.remotes.erase(key.remote);
+    return victim;
+  }
+  // 常驻关联都在重连时说明代理不可达，不再逐包发起连接
+  return anyOpen ? addAssociation() : n;
+}
+
+bool UdpRelay::handlePacket(std::vector<uint8_t> &&packet) {
+  if (packet.size() < sizeof(iphdr))
+    return false;
+  const iphdr *ip = reinterpret_cast<const iphdr *>(packet.data());
+  size_t ipLen = ip->ihl * 4;
+  if (ip->protocol != IPPROTO_UDP || ip->ihl < 5 ||
+      packet.size() < ipLen + sizeof(udphdr))
+    return false;
+
+  const udphdr *udp = reinterpret_cast<const udphdr *>(packet.data() + ipLen);
+  size_t payloadOff = ipLen + sizeof(udphdr);
+  size_t udpLen = ntohs(udp->len);
+  if (udpLen < sizeof(udphdr) || ipLen + udpLen > packet.size())
+    return true;
+  size_t payloadLen = udpLen - sizeof(udphdr);
+
+  uint32_t remoteIp = ip->daddr;
+  uint16_t remotePort = udp->dest;
+  FlowKey key{makeKey(ip->saddr, udp->source), makeKey(remoteIp, remotePort)};
+  uint64_t now = nowMs();
+
+  auto it = flows_.find(key);
+  if (it == flows_.end()) {
+    size_t chosen = chooseAssociation(key, now);
+    if (chosen == assocs_.size()) {
+      ++dropped_;
+      return true;
+    }
+    assocs_[chosen].remotes[key.remote] = Peer{key.client, 0};
+    it = flows_.emplace(key, Flow{chosen, key.remote, now}).first;
+  }
+  it->second.lastSeenMs = now;
+
+  // 就地封装：SOCKS 头写进负载前原 IP/UDP 头所占的空间
+  size_t hdrOff = payloadOff - socks5::kUdpHeaderLen;
+  socks5::writeUdpHeader(packet.data() + hdrOff, remoteIp, remotePort);
+
+  Association &a = assocs_[it->second.assoc];
+  if (a.state != Association::Ready && a.pending.size() >= kMaxPending) {
+    ++dropped_;
+    return true;
+  }
+  a.pending.push_back(
+      {std::move(packet), hdrOff, socks5::kUdpHeaderLen + payloadLen});
+  if (a.state == Association::Ready && a.pending.size() >= kBatch)
+    sendBatch(a);
+  return true;
+}
+
+void UdpRelay::sendBatch(Association &a) {
+  if (a.pending.empty())
+    return;
+
+  mmsghdr msgs[kBatch];
+  iovec iov[kBatch];
+  size_t total = a.pending.size();
+  size_t done = 0;
+  while (done < total) {
+    size_t n = std::min(kBatch, total - done);
+    for (size_t i = 0; i < n; ++i) {
+      Pending &p = a.pending[done + i];
+      iov[i] = {p.packet.data() + p.offset, p.length};
+      msgs[i] = {};
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int sent = sendmmsg(a.udpFd, msgs, n, MSG_DONTWAIT);
+    if (sent <= 0) {
+      // 发送缓冲区满时按 UDP 语义丢弃剩余报文
+      dropped_ += total - done;
+      break;
+    }
+    done += sent;
+  }
+  a.pending.clear();
+}
+
+void UdpRelay::flush() {
+  for (auto &a : assocs_) {
+    if (a.state == Association::Ready)
+      sendBatch(a);
+  }
+}
+
+void UdpRelay::receiveBatch(size_t idx) {
+  Association &a = assocs_[idx];
+  mmsghdr msgs[kBatch];
+  iovec iov[kBatch];
+
+  for (;;) {
+    for (size_t i = 0; i < kBatch; ++i) {
+      iov[i] = {rxBuf_.data() + i * kSlotSize + kHeadroom,
+                kSlotSize - kHeadroom};
+      msgs[i] = {};
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int n = recvmmsg(a.udpFd, msgs, kBatch, MSG_DONTWAIT, nullptr);
+    if (n <= 0)
+      return;
+    uint64_t now = nowMs();
+
+    for (int i = 0; i < n; ++i) {
+      uint8_t *data = rxBuf_.data() + i * kSlotSize + kHeadroom;
+      size_t len = msgs[i].msg_len;
+      uint32_t remoteIp;
+      uint16_t remotePort;
+      size_t hdrLen = socks5::parseUdpHeader(data, len, remoteIp, remotePort);
+      if (hdrLen == 0)
+        continue;
+      auto rit = a.remotes.find(makeKey(remoteIp, remotePort));
+      if (rit == a.remotes.end())
+        continue;
+      rit->second.lastReplyMs = now;
+      uint32_t clientIp = rit->second.client >> 16;
+      uint16_t clientPort = rit->second.client & 0xffff;
+
+      // 就地解封装：在 SOCKS 头的位置向前铺上 IP/UDP 头
+      size_t payloadLen = len - hdrLen;
+      uint8_t *out = data + hdrLen - sizeof(iphdr) - sizeof(udphdr);
+      size_t outLen = sizeof(iphdr) + sizeof(udphdr) + payloadLen;
+      iphdr *ip = reinterpret_cast<iphdr *>(out);
+      *ip = {};
+      ip->version = 4;
+      ip->ihl = 5;
+      ip->tot_len = htons(outLen);
+      ip->id = htons(ipId_++);
+      ip->ttl = 64;
+      ip->protocol = IPPROTO_UDP;
+      ip->saddr = remoteIp;
+      ip->daddr = clientIp;
+      ip->check = ipChecksum(ip, sizeof(iphdr));
+
+      udphdr *udp = reinterpret_cast<udphdr *>(out + sizeof(iphdr));
+      udp->source = remotePort;
+      udp->dest = clientPort;
+      udp->len = htons(sizeof(udphdr) + payloadLen);
+      udp->check = 0; // IPv4 下 UDP 校验和可选，省去逐字节求和
+
+      output_(out, outLen);
+    }
+    if (n < static_cast<int>(kBatch))
+      return;
+  }
+}
+
+void UdpRelay::expireFlows(uint64_t now) {
+  for (auto it = flows_.begin(); it != flows_.end();) {
+    if (now - it->second.lastSeenMs > kFlowIdleMs) {
+      assocs_[it->second.assoc].remotes.erase(it->second.remoteKey);
+      it = flows_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  // 没有流的按需关联直接关闭
+  for (size_t i = baseAssocs_; i < assocs_.size(); ++i) {
+    if (assocs_[i].state != Association::Closed && assocs_[i].remotes.empty())
+      closeAssociation(i);
+  }
+}
+
+void UdpRelay::poll() {
+  epoll_event events[32];
+  int n = epoll_wait(epollFd_, events, 32, 0);
+  for (int i = 0; i < n; ++i) {
+    size_t idx = events[i].data.u64 >> 1;
+    Association &a = assocs_[idx];
+    if (a.state == Association::Closed)
+      continue;
+    if (!(events[i].data.u64 & 1)) {
+      receiveBatch(idx);
+    } else if (a.state == Association::Ready) {
+      // 控制连接上不应有数据，可读即代理关闭了关联
+      failAssociation(idx, "lost");
+    } else if (!advanceHandshake(idx)) {
+      failAssociation(idx, nullptr);
+    }
+  }
+
+  uint64_t now = nowMs();
+  for (size_t i = 0; i < assocs_.size(); ++i) {
+    Association &a = assocs_[i];
+    if (a.state == Association::Closed) {
+      if (i < baseAssocs_ && now >= a.retryAtMs)
+        openAssociation(i);
+    } else if (a.state != Association::Ready && now >= a.deadlineMs) {
+      failAssociation(i, nullptr);
+    }
+  }
+  if (now - lastExpireMs_ >= 1000) {
+    lastExpireMs_ = now;
+    expireFlows(now);
+  }
+}
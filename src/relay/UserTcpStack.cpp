@@ -0,0 +1,753 @@
+#include "relay/UserTcpStack.h"
+#include "core/Checksum.h"
+#include "relay/RelayManager.h"
+#include "relay/RingBuffer.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static constexpr uint16_t kOurMss = 1460;  // TUN MTU 1500
+static constexpr uint8_t kOurWscale = 7;   // 窗口上限 8 MiB
+static constexpr uint32_t kRecvWindow = 2 * 1024 * 1024;
+static constexpr size_t kSendBuffer = 512 * 1024;
+static constexpr uint32_t kMaxInflight = 1024 * 1024;
+static constexpr int kAppSockBuf = 1024 * 1024; // socketpair 单向缓冲
+static constexpr uint32_t kAckEveryBytes = 4 * kOurMss; // 累计多少未确认数据后立即 ACK
+static constexpr uint32_t kInitialRtoMs = 1000;
+static constexpr uint32_t kMinRtoMs = 200;
+static constexpr uint32_t kMaxRtoMs = 60000;
+static constexpr int kMaxRetries = 8;
+static constexpr uint64_t kTimerTickMs = 10;
+static constexpr uint64_t kLingerMs = 2000; // 双向关闭后保留，应答重传的 FIN
+static constexpr uint64_t kIdleTimeoutMs = 10 * 60 * 1000;
+
+static bool seqLt(uint32_t a, uint32_t b) {
+  return static_cast<int32_t>(a - b) < 0;
+}
+
+struct UserTcpStack::Conn {
+  enum State { SYN_RCVD, ESTABLISHED, CLOSED };
+
+  explicit Conn(const FlowKey &k) : key(k), sndBuf(kSendBuffer) {}
+
+  FlowKey key;
+  int appFd = -1; // socketpair 本端，另一端交给 RelayManager
+  State state = SYN_RCVD;
+  bool closed = false;
+
+  // 发送方向（本端 → 客户端）；sndBuf 保存未确认与未发送的数据
+  uint32_t iss = 0;
+  uint32_t sndUna = 0;
+  uint32_t sndNxt = 0;
+  uint32_t peerWnd = 0;
+  uint16_t peerMss = 536;
+  uint8_t peerWscale = 0;
+  bool wscaleOk = false;
+  RingBuffer sndBuf;
+  bool appReadable = false;
+  bool appEof = false;
+  bool finSent = false;
+  bool finAcked = false;
+  int dupAcks = 0;
+
+  // 接收方向（客户端 → 本端）
+  uint32_t rcvNxt = 0;
+  uint64_t rcvAbs = 0; // rcvNxt 对应的流内绝对偏移，用作乱序表的键
+  std::vector<uint8_t> rxPending; // 已按序到达、尚未写进 appFd 的数据
+  size_t rxOff = 0;
+  std::map<uint64_t, std::vector<uint8_t>> ooo;
+  size_t oooBytes = 0;
+  bool appWritable = false;
+  bool peerFin = false;
+  bool appShut = false;
+  uint32_t lastAdvWnd = 0;
+
+  // 确认与定时器
+  uint32_t unackedBytes = 0;
+  bool ackQueued = false; // 在 ackQueue_ 中，仅在出队时清除
+  bool ackOwed = false;   // 还欠客户端一个 ACK，发出任意段后清除
+  uint64_t rtoDeadline = 0; // 0 表示未启动
+  uint32_t rtoMs = kInitialRtoMs;
+  int retries = 0;
+  bool rttTiming = false;
+  uint32_t rttSeq = 0;
+  uint64_t rttStartMs = 0;
+  uint32_t srtt = 0;
+  uint32_t rttvar = 0;
+  uint64_t lingerUntil = 0;
+  uint64_t lastActivityMs = 0;
+
+  size_t rxPendingSize() const { return rxPending.size() - rxOff; }
+  // 已发出但未确认的数据字节（不含 SYN/FIN）
+  size_t dataInFlight() const {
+    return sndNxt - sndUna - (finSent && !finAcked ? 1 : 0);
+  }
+};
+
+size_t UserTcpStack::FlowKeyHash::operator()(const FlowKey &k) const {
+  uint64_t a = (uint64_t(k.srcIp) << 32) | k.dstIp;
+  uint64_t b = (uint64_t(k.srcPort) << 16) | k.dstPort;
+  uint64_t h = a * 0x9E3779B97F4A7C15ULL ^ (b + 0x632BE59BD9B4E019ULL);
+  return h ^ (h >> 29);
+}
+
+UserTcpStack::UserTcpStack(RelayManager &relay, Output output)
+    : relay_(relay), output_(std::move(output)), rng_(std::random_device{}()) {
+  epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd_ < 0)
+    perror("[UserTcpStack] epoll_create1");
+}
+
+UserTcpStack::~UserTcpStack() {
+  for (auto &kv : conns_) {
+    if (kv.second->appFd >= 0)
+      ::close(kv.second->appFd);
+  }
+  if (epollFd_ >= 0)
+    ::close(epollFd_);
+}
+
+int UserTcpStack::getEventFd() const { return epollFd_; }
+
+size_t UserTcpStack::connectionCount() const { return conns_.size(); }
+
+int UserTcpStack::nextTimeoutMs(int maxMs) const {
+  if (!ackQueue_.empty())
+    return 0;
+  return conns_.empty() ? maxMs : std::min<int>(maxMs, kTimerTickMs);
+}
+
+uint64_t UserTcpStack::nowMs() {
+  auto now = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             now.time_since_epoch())
+      .count();
+}
+
+bool UserTcpStack::handlePacket(const std::vector<uint8_t> &packet) {
+  if (packet.size() < sizeof(iphdr))
+    return false;
+  const iphdr *ip = reinterpret_cast<const iphdr *>(packet.data());
+  size_t ipLen = ip->ihl * 4;
+  size_t totLen = std::min<size_t>(ntohs(ip->tot_len), packet.size());
+  if (ip->protocol != IPPROTO_TCP || ip->ihl < 5 ||
+      totLen < ipLen + sizeof(tcphdr))
+    return false;
+
+  const tcphdr *tcp = reinterpret_cast<const tcphdr *>(packet.data() + ipLen);
+  size_t tcpLen = tcp->doff * 4;
+  if (tcpLen < sizeof(tcphdr) || totLen < ipLen + tcpLen)
+    return true;
+
+  FlowKey key{ip->saddr, ip->daddr, tcp->source, tcp->dest};
+  uint32_t seq = ntohl(tcp->seq);
+  uint32_t ack = ntohl(tcp->ack_seq);
+  const uint8_t *payload = packet.data() + ipLen + tcpLen;
+  size_t payloadLen = totLen - ipLen - tcpLen;
+
+  auto it = conns_.find(key);
+  Conn *c = it == conns_.end() ? nullptr : it->second.get();
+
+  if (c && c->state == Conn::CLOSED) {
+    // 关闭后的逗留期：重传的 FIN 说明对端没收到我们的 ACK
+    if (tcp->fin && !tcp->rst)
+      sendAck(*c);
+    return true;
+  }
+
+  if (!c) {
+    if (tcp->rst)
+      return true;
+    if (tcp->syn && !tcp->ack) {
+      c = accept(key, seq, packet.data() + ipLen + sizeof(tcphdr),
+                 tcpLen - sizeof(tcphdr));
+      if (c)
+        sendSynAck(*c);
+      else
+        sendReset(key, 0, seq + 1, true);
+      return true;
+    }
+    uint32_t segLen = payloadLen + tcp->syn + tcp->fin;
+    sendReset(key, tcp->ack ? ack : 0, seq + segLen, !tcp->ack);
+    return true;
+  }
+
+  c->lastActivityMs = nowMs();
+
+  if (tcp->rst) {
+    close(*c, false);
+    reap();
+    return true;
+  }
+
+  if (tcp->syn) {
+    // 客户端没收到 SYN-ACK 而重传了 SYN
+    if (c->state == Conn::SYN_RCVD && seq + 1 == c->rcvNxt)
+      sendSynAck(*c);
+    return true;
+  }
+
+  if (!tcp->ack)
+    return true;
+
+  uint16_t window = ntohs(tcp->window);
+  if (c->state == Conn::SYN_RCVD) {
+    if (ack != c->iss + 1) {
+      sendReset(key, ack, 0, false);
+      return true;
+    }
+    c->state = Conn::ESTABLISHED;
+    c->sndUna = ack;
+    c->rtoDeadline = 0;
+    c->retries = 0;
+  }
+
+  processAck(*c, ack, window, payloadLen == 0 && !tcp->fin);
+  if (payloadLen > 0 || tcp->fin)
+    processData(*c, seq, payload, payloadLen, tcp->fin);
+  if (!c->closed)
+    service(*c);
+  reap();
+  return true;
+}
+
+UserTcpStack::Conn *UserTcpStack::accept(const FlowKey &key, uint32_t seq,
+                                         const uint8_t *opts, size_t optLen) {
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv) <
+      0) {
+    perror("[UserTcpStack] socketpair");
+    return nullptr;
+  }
+  for (int fd : sv) {
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &kAppSockBuf, sizeof(kAppSockBuf));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &kAppSockBuf, sizeof(kAppSockBuf));
+  }
+
+  char dstStr[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &key.dstIp, dstStr, sizeof(dstStr));
+  // openSession 失败时会自行关闭 sv[1]
+  if (relay_.openSession(sv[1], dstStr, ntohs(key.dstPort)) == 0) {
+    ::close(sv[0]);
+    return nullptr;
+  }
+
+  auto conn = std::make_unique<Conn>(key);
+  Conn &c = *conn;
+  c.appFd = sv[0];
+  c.iss = rng_();
+  c.sndUna = c.iss;
+  c.sndNxt = c.iss + 1;
+  c.rcvNxt = seq + 1;
+  c.lastActivityMs = nowMs();
+
+  // 解析 SYN 选项：MSS 与窗口缩放
+  size_t i = 0;
+  while (i < optLen) {
+    uint8_t kind = opts[i];
+    if (kind == TCPOPT_EOL)
+      break;
+    if (kind == TCPOPT_NOP) {
+      ++i;
+      continue;
+    }
+    if (i + 1 >= optLen || opts[i + 1] < 2 || i + opts[i + 1] > optLen)
+      break;
+    uint8_t len = opts[i + 1];
+    if (kind == TCPOPT_MAXSEG && len == TCPOLEN_MAXSEG)
+      c.peerMss = (opts[i + 2] << 8) | opts[i + 3];
+    else if (kind == TCPOPT_WINDOW && len == TCPOLEN_WINDOW) {
+      c.wscaleOk = true;
+      c.peerWscale = std::min<uint8_t>(opts[i + 2], 14);
+    }
+    i += len;
+  }
+  c.peerMss = std::min(c.peerMss, kOurMss);
+
+  epoll_event ev{};
+  ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  ev.data.ptr = &c;
+  if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, c.appFd, &ev) < 0) {
+    perror("[UserTcpStack] epoll_ctl");
+    ::close(c.appFd);
+    return nullptr;
+  }
+
+  conns_.emplace(key, std::move(conn));
+  return &c;
+}
+
+uint32_t UserTcpStack::receiveWindow(const Conn &c) const {
+  size_t used = c.rxPendingSize() + c.oooBytes;
+  return used >= kRecvWindow ? 0 : kRecvWindow - used;
+}
+
+void UserTcpStack::processAck(Conn &c, uint32_t ack, uint16_t window,
+                              bool pureAck) {
+  // SYN 中的窗口不缩放，之后的窗口都要按协商结果左移
+  c.peerWnd = uint32_t(window) << (c.wscaleOk ? c.peerWscale : 0);
+
+  if (seqLt(c.sndNxt, ack))
+    return; // 确认了尚未发送的数据，忽略
+
+  if (seqLt(c.sndUna, ack)) {
+    uint32_t acked = ack - c.sndUna;
+    if (c.finSent && ack == c.sndNxt) {
+      c.finAcked = true;
+      --acked;
+    }
+    c.sndBuf.consume(acked);
+    c.sndUna = ack;
+    c.dupAcks = 0;
+    c.retries = 0;
+
+    // Karn 算法：只用未重传过的段采样 RTT
+    if (c.rttTiming && seqLt(c.rttSeq, ack)) {
+      uint64_t now = nowMs();
+      uint32_t sample = now - c.rttStartMs;
+      if (c.srtt == 0) {
+        c.srtt = sample;
+        c.rttvar = sample / 2;
+      } else {
+        uint32_t delta = c.srtt > sample ? c.srtt - sample : sample - c.srtt;
+        c.rttvar = (3 * c.rttvar + delta) / 4;
+        c.srtt = (7 * c.srtt + sample) / 8;
+      }
+      c.rttTiming = false;
+    }
+    c.rtoMs = std::clamp<uint32_t>(c.srtt + 4 * c.rttvar, kMinRtoMs, kMaxRtoMs);
+    c.rtoDeadline = 0;
+    if (c.sndNxt != c.sndUna)
+      armRto(c, nowMs());
+    return;
+  }
+
+  // 三个重复 ACK 触发快速重传队首的一个段
+  if (pureAck && ack == c.sndUna && c.dataInFlight() > 0 &&
+      ++c.dupAcks == 3) {
+    size_t len = std::min<size_t>(c.dataInFlight(), c.peerMss);
+    sendSegment(c, TH_ACK, c.sndUna, 0, len);
+    c.rttTiming = false;
+  }
+}
+
+void UserTcpStack::processData(Conn &c, uint32_t seq, const uint8_t *data,
+                               size_t len, bool fin) {
+  // 裁掉已经收到过的前缀
+  if (seqLt(seq, c.rcvNxt)) {
+    uint32_t dup = c.rcvNxt - seq;
+    if (dup > len || (dup == len && !fin)) {
+      sendAck(c); // 纯重复段，立即确认帮助对端恢复
+      return;
+    }
+    data += dup;
+    len -= dup;
+    seq = c.rcvNxt;
+  }
+
+  if (seq != c.rcvNxt) {
+    // 乱序段：窗口内的暂存，并立即发送重复 ACK 触发对端快速重传
+    uint64_t off = c.rcvAbs + (seq - c.rcvNxt);
+    if (len > 0 && off + len - c.rcvAbs <= receiveWindow(c)) {
+      auto &slot = c.ooo[off];
+      if (slot.size() < len) {
+        c.oooBytes += len - slot.size();
+        slot.assign(data, data + len);
+      }
+    }
+    sendAck(c);
+    return;
+  }
+
+  if (len > 0) {
+    // 写 appFd 失败时 deliver 会关闭连接，此后不能再动 c 的状态与 ACK 队列
+    deliver(c, data, len);
+    if (c.closed)
+      return;
+    c.rcvNxt += len;
+    c.rcvAbs += len;
+    c.unackedBytes += len;
+
+    // 把与新 rcvNxt 衔接上的乱序段依次交付
+    while (!c.ooo.empty() && c.ooo.begin()->first <= c.rcvAbs) {
+      auto node = c.ooo.begin();
+      uint64_t end = node->first + node->second.size();
+      c.oooBytes -= node->second.size();
+      if (end > c.rcvAbs) {
+        size_t skip = c.rcvAbs - node->first;
+        size_t more = end - c.rcvAbs;
+        deliver(c, node->second.data() + skip, more);
+        if (c.closed)
+          return;
+        c.rcvNxt += more;
+        c.rcvAbs += more;
+        c.unackedBytes += more;
+      }
+      c.ooo.erase(node);
+    }
+  }
+
+  if (fin && c.ooo.empty() && !c.peerFin) {
+    c.peerFin = true;
+    c.rcvNxt += 1;
+    sendAck(c);
+    return;
+  }
+
+  if (c.unackedBytes >= kAckEveryBytes)
+    sendAck(c);
+  else
+    queueAck(c);
+}
+
+void UserTcpStack::deliver(Conn &c, const uint8_t *data, size_t len) {
+  // 前面还有积压时必须排队，保证写入 appFd 的顺序
+  if (c.rxPendingSize() == 0) {
+    ssize_t n = write(c.appFd, data, len);
+    if (n < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        close(c, true);
+        return;
+      }
+      n = 0;
+      c.appWritable = false;
+    }
+    data += n;
+    len -= n;
+  }
+  if (len > 0)
+    c.rxPending.insert(c.rxPending.end(), data, data + len);
+}
+
+void UserTcpStack::service(Conn &c) {
+  // 先把积压的数据写进 appFd，窗口随之打开
+  if (c.appWritable && c.rxPendingSize() > 0) {
+    ssize_t n = write(c.appFd, c.rxPending.data() + c.rxOff, c.rxPendingSize());
+    if (n > 0) {
+      c.rxOff += n;
+      if (c.rxPendingSize() == 0) {
+        c.rxPending.clear();
+        c.rxOff = 0;
+      } else if (c.rxOff > c.rxPending.size() / 2) {
+        c.rxPending.erase(c.rxPending.begin(), c.rxPending.begin() + c.rxOff);
+        c.rxOff = 0;
+      }
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      c.appWritable = false;
+    } else if (n < 0) {
+      close(c, true);
+      return;
+    }
+
+    // 窗口从很小重新打开时主动通告，避免对端一直等零窗口探测
+    uint32_t wnd = receiveWindow(c);
+    if (wnd >= c.lastAdvWnd + 2 * kOurMss && c.lastAdvWnd < kRecvWindow / 2)
+      queueAck(c);
+  }
+  if (c.peerFin && c.rxPendingSize() == 0 && !c.appShut) {
+    shutdown(c.appFd, SHUT_WR);
+    c.appShut = true;
+  }
+
+  trySend(c);
+
+  if (c.peerFin && c.finAcked && c.appShut && !c.closed) {
+    c.state = Conn::CLOSED;
+    c.lingerUntil = nowMs() + kLingerMs;
+    ::close(c.appFd);
+    c.appFd = -1;
+    c.rtoDeadline = 0;
+  }
+}
+
+void UserTcpStack::trySend(Conn &c) {
+  if (c.state != Conn::ESTABLISHED || c.closed)
+    return;
+
+  for (;;) {
+    size_t inFlight = c.dataInFlight();
+    size_t unsent = c.sndBuf.size() - inFlight;
+
+    if (unsent == 0 && c.appReadable && !c.appEof && !c.sndBuf.full()) {
+      ssize_t n = c.sndBuf.readFrom(c.appFd);
+      if (n > 0)
+        continue;
+      if (n == 0) {
+        c.appEof = true;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        c.appReadable = false;
+      } else {
+        close(c, true);
+        return;
+      }
+      continue;
+    }
+
+    size_t wnd = std::min<size_t>(c.peerWnd, kMaxInflight);
+    size_t usable = wnd > inFlight ? wnd - inFlight : 0;
+    size_t len = std::min({unsent, usable, size_t(c.peerMss)});
+    // 避免糊涂窗口：不足一个 MSS 时只在能发完全部待发数据时发送
+    if (len == 0 || (len < c.peerMss && len < unsent && inFlight > 0))
+      break;
+
+    uint8_t flags = TH_ACK | (len == unsent ? TH_PUSH : 0);
+    sendSegment(c, flags, c.sndNxt, inFlight, len);
+    if (!c.rttTiming) {
+      c.rttTiming = true;
+      c.rttSeq = c.sndNxt;
+      c.rttStartMs = nowMs();
+    }
+    c.sndNxt += len;
+    if (c.rtoDeadline == 0)
+      armRto(c, nowMs());
+
+    // 还有空间时顺便从 appFd 补充数据
+    if (c.appReadable && !c.appEof && !c.sndBuf.full()) {
+      ssize_t n = c.sndBuf.readFrom(c.appFd);
+      if (n == 0)
+        c.appEof = true;
+      else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        c.appReadable = false;
+      else if (n < 0) {
+        close(c, true);
+        return;
+      }
+    }
+  }
+
+  size_t unsent = c.sndBuf.size() - c.dataInFlight();
+  if (c.appEof && !c.finSent && unsent == 0) {
+    sendSegment(c, TH_FIN | TH_ACK, c.sndNxt, 0, 0);
+    c.sndNxt += 1;
+    c.finSent = true;
+    if (c.rtoDeadline == 0)
+      armRto(c, nowMs());
+  }
+  // 对端零窗口且有数据待发：借用重传定时器做窗口探测
+  if (unsent > 0 && c.peerWnd == 0 && c.rtoDeadline == 0)
+    armRto(c, nowMs());
+}
+
+void UserTcpStack::armRto(Conn &c, uint64_t now) {
+  c.rtoDeadline = now + c.rtoMs;
+}
+
+void UserTcpStack::queueAck(Conn &c) {
+  // 已关闭的连接随时会被 reap 释放，不能再进 ackQueue_
+  if (c.closed)
+    return;
+  c.ackOwed = true;
+  if (!c.ackQueued) {
+    c.ackQueued = true;
+    ackQueue_.push_back(&c);
+  }
+}
+
+void UserTcpStack::flush() {
+  for (Conn *c : ackQueue_) {
+    if (!c->closed && c->ackOwed)
+      sendAck(*c);
+    c->ackQueued = false;
+  }
+  ackQueue_.clear();
+  reap();
+}
+
+void UserTcpStack::poll() {
+  epoll_event events[256];
+  int n = epoll_wait(epollFd_, events, 256, 0);
+  for (int i = 0; i < n; ++i) {
+    Conn &c = *static_cast<Conn *>(events[i].data.ptr);
+    if (c.closed || c.appFd < 0)
+      continue;
+    if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+      c.appReadable = true;
+    if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+      c.appWritable = true;
+    c.lastActivityMs = nowMs();
+    service(c);
+  }
+
+  uint64_t now = nowMs();
+  if (now - lastTimerScanMs_ >= kTimerTickMs) {
+    lastTimerScanMs_ = now;
+    for (auto &kv : conns_) {
+      if (!kv.second->closed)
+        onTimer(*kv.second, now);
+    }
+  }
+  reap();
+}
+
+void UserTcpStack::onTimer(Conn &c, uint64_t now) {
+  if (c.state == Conn::CLOSED) {
+    if (now >= c.lingerUntil)
+      close(c, false);
+    return;
+  }
+  if (now - c.lastActivityMs > kIdleTimeoutMs) {
+    close(c, true);
+    return;
+  }
+  if (c.rtoDeadline == 0 || now < c.rtoDeadline)
+    return;
+
+  if (++c.retries > kMaxRetries) {
+    std::cerr << "[UserTcpStack] Retransmission limit reached, reset\n";
+    close(c, true);
+    return;
+  }
+  c.rtoMs = std::min(c.rtoMs * 2, kMaxRtoMs);
+  c.rtoDeadline = 0;
+  c.rttTiming = false;
+
+  if (c.state == Conn::SYN_RCVD) {
+    sendSynAck(c);
+    armRto(c, now);
+    return;
+  }
+
+  size_t unsent = c.sndBuf.size() - c.dataInFlight();
+  if (c.sndNxt == c.sndUna && c.peerWnd == 0 && unsent > 0) {
+    // 零窗口探测：无视窗口发送 1 字节
+    sendSegment(c, TH_ACK, c.sndNxt, 0, 1);
+    c.sndNxt += 1;
+    armRto(c, now);
+    return;
+  }
+
+  // 超时重传采用回退 N：从 sndUna 开始重发，FIN 也随之重发
+  c.sndNxt = c.sndUna;
+  c.finSent = false;
+  c.finAcked = false;
+  trySend(c);
+  if (c.rtoDeadline == 0 && c.sndNxt != c.sndUna)
+    armRto(c, now);
+}
+
+std::vector<uint8_t> UserTcpStack::makePacket(const FlowKey &key,
+                                              uint8_t flags, uint32_t seq,
+                                              uint32_t ack, uint16_t window,
+                                              size_t optLen,
+                                              size_t payloadLen) {
+  size_t tcpLen = sizeof(tcphdr) + optLen;
+  std::vector<uint8_t> packet(sizeof(iphdr) + tcpLen + payloadLen);
+
+  // 回包方向：远端 → 客户端
+  iphdr *ip = reinterpret_cast<iphdr *>(packet.data());
+  ip->version = 4;
+  ip->ihl = 5;
+  ip->tot_len = htons(packet.size());
+  ip->id = htons(ipId_++);
+  ip->frag_off = htons(IP_DF);
+  ip->ttl = 64;
+  ip->protocol = IPPROTO_TCP;
+  ip->saddr = key.dstIp;
+  ip->daddr = key.srcIp;
+
+  tcphdr *tcp = reinterpret_cast<tcphdr *>(packet.data() + sizeof(iphdr));
+  tcp->source = key.dstPort;
+  tcp->dest = key.srcPort;
+  tcp->seq = htonl(seq);
+  tcp->ack_seq = htonl(ack);
+  tcp->doff = tcpLen / 4;
+  tcp->th_flags = flags;
+  tcp->window = htons(window);
+  return packet;
+}
+
+void UserTcpStack::finalize(std::vector<uint8_t> &packet) {
+  iphdr *ip = reinterpret_cast<iphdr *>(packet.data());
+  tcphdr *tcp = reinterpret_cast<tcphdr *>(packet.data() + sizeof(iphdr));
+  ip->check = 0;
+  ip->check = ipChecksum(ip, sizeof(iphdr));
+  tcp->check = 0;
+  tcp->check = l4Checksum(ip->saddr, ip->daddr, IPPROTO_TCP, tcp,
+                          packet.size() - sizeof(iphdr));
+  output_(packet);
+}
+
+void UserTcpStack::sendSegment(Conn &c, uint8_t flags, uint32_t seq,
+                               size_t dataOffset, size_t len) {
+  uint32_t wnd = receiveWindow(c);
+  uint16_t field = std::min<uint32_t>(wnd >> (c.wscaleOk ? kOurWscale : 0),
+                                      0xffff);
+  c.lastAdvWnd = uint32_t(field) << (c.wscaleOk ? kOurWscale : 0);
+
+  auto packet = makePacket(c.key, flags, seq, c.rcvNxt, field, 0, len);
+  if (len > 0)
+    c.sndBuf.peek(dataOffset, packet.data() + sizeof(iphdr) + sizeof(tcphdr),
+                  len);
+  finalize(packet);
+
+  // 每个段都捎带 ACK，排队中的纯 ACK 可以省掉
+  c.unackedBytes = 0;
+  c.ackOwed = false;
+}
+
+void UserTcpStack::sendAck(Conn &c) {
+  if (!c.closed)
+    sendSegment(c, TH_ACK, c.sndNxt, 0, 0);
+}
+
+void UserTcpStack::sendSynAck(Conn &c) {
+  // SYN-ACK 中的窗口字段不缩放
+  size_t optLen = c.wscaleOk ? 8 : 4;
+  auto packet = makePacket(c.key, TH_SYN | TH_ACK, c.iss, c.rcvNxt, 0xffff,
+                           optLen, 0);
+  uint8_t *opt = packet.data() + sizeof(iphdr) + sizeof(tcphdr);
+  opt[0] = TCPOPT_MAXSEG;
+  opt[1] = TCPOLEN_MAXSEG;
+  opt[2] = kOurMss >> 8;
+  opt[3] = kOurMss & 0xff;
+  if (c.wscaleOk) {
+    opt[4] = TCPOPT_NOP;
+    opt[5] = TCPOPT_WINDOW;
+    opt[6] = TCPOLEN_WINDOW;
+    opt[7] = kOurWscale;
+  }
+  finalize(packet);
+  if (c.rtoDeadline == 0)
+    armRto(c, nowMs());
+}
+
+void UserTcpStack::sendReset(const FlowKey &key, uint32_t seq, uint32_t ack,
+                             bool withAck) {
+  auto packet = makePacket(key, TH_RST | (withAck ? TH_ACK : 0), seq, ack, 0,
+                           0, 0);
+  finalize(packet);
+}
+
+void UserTcpStack::close(Conn &c, bool reset) {
+  if (c.closed)
+    return;
+  if (reset && c.state != Conn::CLOSED)
+    sendReset(c.key, c.sndNxt, c.rcvNxt, true);
+  if (c.appFd >= 0)
+    ::close(c.appFd); // RelayManager 侧随后读到 EOF 并结束会话
+  c.appFd = -1;
+  c.closed = true;
+  if (c.ackQueued) {
+    ackQueue_.erase(std::find(ackQueue_.begin(), ackQueue_.end(), &c));
+    c.ackQueued = false;
+  }
+  closed_.push_back(c.key);
+}
+
+// handlePacket / poll 的调用链中可能还持有 Conn 指针，统一在末尾回收
+void UserTcpStack::reap() {
+  if (closed_.empty())
+    return;
+  for (const auto &key : closed_)
+    conns_.erase(key);
+  closed_.clear();
+}
@@ -1,16 +1,52 @@
 #include "routing/DynamicRouteProvider.h"
+#include <algorithm>
 #include <arpa/inet.h>
 #include <chrono>
 #include <cstring>
 #include <iostream>
+#include <linux/pkt_sched.h>
 #include <netinet/in.h>
-#include <sstream>
+#include <netinet/ip.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+// 报文格式（网络字节序）：
+//   头部 12 字节：magic(2) version(1) flags(1) count(2) reserved(2) router(4)
+//   路由 10 字节：dest(4) nextHop(4) prefixLen(1) metric(1)
+static constexpr uint16_t kMagic = 0x5752; // "WR"
+static constexpr uint8_t kVersion = 1;
+static constexpr uint8_t kFlagFull = 0x01;
+static constexpr size_t kHeaderLen = 12;
+static constexpr size_t kEntryLen = 10;
+static constexpr size_t kMaxDatagram = 1472; // 以太网 MTU 内不分片
+static constexpr size_t kEntriesPerDatagram =
+    (kMaxDatagram - kHeaderLen) / kEntryLen;
+
+static constexpr uint8_t kInfinity = 16;
+static constexpr uint64_t kPeriodicMs = 30000;     // 全量保活
+static constexpr uint64_t kTimeoutMs = 90000;      // 3 次未刷新即失效
+static constexpr uint64_t kGarbageMs = 60000;      // 失效后保留并通告的时间
+static constexpr uint64_t kTriggerDelayMs = 2;     // 合并同一时刻的多次变化
+static constexpr size_t kMaxPaths = 8;             // 等价下一跳上限
+
+static uint32_t prefixToMask(uint8_t prefixLen) {
+  return prefixLen == 0 ? 0 : htonl(~uint32_t(0) << (32 - prefixLen));
+}
+
+static uint8_t maskToPrefix(uint32_t mask) {
+  return __builtin_popcount(mask);
+}
+
+static std::string addrToString(uint32_t addr) {
+  in_addr a;
+  a.s_addr = addr;
+  return inet_ntoa(a);
+}
+
 DynamicRouteProvider::DynamicRouteProvider(const std::string &iface,
                                            const std::string &localIp)
-    : iface_(iface), localIp_(localIp), running_(false) {}
+    : iface_(iface), localIp_(localIp), localAddr_(inet_addr(localIp.c_str())),
+      running_(false) {}
 
 DynamicRouteProvider::~DynamicRouteProvider() { stop(); }
 
@@ -21,47 +57,224 @@ void DynamicRouteProvider::start() {
 }
 
 void DynamicRouteProvider::stop() {
-  running_ = false;
+  {
+    std::lock_guard<std::mutex> lock(routeMutex_);
+    running_ = false;
+  }
+  triggerCv_.notify_all();
   if (sendThread_.joinable())
     sendThread_.join();
   if (recvThread_.joinable())
     recvThread_.join();
 }
 
+uint64_t DynamicRouteProvider::makeKey(uint32_t dest, uint8_t prefixLen) {
+  return (uint64_t(dest) << 8) | prefixLen;
+}
+
+uint64_t DynamicRouteProvider::nowMs() {
+  auto now = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             now.time_since_epoch())
+      .count();
+}
+
+void DynamicRouteProvider::markChanged(Route &route) {
+  route.changed = true;
+  pendingTrigger_ = true;
+  triggerCv_.notify_one();
+}
+
+void DynamicRouteProvider::updateGroup(Route &route) {
+  if (route.alternates.empty()) {
+    route.group.reset();
+    return;
+  }
+  std::vector<NextHop> hops{{addrToString(route.gateway), iface_}};
+  for (const auto &alt : route.alternates)
+    hops.push_back({addrToString(alt.gateway), iface_});
+  // 在原分配上增量调整，仍在的下一跳上的流不受影响
+  route.group = route.group ? route.group->withNextHops(std::move(hops))
+                            : std::make_shared<EcmpGroup>(std::move(hops));
+}
+
+bool DynamicRouteProvider::promoteAlternate(Route &route) {
+  if (route.alternates.empty())
+    return false;
+  route.gateway = route.alternates.front().gateway;
+  route.updatedMs = route.alternates.front().updatedMs;
+  route.alternates.erase(route.alternates.begin());
+  updateGroup(route);
+  return true;
+}
+
+void DynamicRouteProvider::advertise(const std::string &dest,
+                                     const std::string &netmask, int metric) {
+  uint32_t mask = inet_addr(netmask.c_str());
+  uint8_t prefixLen = maskToPrefix(mask);
+  uint32_t net = inet_addr(dest.c_str()) & mask;
+
+  std::lock_guard<std::mutex> lock(routeMutex_);
+  Route &r = routeTable_[makeKey(net, prefixLen)];
+  uint8_t m = std::min(metric, int(kInfinity));
+  r = Route{net, prefixLen, 0, m, true, false, nowMs(), {}, nullptr};
+  prefixMask_ |= 1ULL << prefixLen;
+  markChanged(r);
+}
+
+void DynamicRouteProvider::withdraw(const std::string &dest,
+                                    const std::string &netmask) {
+  uint32_t mask = inet_addr(netmask.c_str());
+  uint8_t prefixLen = maskToPrefix(mask);
+  uint32_t net = inet_addr(dest.c_str()) & mask;
+
+  std::lock_guard<std::mutex> lock(routeMutex_);
+  auto it = routeTable_.find(makeKey(net, prefixLen));
+  if (it == routeTable_.end() || !it->second.local)
+    return;
+  // 不可达状态保留一个回收期，让邻居尽快收到撤销
+  it->second.local = false;
+  it->second.alternates.clear();
+  updateGroup(it->second);
+  it->second.metric = kInfinity;
+  it->second.updatedMs = nowMs() - kTimeoutMs;
+  markChanged(it->second);
+}
+
+// 在 routeMutex_ 下把待通告的路由序列化成若干数据报，发送在锁外进行
+std::vector<std::vector<uint8_t>>
+DynamicRouteProvider::serializeRoutes(bool full) {
+  std::vector<std::vector<uint8_t>> datagrams;
+  uint8_t buf[kMaxDatagram];
+  size_t count = 0;
+  auto flush = [&]() {
+    if (count == 0)
+      return;
+    uint16_t magic = htons(kMagic), n = htons(count), reserved = 0;
+    memcpy(buf, &magic, 2);
+    buf[2] = kVersion;
+    buf[3] = full ? kFlagFull : 0;
+    memcpy(buf + 4, &n, 2);
+    memcpy(buf + 6, &reserved, 2);
+    memcpy(buf + 8, &localAddr_, 4);
+    datagrams.emplace_back(buf, buf + kHeaderLen + count * kEntryLen);
+    count = 0;
+  };
+
+  for (auto &kv : routeTable_) {
+    Route &r = kv.second;
+    if (!full && !r.changed)
+      continue;
+    r.changed = false;
+    uint8_t *e = buf + kHeaderLen + count * kEntryLen;
+    memcpy(e, &r.dest, 4);
+    memcpy(e + 4, &r.gateway, 4);
+    e[8] = r.prefixLen;
+    e[9] = r.metric;
+    if (++count == kEntriesPerDatagram)
+      flush();
+  }
+  flush();
+  return datagrams;
+}
+
 void DynamicRouteProvider::sendLoop() {
   int sock = socket(AF_INET, SOCK_DGRAM, 0);
   if (sock < 0)
     return;
 
+  int broadcast = 1;
+  setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+  // 更新报文走本机 qdisc 的控制优先级，并标为网络控制流量（CS6），
+  // 数据面拥塞时邻居与中间设备也能优先转发
+  int priority = TC_PRIO_CONTROL;
+  setsockopt(sock, SOL_SOCKET, SO_PRIORITY, &priority, sizeof(priority));
+  int tos = IPTOS_PREC_INTERNETCONTROL;
+  setsockopt(sock, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
   sockaddr_in addr{};
   addr.sin_family = AF_INET;
-  addr.sin_port = htons(54321);
+  addr.sin_port = htons(kPort);
   addr.sin_addr.s_addr = inet_addr("255.255.255.255");
 
-  int broadcast = 1;
-  setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
-
+  uint64_t nextFull = nowMs() + kPeriodicMs;
+  std::vector<std::vector<uint8_t>> datagrams;
+  std::unique_lock<std::mutex> lock(routeMutex_);
   while (running_) {
-    std::this_thread::sleep_for(std::chrono::seconds(10));
+    triggerCv_.wait_for(lock, std::chrono::milliseconds(1000), [this] {
+      return pendingTrigger_ || !running_;
+    });
+    if (!running_)
+      break;
 
-    std::lock_guard<std::mutex> lock(routeMutex_);
-    for (const auto &route : routeTable_) {
-      std::string msg = route.dest + " " + route.netmask + " " + localIp_ +
-                        " " + iface_ + " " + std::to_string(route.metric);
-      sendto(sock, msg.c_str(), msg.size(), 0, (sockaddr *)&addr, sizeof(addr));
+    uint64_t now = nowMs();
+    expireRoutes(now);
+    if (now >= nextFull) {
+      datagrams = serializeRoutes(true);
+      nextFull = now + kPeriodicMs;
+      pendingTrigger_ = false;
+    } else if (pendingTrigger_) {
+      // 稍等片刻把同一批变化合并到一次触发更新里
+      lock.unlock();
+      std::this_thread::sleep_for(std::chrono::milliseconds(kTriggerDelayMs));
+      lock.lock();
+      pendingTrigger_ = false;
+      datagrams = serializeRoutes(false);
     }
+    if (datagrams.empty())
+      continue;
+
+    // sendto 可能阻塞，期间不挡住查表与收包线程
+    lock.unlock();
+    for (const auto &d : datagrams)
+      sendto(sock, d.data(), d.size(), 0, (sockaddr *)&addr, sizeof(addr));
+    datagrams.clear();
+    lock.lock();
   }
   close(sock);
 }
 
+void DynamicRouteProvider::expireRoutes(uint64_t now) {
+  for (auto it = routeTable_.begin(); it != routeTable_.end();) {
+    Route &r = it->second;
+    uint64_t age = now - r.updatedMs;
+    if (r.local) {
+      ++it;
+    } else if (age > kTimeoutMs + kGarbageMs) {
+      it = routeTable_.erase(it);
+    } else {
+      size_t paths = r.alternates.size();
+      for (auto a = r.alternates.begin(); a != r.alternates.end();)
+        a = now - a->updatedMs > kTimeoutMs ? r.alternates.erase(a) : a + 1;
+      if (r.alternates.size() != paths)
+        updateGroup(r);
+      // 主下一跳超时但仍有等价下一跳时，改用等价下一跳，度量不变
+      if (age > kTimeoutMs && r.metric < kInfinity && !promoteAlternate(r)) {
+        r.metric = kInfinity;
+        markChanged(r);
+      }
+      ++it;
+    }
+  }
+}
+
 void DynamicRouteProvider::receiveLoop() {
   int sock = socket(AF_INET, SOCK_DGRAM, 0);
   if (sock < 0)
     return;
 
+  int reuse = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  // 阻塞接收带超时，stop() 时能及时退出
+  timeval tv{0, 200 * 1000};
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  // 独立的接收缓冲：worker 占满 CPU、本线程迟迟得不到调度时，
+  // 一轮全量更新也能完整地留在内核里，不与数据面共用队列
+  int rcvBuf = 1024 * 1024;
+  setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf));
+
   sockaddr_in addr{};
   addr.sin_family = AF_INET;
-  addr.sin_port = htons(54321);
+  addr.sin_port = htons(kPort);
   addr.sin_addr.s_addr = INADDR_ANY;
 
   if (bind(sock, (sockaddr *)&addr, sizeof(addr)) < 0) {
@@ -69,68 +282,161 @@ void DynamicRouteProvider::receiveLoop() {
     return;
   }
 
-  char buffer[256];
+  uint8_t buffer[kMaxDatagram];
   while (running_) {
     sockaddr_in sender{};
     socklen_t len = sizeof(sender);
-    int bytes = recvfrom(sock, buffer, sizeof(buffer) - 1, 0,
-                         (sockaddr *)&sender, &len);
-    if (bytes <= 0)
+    int bytes = recvfrom(sock, buffer, sizeof(buffer), 0, (sockaddr *)&sender,
+                         &len);
+    if (bytes <= 0 || sender.sin_addr.s_addr == localAddr_)
       continue;
-    buffer[bytes] = 0;
-
-    std::istringstream iss(buffer);
-    RouteEntry route;
-    std::string metricStr;
-    iss >> route.dest >> route.netmask >> route.gateway >> route.iface >>
-        metricStr;
-    route.metric = std::stoi(metricStr);
-    mergeRoutes({route}, inet_ntoa(sender.sin_addr));
+    mergeRoutes(buffer, bytes, sender.sin_addr.s_addr);
   }
   close(sock);
 }
 
-void DynamicRouteProvider::mergeRoutes(const std::vector<RouteEntry> &newRoutes,
-                                       const std::string &senderIp) {
+void DynamicRouteProvider::mergeRoutes(const uint8_t *data, size_t len,
+                                       uint32_t senderIp) {
+  if (len < kHeaderLen)
+    return;
+  uint16_t magic, count;
+  memcpy(&magic, data, 2);
+  memcpy(&count, data + 4, 2);
+  count = ntohs(count);
+  if (ntohs(magic) != kMagic || data[2] != kVersion ||
+      len < kHeaderLen + size_t(count) * kEntryLen)
+    return;
+
+  uint64_t now = nowMs();
   std::lock_guard<std::mutex> lock(routeMutex_);
-  for (const auto &r : newRoutes) {
-    bool updated = false;
-    for (auto &existing : routeTable_) {
-      if (existing.dest == r.dest && existing.netmask == r.netmask) {
-        if (r.metric + 1 < existing.metric) {
-          existing.gateway = senderIp;
-          existing.metric = r.metric + 1;
-          updated = true;
-        }
-        break;
-      }
+  for (size_t i = 0; i < count; ++i) {
+    const uint8_t *e = data + kHeaderLen + i * kEntryLen;
+    uint32_t dest, nextHop;
+    memcpy(&dest, e, 4);
+    memcpy(&nextHop, e + 4, 4);
+    uint8_t prefixLen = e[8];
+    if (prefixLen > 32)
+      continue;
+    dest &= prefixToMask(prefixLen);
+
+    // 邻居经由本机到达的路由对本机不可用（毒性逆转）；先按 int 计算，
+    // 避免 e[9] 为 255 时加一回绕成 0
+    int hops = e[9] + 1;
+    if (e[9] >= kInfinity || nextHop == localAddr_)
+      hops = kInfinity;
+    uint8_t metric = std::min(hops, int(kInfinity));
+
+    uint64_t key = makeKey(dest, prefixLen);
+    auto it = routeTable_.find(key);
+    if (it == routeTable_.end()) {
+      if (metric >= kInfinity)
+        continue;
+      Route &r = routeTable_[key];
+      r = Route{dest, prefixLen, senderIp, metric, false, false, now, {},
+                nullptr};
+      prefixMask_ |= 1ULL << prefixLen;
+      markChanged(r);
+      continue;
     }
-    if (!updated) {
-      RouteEntry newRoute = r;
-      newRoute.gateway = senderIp;
-      newRoute.metric += 1;
-      routeTable_.push_back(newRoute);
+
+    Route &r = it->second;
+    if (r.local)
+      continue;
+    auto alt = std::find_if(
+        r.alternates.begin(), r.alternates.end(),
+        [senderIp](const Alternate &a) { return a.gateway == senderIp; });
+    if (r.gateway == senderIp) {
+      // 主下一跳变差时若有等价下一跳，直接改用，度量不变
+      if (metric > r.metric && promoteAlternate(r)) {
+        markChanged(r);
+        continue;
+      }
+      // 当前下一跳的通告总是采纳，无论变好还是变坏；变为不可达时直接进入回收期
+      if (metric < kInfinity)
+        r.updatedMs = now;
+      else if (r.metric < kInfinity)
+        r.updatedMs = now - kTimeoutMs;
+      if (metric != r.metric) {
+        r.metric = metric;
+        // 变好后其余下一跳不再等价
+        r.alternates.clear();
+        updateGroup(r);
+        markChanged(r);
+      }
+    } else if (metric < r.metric) {
+      r.gateway = senderIp;
+      r.metric = metric;
+      r.updatedMs = now;
+      r.alternates.clear();
+      updateGroup(r);
+      markChanged(r);
+    } else if (alt != r.alternates.end()) {
+      if (metric == r.metric) {
+        alt->updatedMs = now;
+      } else {
+        r.alternates.erase(alt);
+        updateGroup(r);
+      }
+    } else if (metric == r.metric && metric < kInfinity &&
+               r.alternates.size() + 1 < kMaxPaths) {
+      r.alternates.push_back({senderIp, now});
+      updateGroup(r);
     }
   }
 }
 
+const DynamicRouteProvider::Route *
+DynamicRouteProvider::findRoute(uint32_t dst) const {
+  // 最长前缀匹配：只探测表中存在的前缀长度
+  for (int len = 32; len >= 0; --len) {
+    if (!(prefixMask_ & (1ULL << len)))
+      continue;
+    auto it = routeTable_.find(makeKey(dst & prefixToMask(len), len));
+    if (it == routeTable_.end() || it->second.metric >= kInfinity)
+      continue;
+    return &it->second;
+  }
+  return nullptr;
+}
+
+RouteEntry DynamicRouteProvider::toEntry(const Route &r) const {
+  return RouteEntry{addrToString(r.dest),
+                    addrToString(prefixToMask(r.prefixLen)),
+                    r.local ? localIp_ : addrToString(r.gateway), iface_,
+                    r.metric};
+}
+
 std::optional<RouteEntry>
 DynamicRouteProvider::lookup(const std::string &dstIp) {
   std::lock_guard<std::mutex> lock(routeMutex_);
-  for (const auto &route : routeTable_) {
-    if (match(dstIp, route)) {
-      return route;
-    }
-  }
-  return std::nullopt;
+  const Route *r = findRoute(inet_addr(dstIp.c_str()));
+  if (!r)
+    return std::nullopt;
+  return toEntry(*r);
 }
 
-bool DynamicRouteProvider::match(const std::string &ip,
-                                 const RouteEntry &route) {
-  in_addr ipAddr, destAddr, maskAddr;
-  inet_aton(ip.c_str(), &ipAddr);
-  inet_aton(route.dest.c_str(), &destAddr);
-  inet_aton(route.netmask.c_str(), &maskAddr);
-  return (ipAddr.s_addr & maskAddr.s_addr) ==
-         (destAddr.s_addr & maskAddr.s_addr);
+std::optional<RouteEntry>
+DynamicRouteProvider::lookup(const std::string &dstIp, uint32_t flowHash) {
+  std::lock_guard<std::mutex> lock(routeMutex_);
+  const Route *r = findRoute(inet_addr(dstIp.c_str()));
+  if (!r)
+    return std::nullopt;
+  RouteEntry entry = toEntry(*r);
+  if (r->group)
+    entry.gateway = r->group->select(flowHash)->gateway;
+  return entry;
+}
+
+bool DynamicRouteProvider::resolve(uint32_t dst, uint32_t flowHash,
+                                   RouteHop &hop) {
+  std::lock_guard<std::mutex> lock(routeMutex_);
+  const Route *r = findRoute(dst);
+  if (!r)
+    return false;
+  // 本机通告的网段直连；iface_ 构造后不变，可在锁外引用
+  hop.gateway = r->local ? 0 : r->gateway;
+  if (r->group)
+    hop.gateway = r->group->select(flowHash)->addr;
+  hop.iface = &iface_;
+  return true;
 }
@@ -0,0 +1,74 @@
+#include "routing/EcmpGroup.h"
+#include <algorithm>
+#include <arpa/inet.h>
+
+static constexpr uint16_t kUnassigned = 0xffff;
+
+EcmpGroup::EcmpGroup(std::vector<NextHop> hops) : hops_(std::move(hops)) {
+  resolveAddresses();
+  for (size_t i = 0; i < kBuckets; ++i)
+    buckets_[i] = hops_.empty() ? kUnassigned : i % hops_.size();
+}
+
+std::shared_ptr<const EcmpGroup>
+EcmpGroup::withNextHops(std::vector<NextHop> hops) const {
+  std::shared_ptr<EcmpGroup> group(new EcmpGroup());
+  group->hops_ = std::move(hops);
+  group->resolveAddresses();
+
+  std::vector<int> oldToNew(hops_.size(), -1);
+  for (size_t i = 0; i < hops_.size(); ++i) {
+    auto it = std::find(group->hops_.begin(), group->hops_.end(), hops_[i]);
+    if (it != group->hops_.end())
+      oldToNew[i] = it - group->hops_.begin();
+  }
+  group->rebalance(oldToNew, buckets_);
+  return group;
+}
+
+void EcmpGroup::resolveAddresses() {
+  for (auto &hop : hops_)
+    hop.addr = inet_addr(hop.gateway.c_str());
+}
+
+void EcmpGroup::rebalance(const std::vector<int> &oldToNew,
+                          const std::array<uint16_t, kBuckets> &oldBuckets) {
+  size_t n = hops_.size();
+  if (n == 0) {
+    buckets_.fill(kUnassigned);
+    return;
+  }
+
+  // 每个下一跳的目标桶数，余数分给靠前的下一跳
+  std::vector<size_t> target(n, kBuckets / n), count(n, 0);
+  for (size_t i = 0; i < kBuckets % n; ++i)
+    ++target[i];
+
+  // 第一遍：保留下一跳仍在组内且未超出目标的桶
+  std::vector<size_t> freeBuckets;
+  for (size_t b = 0; b < kBuckets; ++b) {
+    uint16_t old = oldBuckets[b];
+    int hop = old < oldToNew.size() ? oldToNew[old] : -1;
+    if (hop >= 0 && count[hop] < target[hop]) {
+      buckets_[b] = hop;
+      ++count[hop];
+    } else {
+      freeBuckets.push_back(b);
+    }
+  }
+
+  // 第二遍：空出的桶分给尚未达到目标的下一跳
+  size_t hop = 0;
+  for (size_t b : freeBuckets) {
+    while (count[hop] >= target[hop])
+      hop = (hop + 1) % n;
+    buckets_[b] = hop;
+    ++count[hop];
+  }
+}
+
+const NextHop *EcmpGroup::select(uint32_t flowHash) const {
+  if (hops_.empty())
+    return nullptr;
+  return &hops_[buckets_[flowHash % kBuckets]];
+}
@@ -1,8 +1,10 @@
 #include "routing/StaticRouteProvider.h"
 #include <arpa/inet.h>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <unordered_map>
 
 bool StaticRouteProvider::loadFromFile(const std::string &path) {
   std::ifstream in(path);
@@ -12,35 +14,185 @@ bool StaticRouteProvider::loadFromFile(const std::string &path) {
   } else
     std::cout << "Load route config" << std::endl;
 
+  // 格式：dest netmask gateway iface [metric]
+  std::vector<std::vector<NextHop>> hops;
+  std::unordered_map<uint64_t, size_t> index;
+  bool ok = true;
   std::string line;
   while (std::getline(in, line)) {
     if (line.empty() || line[0] == '#')
       continue;
     std::istringstream ss(line);
     RouteEntry entry;
-    ss >> entry.dest >> entry.netmask >> entry.gateway >> entry.iface;
-    routes_.push_back(entry);
+    in_addr dest, mask, gateway;
+    if (!(ss >> entry.dest >> entry.netmask >> entry.gateway >> entry.iface) ||
+        !inet_aton(entry.dest.c_str(), &dest) ||
+        !inet_aton(entry.netmask.c_str(), &mask) ||
+        !inet_aton(entry.gateway.c_str(), &gateway) ||
+        entry.iface.size() >= sizeof(SnapshotNextHop::iface)) {
+      std::cerr << "[Router] Malformed route: " << line << std::endl;
+      ok = false;
+      continue;
+    }
+    if (!(ss >> entry.metric))
+      entry.metric = 0;
+
+    // 按截断后的 (网段, 掩码) 归组，大路由表也只需一次哈希查找
+    uint32_t net = dest.s_addr & mask.s_addr;
+    auto found = index.emplace(uint64_t(net) << 32 | mask.s_addr,
+                               routes_.size());
+    size_t i = found.first->second;
+    if (found.second) {
+      routes_.push_back({entry, net, mask.s_addr, gateway.s_addr, nullptr});
+      hops.push_back({{entry.gateway, entry.iface}});
+    } else if (entry.metric < routes_[i].entry.metric) {
+      routes_[i].entry = entry;
+      routes_[i].gateway = gateway.s_addr;
+      hops[i] = {{entry.gateway, entry.iface}};
+    } else if (entry.metric == routes_[i].entry.metric) {
+      hops[i].push_back({entry.gateway, entry.iface});
+    }
+  }
+
+  for (size_t i = 0; i < routes_.size(); ++i) {
+    if (hops[i].size() > 1) {
+      std::cout << "[Router] ECMP " << routes_[i].entry.dest << "/"
+                << routes_[i].entry.netmask << " over " << hops[i].size()
+                << " next hops" << std::endl;
+      routes_[i].group = std::make_shared<EcmpGroup>(std::move(hops[i]));
+    }
+  }
+  return ok;
+}
+
+static std::string addressString(uint32_t addr) {
+  char buf[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &addr, buf, sizeof(buf));
+  return buf;
+}
+
+bool StaticRouteProvider::loadSnapshot(const ConfigSnapshot &snapshot) {
+  uint32_t numRoutes, numHops;
+  size_t routeBytes, hopBytes;
+  auto *routes = static_cast<const SnapshotRoute *>(
+      snapshot.section(SnapshotSection::Routes, numRoutes, routeBytes));
+  auto *hops = static_cast<const SnapshotNextHop *>(
+      snapshot.section(SnapshotSection::NextHops, numHops, hopBytes));
+  if (!routes || !hops || routeBytes != numRoutes * sizeof(SnapshotRoute) ||
+      hopBytes != numHops * sizeof(SnapshotNextHop)) {
+    std::cerr << "[Router] Snapshot has no valid route table" << std::endl;
+    return false;
   }
 
+  // 查找结果以字符串返回，路由项仍需物化；但不再有逐行的文本解析
+  routes_.clear();
+  routes_.reserve(numRoutes);
+  for (uint32_t i = 0; i < numRoutes; ++i) {
+    const SnapshotRoute &r = routes[i];
+    if (r.hopCount == 0 || r.firstHop > numHops ||
+        r.hopCount > numHops - r.firstHop) {
+      std::cerr << "[Router] Snapshot route " << i << " is corrupt"
+                << std::endl;
+      routes_.clear();
+      return false;
+    }
+    const SnapshotNextHop &first = hops[r.firstHop];
+    RouteEntry entry{addressString(r.dest), addressString(r.netmask),
+                     addressString(first.gateway),
+                     std::string(first.iface,
+                                 strnlen(first.iface, sizeof(first.iface))),
+                     r.metric};
+    routes_.push_back({std::move(entry), r.dest & r.netmask, r.netmask,
+                       first.gateway, nullptr});
+    if (r.hopCount == 1)
+      continue;
+    std::vector<NextHop> group;
+    for (uint32_t h = r.firstHop; h < r.firstHop + r.hopCount; ++h)
+      group.push_back({addressString(hops[h].gateway),
+                       std::string(hops[h].iface,
+                                   strnlen(hops[h].iface,
+                                           sizeof(hops[h].iface)))});
+    routes_.back().group = std::make_shared<EcmpGroup>(std::move(group));
+  }
+  std::cout << "[Router] Loaded " << routes_.size()
+            << " routes from snapshot" << std::endl;
   return true;
 }
 
-bool StaticRouteProvider::match(const std::string &ip,
-                                const RouteEntry &route) {
-  in_addr ipAddr, destAddr, maskAddr;
-  inet_aton(ip.c_str(), &ipAddr);
-  inet_aton(route.dest.c_str(), &destAddr);
-  inet_aton(route.netmask.c_str(), &maskAddr);
-  return (ipAddr.s_addr & maskAddr.s_addr) ==
-         (destAddr.s_addr & maskAddr.s_addr);
+void StaticRouteProvider::saveSnapshot(ConfigSnapshotWriter &writer) const {
+  std::vector<SnapshotRoute> routes;
+  std::vector<SnapshotNextHop> hops;
+  for (const auto &route : routes_) {
+    std::vector<NextHop> single{{route.entry.gateway, route.entry.iface}};
+    const std::vector<NextHop> &group =
+        route.group ? route.group->nextHops() : single;
+    routes.push_back({route.dest, route.mask, route.entry.metric,
+                      uint32_t(hops.size()), uint32_t(group.size())});
+    for (const auto &hop : group) {
+      SnapshotNextHop h{};
+      h.gateway = inet_addr(hop.gateway.c_str());
+      strncpy(h.iface, hop.iface.c_str(), sizeof(h.iface) - 1);
+      hops.push_back(h);
+    }
+  }
+  writer.add(SnapshotSection::Routes, routes.size(), routes.data(),
+             routes.size() * sizeof(SnapshotRoute));
+  writer.add(SnapshotSection::NextHops, hops.size(), hops.data(),
+             hops.size() * sizeof(SnapshotNextHop));
+}
+
+const StaticRouteProvider::Route *
+StaticRouteProvider::find(const std::string &dstIp) {
+  in_addr ip;
+  if (!inet_aton(dstIp.c_str(), &ip))
+    return nullptr;
+  return find(ip.s_addr);
 }
 
-std::optional<RouteEntry>
-StaticRouteProvider::lookup(const std::string &dstIp) {
+const StaticRouteProvider::Route *
+StaticRouteProvider::find(uint32_t dst) const {
   for (const auto &route : routes_) {
-    if (match(dstIp, route)) {
-      return route;
+    if ((dst & route.mask) == route.dest) {
+      return &route;
     }
   }
-  return std::nullopt;
+  return nullptr;
+}
+
+std::optional<RouteEntry>
+StaticRouteProvider::lookup(const std::string &dstIp) {
+  const Route *route = find(dstIp);
+  if (!route)
+    return std::nullopt;
+  return route->entry;
+}
+
+std::optional<RouteEntry>
+StaticRouteProvider::lookup(const std::string &dstIp, uint32_t flowHash) {
+  const Route *route = find(dstIp);
+  if (!route)
+    return std::nullopt;
+  RouteEntry entry = route->entry;
+  if (route->group) {
+    const NextHop *hop = route->group->select(flowHash);
+    entry.gateway = hop->gateway;
+    entry.iface = hop->iface;
+  }
+  return entry;
+}
+
+bool StaticRouteProvider::resolve(uint32_t dst, uint32_t flowHash,
+                                  RouteHop &hop) {
+  const Route *route = find(dst);
+  if (!route)
+    return false;
+  if (route->group) {
+    const NextHop *next = route->group->select(flowHash);
+    hop.gateway = next->addr;
+    hop.iface = &next->iface;
+  } else {
+    hop.gateway = route->gateway;
+    hop.iface = &route->entry.iface;
+  }
+  return true;
 }
@@ -0,0 +1,64 @@
+#include "QoS/QoSManager.h"
+#include "core/ConfigSnapshot.h"
+#include "firewall/Firewall.h"
+#include "routing/StaticRouteProvider.h"
+#include <iostream>
+#include <string>
+
+// wuthering-configc：读取 firewall.rules、qos.rules 与 routes.conf，
+// 任一文件有格式错误即失败；通过后写出快照，再读回一遍确认可以加载
+static void usage(const char *prog) {
+  std::cerr << "Usage: " << prog
+            << " [--config-dir <dir>] [--out <file>]\n"
+               "  --config-dir <dir>  text configs to compile (config)\n"
+               "  --out <file>        snapshot path (<dir>/config.snap)\n";
+}
+
+int main(int argc, char **argv) {
+  std::string configDir = "config", out;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--config-dir" && hasValue) {
+      configDir = argv[++i];
+    } else if (arg == "--out" && hasValue) {
+      out = argv[++i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (out.empty())
+    out = configDir + "/config.snap";
+
+  Firewall firewall;
+  QoSManager qos;
+  StaticRouteProvider routes;
+  bool ok = firewall.loadRules(configDir + "/firewall.rules");
+  ok = qos.loadRules(configDir + "/qos.rules") && ok;
+  ok = routes.loadFromFile(configDir + "/routes.conf") && ok;
+  if (!ok) {
+    std::cerr << "[Configc] " << configDir
+              << " has errors, snapshot not written\n";
+    return 1;
+  }
+
+  ConfigSnapshotWriter writer;
+  firewall.saveSnapshot(writer);
+  qos.saveSnapshot(writer);
+  routes.saveSnapshot(writer);
+  if (!writer.write(out))
+    return 1;
+
+  ConfigSnapshot snapshot;
+  Firewall checkFirewall;
+  QoSManager checkQos;
+  StaticRouteProvider checkRoutes;
+  if (!snapshot.open(out) || !checkFirewall.loadSnapshot(snapshot) ||
+      !checkQos.loadSnapshot(snapshot) || !checkRoutes.loadSnapshot(snapshot)) {
+    std::cerr << "[Configc] " << out << " failed to load back\n";
+    return 1;
+  }
+  std::cout << "[Configc] Wrote " << out << "\n";
+  return 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// 对数分桶的延迟直方图：每个 2 的幂区间再均分 16 格，相对误差约 6%，
+// 记录开销为常数且内存固定，适合逐包记录
+class LatencyHistogram {
+public:
+  void record(uint64_t ns) {
+    ++buckets_[index(ns)];
+    ++count_;
+    if (ns > max_)
+      max_ = ns;
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t max() const { return max_; }
+
+  // 返回分位数 p（0~1）所在桶的上界，单位纳秒
+  uint64_t percentile(double p) const {
+    if (count_ == 0)
+      return 0;
+    uint64_t target = static_cast<uint64_t>(p * (count_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+      seen += buckets_[i];
+      if (seen >= target)
+        return upperBound(i) < max_ ? upperBound(i) : max_;
+    }
+    return max_;
+  }
+
+private:
+  static constexpr unsigned kSubBits = 4;
+  static constexpr unsigned kSub = 1u << kSubBits;
+
+  static size_t index(uint64_t ns) {
+    if (ns < kSub)
+      return ns;
+    unsigned exp = 63 - __builtin_clzll(ns); // ns 所在的 2 的幂区间
+    unsigned sub = (ns >> (exp - kSubBits)) & (kSub - 1);
+    return (exp - kSubBits + 1) * kSub + sub;
+  }
+
+  static uint64_t upperBound(size_t idx) {
+    if (idx < kSub)
+      return idx;
+    unsigned exp = idx / kSub + kSubBits - 1;
+    uint64_t sub = idx % kSub;
+    return ((kSub + sub + 1) << (exp - kSubBits)) - 1;
+  }
+
+  std::array<uint64_t, (64 - kSubBits + 1) * kSub> buckets_{};
+  uint64_t count_ = 0;
+  uint64_t max_ = 0;
+};
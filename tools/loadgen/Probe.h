@@ -0,0 +1,19 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+// 探测报文头，放在每个 UDP 负载 / TCP 帧的开头；反射端原样回送，
+// 发送端据此匹配流并计算往返延迟。收发两端在同一主机，直接用本机字节序
+struct Probe {
+  static constexpr uint32_t kMagic = 0x57544847; // "WTHG"
+  uint32_t magic;
+  uint32_t flow;
+  uint64_t seq;
+  uint64_t sentNs;
+};
+
+inline uint64_t monotonicNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
@@ -0,0 +1,193 @@
+#include "Reflector.h"
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_map>
+
+static constexpr size_t kBatch = 64;
+static constexpr size_t kSlot = 65536;
+
+static int bindSocket(int type, uint16_t port) {
+  int fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  int bufSize = 4 * 1024 * 1024;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+  setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof(bufSize));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  // 回包须从原目的地址发出，否则发送端 connect 过的 socket 收不到
+  if (type == SOCK_DGRAM)
+    setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &one, sizeof(one));
+  if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      (type == SOCK_STREAM && listen(fd, 1024) < 0)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+Reflector::Reflector(uint16_t port, size_t numThreads)
+    : port_(port), numThreads_(numThreads ? numThreads : 1) {}
+
+Reflector::~Reflector() { stop(); }
+
+bool Reflector::start() {
+  running_ = true;
+  for (size_t i = 0; i < numThreads_; ++i) {
+    int udpFd = bindSocket(SOCK_DGRAM, port_);
+    int listenFd = bindSocket(SOCK_STREAM, port_);
+    if (udpFd < 0 || listenFd < 0) {
+      perror("[Reflector] bind");
+      if (udpFd >= 0)
+        close(udpFd);
+      if (listenFd >= 0)
+        close(listenFd);
+      stop();
+      return false;
+    }
+    workers_.emplace_back(&Reflector::workerLoop, this, udpFd, listenFd);
+  }
+  std::cerr << "[Reflector] Listening on port " << port_ << " with "
+            << numThreads_ << " threads\n";
+  return true;
+}
+
+void Reflector::stop() {
+  running_ = false;
+  for (auto &t : workers_) {
+    if (t.joinable())
+      t.join();
+  }
+  workers_.clear();
+}
+
+void Reflector::workerLoop(int udpFd, int listenFd) {
+  int epollFd = epoll_create1(EPOLL_CLOEXEC);
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.fd = udpFd;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, udpFd, &ev);
+  ev.data.fd = listenFd;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+
+  // TCP 连接上写不出去的回送数据
+  std::unordered_map<int, std::string> pending;
+  auto dropConn = [&](int fd) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    pending.erase(fd);
+  };
+
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[kBatch * kSlot]);
+  mmsghdr msgs[kBatch];
+  iovec iov[kBatch];
+  sockaddr_in peers[kBatch];
+  alignas(cmsghdr) uint8_t controls[kBatch][CMSG_SPACE(sizeof(in_pktinfo))];
+
+  while (running_) {
+    epoll_event events[64];
+    int n = epoll_wait(epollFd, events, 64, 100);
+    for (int i = 0; i < n; ++i) {
+      int fd = events[i].data.fd;
+
+      if (fd == udpFd) {
+        // 批量收下后原样批量发回各自的来源地址
+        for (;;) {
+          for (size_t k = 0; k < kBatch; ++k) {
+            iov[k] = {buf.get() + k * kSlot, kSlot};
+            msgs[k] = {};
+            msgs[k].msg_hdr.msg_iov = &iov[k];
+            msgs[k].msg_hdr.msg_iovlen = 1;
+            msgs[k].msg_hdr.msg_name = &peers[k];
+            msgs[k].msg_hdr.msg_namelen = sizeof(peers[k]);
+            msgs[k].msg_hdr.msg_control = controls[k];
+            msgs[k].msg_hdr.msg_controllen = sizeof(controls[k]);
+          }
+          int got = recvmmsg(udpFd, msgs, kBatch, MSG_DONTWAIT, nullptr);
+          if (got <= 0)
+            break;
+          for (int k = 0; k < got; ++k) {
+            iov[k].iov_len = msgs[k].msg_len;
+            // 收到的 IP_PKTINFO 原样作为发送时的源地址
+            cmsghdr *c = CMSG_FIRSTHDR(&msgs[k].msg_hdr);
+            if (c && c->cmsg_level == IPPROTO_IP && c->cmsg_type == IP_PKTINFO) {
+              auto *info = reinterpret_cast<in_pktinfo *>(CMSG_DATA(c));
+              info->ipi_spec_dst = info->ipi_addr;
+              info->ipi_ifindex = 0;
+            } else {
+              msgs[k].msg_hdr.msg_control = nullptr;
+              msgs[k].msg_hdr.msg_controllen = 0;
+            }
+          }
+          int sent = sendmmsg(udpFd, msgs, got, MSG_DONTWAIT);
+          if (sent > 0)
+            reflected_ += sent;
+          if (got < static_cast<int>(kBatch))
+            break;
+        }
+      } else if (fd == listenFd) {
+        int conn;
+        while ((conn = accept4(listenFd, nullptr, nullptr,
+                               SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+          epoll_event cev{};
+          cev.events = EPOLLIN;
+          cev.data.fd = conn;
+          epoll_ctl(epollFd, EPOLL_CTL_ADD, conn, &cev);
+        }
+      } else {
+        std::string &out = pending[fd];
+        bool wasBlocked = !out.empty();
+        bool closed = false;
+        // 有积压时先写积压，积压清空前不再读，靠 TCP 窗口反压发送端
+        if (!out.empty()) {
+          ssize_t w = write(fd, out.data(), out.size());
+          if (w > 0)
+            out.erase(0, w);
+        }
+        while (out.empty()) {
+          ssize_t r = read(fd, buf.get(), kSlot);
+          if (r == 0 || (r < 0 && errno != EAGAIN && errno != EINTR)) {
+            closed = true;
+            break;
+          }
+          if (r < 0)
+            break;
+          ssize_t w = write(fd, buf.get(), r);
+          if (w < 0)
+            w = 0;
+          if (w < r)
+            out.assign(reinterpret_cast<char *>(buf.get()) + w, r - w);
+        }
+        if (closed) {
+          dropConn(fd);
+          continue;
+        }
+        if (wasBlocked != !out.empty()) {
+          epoll_event cev{};
+          cev.events = out.empty() ? EPOLLIN : EPOLLOUT;
+          cev.data.fd = fd;
+          epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &cev);
+        }
+      }
+    }
+  }
+
+  for (auto &kv : pending)
+    close(kv.first);
+  close(epollFd);
+  close(udpFd);
+  close(listenFd);
+}
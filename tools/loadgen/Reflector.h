@@ -0,0 +1,28 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// 压测反射端：在同一端口上把 UDP 报文与 TCP 字节流原样回送。
+// 多个线程各自以 SO_REUSEPORT 绑定，由内核分摊流，避免反射端成为瓶颈
+class Reflector {
+public:
+  Reflector(uint16_t port, size_t numThreads = 1);
+  ~Reflector();
+
+  bool start();
+  void stop();
+
+  // 已回送的 UDP 报文数
+  uint64_t reflectedCount() const { return reflected_; }
+
+private:
+  void workerLoop(int udpFd, int listenFd);
+
+  uint16_t port_;
+  size_t numThreads_;
+  std::atomic<bool> running_{false};
+  std::atomic<uint64_t> reflected_{0};
+  std::vector<std::thread> workers_;
+};
@@ -0,0 +1,294 @@
+#include "Sender.h"
+#include "Probe.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static constexpr uint64_t kDrainNs = 500ULL * 1000 * 1000;
+static constexpr size_t kMaxBatch = 1024;
+static constexpr size_t kRxSlot = 65536;
+
+struct Sender::Flow {
+  int fd = -1;
+  uint32_t id = 0;
+  bool tcp = false;
+  bool connected = false; // UDP 流创建即可发送
+  uint64_t seq = 0;
+  std::vector<uint8_t> tx; // TCP 尚未写出的字节
+  std::vector<uint8_t> rx; // TCP 尚未成帧的字节
+};
+
+Sender::Sender(const SenderConfig &config) : config_(config) {
+  config_.size = std::max(config_.size, sizeof(Probe));
+  config_.batch = std::clamp<size_t>(config_.batch, 1, kMaxBatch);
+  config_.flows = std::max<size_t>(config_.flows, 1);
+  config_.targetCount = std::max<size_t>(config_.targetCount, 1);
+}
+
+Sender::~Sender() {
+  for (auto &f : flows_) {
+    if (f)
+      closeFlow(*f);
+  }
+  for (auto &r : retired_)
+    closeFlow(*r.first);
+  if (epollFd_ >= 0)
+    close(epollFd_);
+}
+
+void Sender::closeFlow(Flow &f) {
+  if (f.fd < 0)
+    return;
+  epoll_ctl(epollFd_, EPOLL_CTL_DEL, f.fd, nullptr);
+  close(f.fd);
+  f.fd = -1;
+}
+
+bool Sender::openFlow(size_t slot) {
+  auto f = std::make_unique<Flow>();
+  f->id = nextFlowId_++;
+  // 按流编号均匀地把一部分流设为 TCP
+  f->tcp = (f->id * 37 % 100) < config_.tcpPercent;
+  f->fd = socket(AF_INET,
+                 (f->tcp ? SOCK_STREAM : SOCK_DGRAM) | SOCK_NONBLOCK |
+                     SOCK_CLOEXEC,
+                 0);
+  if (f->fd < 0) {
+    perror("[Loadgen] socket");
+    return false;
+  }
+  int bufSize = 4 * 1024 * 1024;
+  setsockopt(f->fd, SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof(bufSize));
+  setsockopt(f->fd, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+  if (f->tcp) {
+    int one = 1;
+    setsockopt(f->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+
+  sockaddr_in dst{};
+  dst.sin_family = AF_INET;
+  dst.sin_addr.s_addr = htonl(targetIp_ + f->id % config_.targetCount);
+  dst.sin_port = htons(config_.port);
+  int rc = connect(f->fd, reinterpret_cast<sockaddr *>(&dst), sizeof(dst));
+  if (rc < 0 && errno != EINPROGRESS) {
+    perror("[Loadgen] connect");
+    close(f->fd);
+    ++stats_->connectFailures;
+    return false;
+  }
+  f->connected = !f->tcp || rc == 0;
+
+  epoll_event ev{};
+  ev.events = EPOLLIN | (f->connected ? 0u : static_cast<uint32_t>(EPOLLOUT));
+  ev.data.ptr = f.get();
+  epoll_ctl(epollFd_, EPOLL_CTL_ADD, f->fd, &ev);
+
+  ++stats_->flowsOpened;
+  flows_[slot] = std::move(f);
+  return true;
+}
+
+void Sender::retireFlow(size_t slot, uint64_t now) {
+  if (flows_[slot])
+    retired_.emplace_back(std::move(flows_[slot]), now + kDrainNs);
+}
+
+size_t Sender::sendBurst(Flow &f, size_t count, uint64_t now) {
+  if (f.fd < 0 || !f.connected)
+    return 0;
+  size_t size = config_.size;
+
+  if (f.tcp) {
+    // 上一批没写完时先写完，保证帧边界不乱
+    if (f.tx.empty()) {
+      f.tx.resize(count * size);
+      for (size_t i = 0; i < count; ++i) {
+        Probe p{Probe::kMagic, f.id, f.seq++, now};
+        std::memcpy(f.tx.data() + i * size, &p, sizeof(p));
+      }
+      stats_->sent += count;
+      stats_->bytesSent += count * size;
+    } else {
+      count = 0;
+    }
+    ssize_t n = write(f.fd, f.tx.data(), f.tx.size());
+    if (n > 0)
+      f.tx.erase(f.tx.begin(), f.tx.begin() + n);
+    return count;
+  }
+
+  mmsghdr msgs[kMaxBatch];
+  iovec iov[kMaxBatch];
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t *slot = txBuf_.data() + i * size;
+    Probe p{Probe::kMagic, f.id, f.seq + i, now};
+    std::memcpy(slot, &p, sizeof(p));
+    iov[i] = {slot, size};
+    msgs[i] = {};
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  int n = sendmmsg(f.fd, msgs, count, MSG_DONTWAIT);
+  if (n <= 0)
+    return 0;
+  f.seq += n;
+  stats_->sent += n;
+  stats_->bytesSent += size_t(n) * size;
+  return n;
+}
+
+void Sender::onReply(const uint8_t *data, size_t len, uint64_t now) {
+  if (len < sizeof(Probe))
+    return;
+  Probe p;
+  std::memcpy(&p, data, sizeof(p));
+  if (p.magic != Probe::kMagic || p.sentNs > now)
+    return;
+  ++stats_->received;
+  stats_->bytesReceived += len;
+  stats_->latency.record(now - p.sentNs);
+}
+
+void Sender::receive(Flow &f, uint64_t now) {
+  if (f.tcp) {
+    uint8_t buf[65536];
+    for (;;) {
+      ssize_t n = read(f.fd, buf, sizeof(buf));
+      if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        closeFlow(f);
+        return;
+      }
+      if (n < 0)
+        return;
+      f.rx.insert(f.rx.end(), buf, buf + n);
+      size_t off = 0;
+      for (; off + config_.size <= f.rx.size(); off += config_.size)
+        onReply(f.rx.data() + off, config_.size, now);
+      f.rx.erase(f.rx.begin(), f.rx.begin() + off);
+    }
+  }
+
+  mmsghdr msgs[kMaxBatch];
+  iovec iov[kMaxBatch];
+  size_t slots = std::min(config_.batch, rxBuf_.size() / kRxSlot);
+  for (;;) {
+    for (size_t i = 0; i < slots; ++i) {
+      iov[i] = {rxBuf_.data() + i * kRxSlot, kRxSlot};
+      msgs[i] = {};
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int n = recvmmsg(f.fd, msgs, slots, MSG_DONTWAIT, nullptr);
+    if (n <= 0)
+      return;
+    for (int i = 0; i < n; ++i)
+      onReply(rxBuf_.data() + i * kRxSlot, msgs[i].msg_len, now);
+    if (size_t(n) < slots)
+      return;
+  }
+}
+
+void Sender::pollEvents(int timeoutMs) {
+  epoll_event events[256];
+  int n = epoll_wait(epollFd_, events, 256, timeoutMs);
+  uint64_t now = monotonicNs();
+  for (int i = 0; i < n; ++i) {
+    Flow &f = *static_cast<Flow *>(events[i].data.ptr);
+    if (f.fd < 0)
+      continue;
+    if (!f.connected && (events[i].events & (EPOLLOUT | EPOLLERR))) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(f.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      if (err != 0) {
+        ++stats_->connectFailures;
+        closeFlow(f);
+        continue;
+      }
+      f.connected = true;
+      epoll_event ev{};
+      ev.events = EPOLLIN;
+      ev.data.ptr = &f;
+      epoll_ctl(epollFd_, EPOLL_CTL_MOD, f.fd, &ev);
+    }
+    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+      receive(f, now);
+  }
+}
+
+bool Sender::run(SenderStats &stats) {
+  stats_ = &stats;
+  in_addr addr;
+  if (inet_aton(config_.target.c_str(), &addr) == 0) {
+    std::cerr << "[Loadgen] Invalid target " << config_.target << "\n";
+    return false;
+  }
+  targetIp_ = ntohl(addr.s_addr);
+  epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd_ < 0) {
+    perror("[Loadgen] epoll_create1");
+    return false;
+  }
+  txBuf_.resize(config_.batch * config_.size);
+  rxBuf_.resize(std::min<size_t>(config_.batch, 64) * kRxSlot);
+
+  flows_.resize(config_.flows);
+  for (size_t i = 0; i < config_.flows; ++i)
+    openFlow(i);
+
+  uint64_t start = monotonicNs();
+  uint64_t end = start + uint64_t(config_.duration * 1e9);
+  uint64_t last = start;
+  double tokens = 0, churn = 0;
+  size_t next = 0, churnSlot = 0;
+
+  uint64_t now = start;
+  while (now < end) {
+    double dt = (now - last) / 1e9;
+    last = now;
+
+    // 令牌桶限速；不限速时每次发满一批
+    size_t budget = config_.batch;
+    if (config_.rate > 0) {
+      tokens = std::min(tokens + config_.rate * dt,
+                        double(config_.batch * config_.flows));
+      budget = std::min<size_t>(config_.batch, size_t(tokens));
+    }
+    if (budget > 0) {
+      Flow *f = flows_[next].get();
+      next = (next + 1) % flows_.size();
+      if (f)
+        tokens -= sendBurst(*f, budget, monotonicNs());
+    }
+
+    // 流替换：关闭旧源端口并新建，驱动路由器不断创建 NAT 映射
+    churn += config_.newFlowRate * dt;
+    for (; churn >= 1; churn -= 1) {
+      retireFlow(churnSlot, now);
+      openFlow(churnSlot);
+      churnSlot = (churnSlot + 1) % flows_.size();
+    }
+    while (!retired_.empty() && retired_.front().second <= now) {
+      closeFlow(*retired_.front().first);
+      retired_.pop_front();
+    }
+
+    pollEvents(budget == 0 ? 1 : 0);
+    now = monotonicNs();
+  }
+
+  // 停止发送后再收一段时间，在途回包不计为丢失
+  uint64_t drainEnd = now + kDrainNs * 2;
+  while ((now = monotonicNs()) < drainEnd && stats.received < stats.sent)
+    pollEvents(10);
+
+  stats.seconds = (end - start) / 1e9;
+  return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "LatencyHistogram.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct SenderConfig {
+  std::string target = "198.18.0.1"; // 首个目的地址，流依次分散到后续地址
+  size_t targetCount = 256;
+  uint16_t port = 9000;
+  size_t flows = 64;
+  size_t size = 64;         // 每个报文的负载字节数，不小于探测头
+  unsigned tcpPercent = 0;  // TCP 流所占比例，其余为 UDP
+  double rate = 0;          // 总发包速率（pps），0 表示不限速
+  double newFlowRate = 0;   // 每秒替换为新源端口的流数，制造 NAT 新建压力
+  double duration = 10;     // 秒
+  size_t batch = 32;        // 每次 sendmmsg / writev 的报文数
+};
+
+struct SenderStats {
+  uint64_t sent = 0;
+  uint64_t received = 0;
+  uint64_t bytesSent = 0;
+  uint64_t bytesReceived = 0;
+  uint64_t flowsOpened = 0;
+  uint64_t connectFailures = 0;
+  double seconds = 0;
+  LatencyHistogram latency;
+};
+
+// 压测发送端：单线程 epoll，UDP 流用 sendmmsg/recvmmsg 批量收发，
+// TCP 流按固定长度分帧用 writev 批量写出，回包中的探测头用于统计丢包与延迟
+class Sender {
+public:
+  explicit Sender(const SenderConfig &config);
+  ~Sender();
+
+  bool run(SenderStats &stats);
+
+private:
+  struct Flow;
+
+  bool openFlow(size_t slot);
+  void retireFlow(size_t slot, uint64_t now);
+  void closeFlow(Flow &f);
+  size_t sendBurst(Flow &f, size_t count, uint64_t now);
+  void receive(Flow &f, uint64_t now);
+  void onReply(const uint8_t *data, size_t len, uint64_t now);
+  void pollEvents(int timeoutMs);
+
+  SenderConfig config_;
+  uint32_t targetIp_ = 0; // 主机字节序
+  int epollFd_ = -1;
+  uint32_t nextFlowId_ = 0;
+  std::vector<std::unique_ptr<Flow>> flows_;
+  // 被替换的流继续接收一段时间，以免在途回包被算作丢失
+  std::deque<std::pair<std::unique_ptr<Flow>, uint64_t>> retired_;
+  SenderStats *stats_ = nullptr;
+  std::vector<uint8_t> txBuf_; // UDP 批量发送的报文槽
+  std::vector<uint8_t> rxBuf_; // UDP 批量接收的报文槽
+};
@@ -0,0 +1,153 @@
+#include "Reflector.h"
+#include "Sender.h"
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+// wuthering-loadgen：路由器压测用的流量发生器
+//   send    经路由器向反射端发送 TCP/UDP 流量组合，统计转发速率、丢包与延迟
+//   reflect 在 WAN 侧把收到的报文原样回送
+static void usage(const char *prog) {
+  std::cerr
+      << "Usage: " << prog << " send [options]\n"
+      << "  --target <ip>        first destination address (198.18.0.1)\n"
+      << "  --targets <n>        spread flows over n consecutive addresses "
+         "(256)\n"
+      << "  --port <port>        destination port (9000)\n"
+      << "  --flows <n>          concurrent flows (64)\n"
+      << "  --size <bytes>       payload bytes per packet (64)\n"
+      << "  --tcp-percent <p>    share of TCP flows, rest UDP (0)\n"
+      << "  --rate <pps>         total send rate, 0 = unlimited (0)\n"
+      << "  --new-flow-rate <n>  flows replaced per second (0)\n"
+      << "  --duration <s>       test length in seconds (10)\n"
+      << "  --batch <n>          packets per sendmmsg/writev (32)\n"
+      << "  --json               print results as JSON\n"
+      << "       " << prog << " reflect [--port <port>] [--threads <n>]\n";
+}
+
+static volatile sig_atomic_t stopFlag = 0;
+
+static int runReflect(int argc, char **argv) {
+  uint16_t port = 9000;
+  size_t threads = 1;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--port" && hasValue) {
+      port = std::atoi(argv[++i]);
+    } else if (arg == "--threads" && hasValue) {
+      threads = std::strtoul(argv[++i], nullptr, 10);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  signal(SIGINT, [](int) { stopFlag = 1; });
+  signal(SIGTERM, [](int) { stopFlag = 1; });
+  Reflector reflector(port, threads);
+  if (!reflector.start())
+    return 1;
+  while (!stopFlag)
+    pause();
+  reflector.stop();
+  std::cerr << "[Reflector] Reflected " << reflector.reflectedCount()
+            << " datagrams\n";
+  return 0;
+}
+
+static void printStats(const SenderConfig &cfg, const SenderStats &st,
+                       bool json) {
+  double secs = st.seconds > 0 ? st.seconds : 1;
+  uint64_t lost = st.sent > st.received ? st.sent - st.received : 0;
+  double lossPct = st.sent ? 100.0 * lost / st.sent : 0;
+  auto us = [&](double p) { return st.latency.percentile(p) / 1000.0; };
+
+  if (json) {
+    std::cout << "{\"flows\": " << cfg.flows << ", \"size\": " << cfg.size
+              << ", \"tcp_percent\": " << cfg.tcpPercent
+              << ", \"rate\": " << cfg.rate
+              << ", \"new_flow_rate\": " << cfg.newFlowRate
+              << ", \"seconds\": " << st.seconds << ", \"sent\": " << st.sent
+              << ", \"received\": " << st.received << ", \"lost\": " << lost
+              << ", \"loss_percent\": " << lossPct
+              << ", \"tx_pps\": " << st.sent / secs
+              << ", \"rx_pps\": " << st.received / secs
+              << ", \"rx_mbps\": " << st.bytesReceived * 8 / secs / 1e6
+              << ", \"flows_opened\": " << st.flowsOpened
+              << ", \"connect_failures\": " << st.connectFailures
+              << ", \"latency_us\": {\"p50\": " << us(0.5)
+              << ", \"p90\": " << us(0.9) << ", \"p99\": " << us(0.99)
+              << ", \"p999\": " << us(0.999)
+              << ", \"max\": " << st.latency.max() / 1000.0 << "}}\n";
+    return;
+  }
+  std::cout << "[Loadgen] sent " << st.sent << ", received " << st.received
+            << ", lost " << lost << " (" << lossPct << "%)\n"
+            << "[Loadgen] tx " << st.sent / secs << " pps, rx "
+            << st.received / secs << " pps, "
+            << st.bytesReceived * 8 / secs / 1e6 << " Mbit/s\n"
+            << "[Loadgen] flows opened " << st.flowsOpened
+            << ", connect failures " << st.connectFailures << "\n"
+            << "[Loadgen] latency us p50 " << us(0.5) << ", p90 " << us(0.9)
+            << ", p99 " << us(0.99) << ", p99.9 " << us(0.999) << ", max "
+            << st.latency.max() / 1000.0 << "\n";
+}
+
+static int runSend(int argc, char **argv) {
+  SenderConfig cfg;
+  bool json = false;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--json") {
+      json = true;
+    } else if (!hasValue) {
+      usage(argv[0]);
+      return 1;
+    } else if (arg == "--target") {
+      cfg.target = argv[++i];
+    } else if (arg == "--targets") {
+      cfg.targetCount = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--port") {
+      cfg.port = std::atoi(argv[++i]);
+    } else if (arg == "--flows") {
+      cfg.flows = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--size") {
+      cfg.size = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--tcp-percent") {
+      cfg.tcpPercent = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--rate") {
+      cfg.rate = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--new-flow-rate") {
+      cfg.newFlowRate = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--duration") {
+      cfg.duration = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--batch") {
+      cfg.batch = std::strtoul(argv[++i], nullptr, 10);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  Sender sender(cfg);
+  SenderStats stats;
+  if (!sender.run(stats))
+    return 1;
+  printStats(cfg, stats, json);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  std::string mode = argc > 1 ? argv[1] : "";
+  if (mode == "send")
+    return runSend(argc, argv);
+  if (mode == "reflect")
+    return runReflect(argc, argv);
+  usage(argv[0]);
+  return 1;
+}
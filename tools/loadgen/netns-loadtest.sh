@@ -0,0 +1,96 @@
+#!/bin/bash
+# netns 回环压测：在三个网络命名空间里跑完整的 main.cpp 数据通路
+#
+#   wl-lan     wuthering-loadgen send，默认路由指向 TUN
+#   wl-router  wuthering 本体；TUN 创建后移入 wl-lan，WAN 为 veth
+#   wl-wan     wuthering-loadgen reflect，198.18.0.0/15 作为本地地址
+#
+# 用法：sudo tools/loadgen/netns-loadtest.sh [build 目录] [loadgen send 参数...]
+set -e
+
+BUILD_DIR="${1:-build}"
+shift || true
+ROUTER="$BUILD_DIR/wuthering"
+LOADGEN="$BUILD_DIR/tools/loadgen/wuthering-loadgen"
+
+LAN_NS="wl-lan"
+ROUTER_NS="wl-router"
+WAN_NS="wl-wan"
+TUN_NAME="wl-tun0"
+TUN_IP="192.168.99.2/24"
+WAN_IF="wl-wan0"
+WAN_PEER="wl-wan1"
+WAN_IP="10.201.0.1"
+PEER_IP="10.201.0.2"
+TARGET_NET="198.18.0.0/15"
+PORT=9000
+
+if [ ! -x "$ROUTER" ] || [ ! -x "$LOADGEN" ]; then
+    echo "[-] 找不到 $ROUTER 或 $LOADGEN，请先构建"
+    exit 1
+fi
+
+CONF_DIR=$(mktemp -d)
+ROUTER_PID=""
+REFLECT_PID=""
+
+cleanup() {
+    echo "[+] 清理命名空间"
+    [ -n "$ROUTER_PID" ] && kill "$ROUTER_PID" 2>/dev/null || true
+    [ -n "$REFLECT_PID" ] && kill "$REFLECT_PID" 2>/dev/null || true
+    wait 2>/dev/null || true
+    for ns in $LAN_NS $ROUTER_NS $WAN_NS; do
+        sudo ip netns del $ns 2>/dev/null || true
+    done
+    rm -rf "$CONF_DIR"
+}
+trap cleanup EXIT
+
+echo "[+] 创建命名空间与 veth"
+for ns in $LAN_NS $ROUTER_NS $WAN_NS; do
+    sudo ip netns add $ns
+    sudo ip -n $ns link set lo up
+done
+
+sudo ip link add $WAN_IF netns $ROUTER_NS type veth peer name $WAN_PEER netns $WAN_NS
+sudo ip -n $ROUTER_NS addr add $WAN_IP/24 dev $WAN_IF
+sudo ip -n $ROUTER_NS link set $WAN_IF up
+sudo ip -n $ROUTER_NS route add $TARGET_NET via $PEER_IP
+sudo ip -n $WAN_NS addr add $PEER_IP/24 dev $WAN_PEER
+sudo ip -n $WAN_NS link set $WAN_PEER up
+# 压测目的网段在 WAN 侧全部视为本机地址，由反射端回送
+sudo ip -n $WAN_NS route add local $TARGET_NET dev lo
+
+# 回包同时会被路由器所在命名空间的内核收到，丢弃它回应的 RST 与端口不可达
+if command -v iptables >/dev/null; then
+    sudo ip netns exec $ROUTER_NS iptables -A OUTPUT -p tcp --tcp-flags RST RST --sport 40000:65535 -j DROP
+    sudo ip netns exec $ROUTER_NS iptables -A OUTPUT -p icmp --icmp-type port-unreachable -j DROP
+else
+    echo "[!] 未找到 iptables，TCP 流会被内核 RST 打断，只建议压测 UDP"
+fi
+
+echo "0.0.0.0 0.0.0.0 $PEER_IP $WAN_IF" > "$CONF_DIR/routes.conf"
+touch "$CONF_DIR/firewall.rules" "$CONF_DIR/qos.rules"
+
+echo "[+] 启动反射端与路由器"
+sudo ip netns exec $WAN_NS "$LOADGEN" reflect --port $PORT --threads 2 &
+REFLECT_PID=$!
+sudo ip netns exec $ROUTER_NS "$ROUTER" --tun $TUN_NAME --wan $WAN_IF \
+    --config-dir "$CONF_DIR" --quiet &
+ROUTER_PID=$!
+
+for _ in $(seq 50); do
+    sudo ip -n $ROUTER_NS link show $TUN_NAME >/dev/null 2>&1 && break
+    sleep 0.1
+done
+
+# TUN 的 fd 留在路由器进程里，设备本身移入 LAN 命名空间
+sudo ip -n $ROUTER_NS link set $TUN_NAME netns $LAN_NS
+sudo ip -n $LAN_NS addr add $TUN_IP dev $TUN_NAME
+sudo ip -n $LAN_NS link set $TUN_NAME up
+sudo ip -n $LAN_NS route add default dev $TUN_NAME
+
+echo "[+] 开始压测"
+sudo ip netns exec $LAN_NS "$LOADGEN" send --target 198.18.0.1 --port $PORT "$@"
+
+echo "[✓] 压测完成"
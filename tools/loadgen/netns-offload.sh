@@ -0,0 +1,95 @@
+#!/bin/bash
+# eBPF NAT 快速路径验证：bpf_redirect 不能跨网络命名空间，TUN 须留在路由器
+# 所在的命名空间，发送端也在这里，按策略路由把压测流量引入 TUN
+#
+#   wl-router  wuthering --offload 与 wuthering-loadgen send
+#   wl-wan     wuthering-loadgen reflect，198.18.0.0/15 作为本地地址
+#
+# 回包由 WAN 网卡上的程序直接改写并注入 TUN，日志中不应出现 [DNAT] Matched
+# 用法：sudo tools/loadgen/netns-offload.sh [build 目录] [loadgen send 参数...]
+set -e
+
+BUILD_DIR="${1:-build}"
+shift || true
+ROUTER="$BUILD_DIR/wuthering"
+LOADGEN="$BUILD_DIR/tools/loadgen/wuthering-loadgen"
+
+ROUTER_NS="wl-router"
+WAN_NS="wl-wan"
+TUN_NAME="wl-tun0"
+TUN_IP="192.168.99.2"
+WAN_IF="wl-wan0"
+WAN_PEER="wl-wan1"
+WAN_IP="10.201.0.1"
+PEER_IP="10.201.0.2"
+TARGET_NET="198.18.0.0/15"
+PORT=9000
+
+if [ ! -x "$ROUTER" ] || [ ! -x "$LOADGEN" ]; then
+    echo "[-] 找不到 $ROUTER 或 $LOADGEN，请先构建"
+    exit 1
+fi
+
+CONF_DIR=$(mktemp -d)
+LOG="$CONF_DIR/router.log"
+ROUTER_PID=""
+REFLECT_PID=""
+
+cleanup() {
+    echo "[+] 清理命名空间"
+    [ -n "$ROUTER_PID" ] && kill "$ROUTER_PID" 2>/dev/null || true
+    [ -n "$REFLECT_PID" ] && kill "$REFLECT_PID" 2>/dev/null || true
+    wait 2>/dev/null || true
+    for ns in $ROUTER_NS $WAN_NS; do
+        sudo ip netns del $ns 2>/dev/null || true
+    done
+    rm -rf "$CONF_DIR"
+}
+trap cleanup EXIT
+
+echo "[+] 创建命名空间与 veth"
+for ns in $ROUTER_NS $WAN_NS; do
+    sudo ip netns add $ns
+    sudo ip -n $ns link set lo up
+done
+
+sudo ip link add $WAN_IF netns $ROUTER_NS type veth peer name $WAN_PEER netns $WAN_NS
+sudo ip -n $ROUTER_NS addr add $WAN_IP/24 dev $WAN_IF
+sudo ip -n $ROUTER_NS link set $WAN_IF up
+sudo ip -n $ROUTER_NS route add $TARGET_NET via $PEER_IP
+sudo ip -n $WAN_NS addr add $PEER_IP/24 dev $WAN_PEER
+sudo ip -n $WAN_NS link set $WAN_PEER up
+sudo ip -n $WAN_NS route add local $TARGET_NET dev lo
+
+echo "0.0.0.0 0.0.0.0 $PEER_IP $WAN_IF" > "$CONF_DIR/routes.conf"
+touch "$CONF_DIR/firewall.rules" "$CONF_DIR/qos.rules"
+
+echo "[+] 启动反射端与路由器"
+sudo ip netns exec $WAN_NS "$LOADGEN" reflect --port $PORT --threads 2 &
+REFLECT_PID=$!
+# 不加 --quiet：要靠逐包日志确认回包没有经过用户态
+sudo ip netns exec $ROUTER_NS "$ROUTER" --tun $TUN_NAME --wan $WAN_IF \
+    --config-dir "$CONF_DIR" --offload > "$LOG" 2>&1 &
+ROUTER_PID=$!
+
+for _ in $(seq 50); do
+    sudo ip -n $ROUTER_NS link show $TUN_NAME >/dev/null 2>&1 && break
+    sleep 0.1
+done
+sleep 0.3
+
+sudo ip -n $ROUTER_NS addr add $TUN_IP/24 dev $TUN_NAME
+sudo ip -n $ROUTER_NS link set $TUN_NAME up
+sudo ip netns exec $ROUTER_NS sysctl -qw net.ipv4.conf.all.rp_filter=0 \
+    net.ipv4.conf.$TUN_NAME.rp_filter=0
+# 发往压测端口的本机流量走 TUN；路由器自己发出的 SNAT 报文仍查主表
+sudo ip -n $ROUTER_NS route add default dev $TUN_NAME src $TUN_IP table 100
+sudo ip -n $ROUTER_NS rule add pref 100 from $WAN_IP lookup main
+sudo ip -n $ROUTER_NS rule add pref 101 dport $PORT lookup 100
+
+echo "[+] 开始压测"
+sudo ip netns exec $ROUTER_NS "$LOADGEN" send --target 198.18.0.1 --port $PORT "$@"
+
+grep "\[Offload\]" "$LOG" || echo "[-] 快速路径未挂载"
+echo "[+] 用户态 DNAT 次数：$(grep -c '\[DNAT\] Matched' "$LOG" || true)"
+echo "[✓] 压测完成"